@@ -1,23 +1,202 @@
 #include <bits/stdc++.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "token_sets.h"
+#include "token_sink.h"
+#include "token_cache.h"
+#include "source_buffer.h"
+#include "utf8.h"
+#include "numeric_literal.h"
 using namespace std;
 
-unordered_set<string> keywords = {"int", "float", "double", "long", "return", "void", "if", "else", "while", "for"};
-unordered_set<char> singleOp = {'=', '+', '-', '*', '/', '<', '>', '!', '%'};
-unordered_set<string> multiOp = {"==","!=","<=",">=","++","--","+=","-=","*=","/="};
-unordered_set<char> special = {')','(','{','}',';',','};
+struct Lab3Keywords {
+    static constexpr string_view words[] = {"int", "float", "double", "long", "return", "void", "if", "else", "while", "for"};
+};
+struct Lab3MultiOps {
+    static constexpr string_view words[] = {"==","!=","<=",">=","++","--","+=","-=","*=","/="};
+};
+using Keywords = PerfectHashSet<Lab3Keywords>;
+using MultiOps = PerfectHashSet<Lab3MultiOps>;
+constexpr CharSet singleOp("=+-*/<>!%");
+constexpr CharSet special(")({};,");
 
+enum class SymbolType : uint8_t { Identifier, Literal, Integer, Float };
+
+const char *symbolTypeName(SymbolType t) {
+    switch (t) {
+    case SymbolType::Identifier: return "Identifier";
+    case SymbolType::Literal: return "Literal";
+    case SymbolType::Integer: return "Integer";
+    case SymbolType::Float: return "Float";
+    }
+    return "";
+}
+
+// Owns the text of every interned lexeme. Blocks are never moved or freed
+// while the table is alive, so string_views into them stay valid.
+class StringArena {
+    static const size_t BLOCK = 64 * 1024;
+    vector<unique_ptr<char[]>> blocks;
+    char *current = nullptr;
+    size_t used = BLOCK;
+public:
+    string_view intern(string_view s) {
+        if (s.size() > BLOCK / 4) {              // large lexemes get their own block
+            blocks.emplace_back(new char[s.size()]);
+            memcpy(blocks.back().get(), s.data(), s.size());
+            return string_view(blocks.back().get(), s.size());
+        }
+        if (used + s.size() > BLOCK) {
+            blocks.emplace_back(new char[BLOCK]);
+            current = blocks.back().get();
+            used = 0;
+        }
+        char *dst = current + used;
+        memcpy(dst, s.data(), s.size());
+        used += s.size();
+        return string_view(dst, s.size());
+    }
+};
+
+// Line numbers where a symbol occurs, stored as LEB128 deltas from the
+// previous occurrence. Lines only ever grow, so most entries take one byte.
+class LineList {
+    vector<uint8_t> bytes;
+    int last = 0;
+public:
+    void push_back(int line) {
+        unsigned delta = line - last;
+        last = line;
+        while (delta >= 0x80) {
+            bytes.push_back(uint8_t(delta | 0x80));
+            delta >>= 7;
+        }
+        bytes.push_back(uint8_t(delta));
+    }
+
+    class iterator {
+        const uint8_t *p;
+        int line = 0;
+        int decode(const uint8_t *q, const uint8_t **next) const {
+            unsigned v = 0;
+            int shift = 0;
+            while (*q & 0x80) { v |= unsigned(*q++ & 0x7f) << shift; shift += 7; }
+            v |= unsigned(*q++) << shift;
+            *next = q;
+            return int(v);
+        }
+    public:
+        iterator(const uint8_t *p, int line) : p(p), line(line) {}
+        int operator*() const {
+            const uint8_t *next;
+            return line + decode(p, &next);
+        }
+        iterator &operator++() {
+            line += decode(p, &p);
+            return *this;
+        }
+        bool operator!=(const iterator &o) const { return p != o.p; }
+    };
+    iterator begin() const { return iterator(bytes.data(), 0); }
+    iterator end() const { return iterator(bytes.data() + bytes.size(), 0); }
+
+    // The encoded form, for the token cache.
+    string_view encoded() const { return string_view(reinterpret_cast<const char *>(bytes.data()), bytes.size()); }
+    int lastLine() const { return last; }
+    void assign(string_view encoded, int lastLine) {
+        bytes.assign(encoded.begin(), encoded.end());
+        last = lastLine;
+    }
+};
+
+// A declared identifier gets an entry per declaration; constants, and
+// identifiers used without a declaration in sight, get one entry per lexeme
+// with scope -1 and lineDeclared 0.
 struct SymbolEntry {
     int entryNo;
-    string lexeme;
-    string tokenType;
+    string_view lexeme;
+    SymbolType tokenType;
+    int scope;              // nesting depth of the declaration, 0 for file scope
     int lineDeclared;
-    vector<int> lineUsed;
+    LineList lineUsed;
+    int shadowed = -1;      // entry this declaration hides until its scope closes
+    NumberValue value;      // Integer and Float constants that decode; zero otherwise
+};
+
+struct SymbolKey {
+    string_view lexeme;
+    SymbolType type;
+    bool operator==(const SymbolKey &o) const { return type == o.type && lexeme == o.lexeme; }
+};
+
+struct SymbolKeyHash {
+    size_t operator()(const SymbolKey &k) const {
+        return hash<string_view>()(k.lexeme) * 31 + size_t(k.type);
+    }
+};
+
+// Innermost declaration of every name, for all open scopes at once. A
+// declaration overwrites the name's binding and keeps the entry it hid in
+// SymbolEntry::shadowed; closing its scope writes that entry back. Names
+// are never removed, so probing is plain linear probing and a lookup costs
+// the same however deeply scopes nest.
+class ScopedSymbols {
+public:
+    struct Binding {
+        string_view name;
+        int entry = -1;         // index in symbolTable, -1 if no declaration is in scope
+        int undeclared = -1;    // entry collecting uses with no declaration in scope
+    };
+
+    explicit ScopedSymbols(StringArena &arena) : arena(arena), slots(1024) {}
+
+    Binding *find(string_view name) {
+        Binding &b = slots[probe(name)];
+        return b.name.data() ? &b : nullptr;
+    }
+
+    // The name's binding, added (interned, with no entry) if it is new.
+    Binding &bind(string_view name) {
+        size_t i = probe(name);
+        if (slots[i].name.data()) return slots[i];
+        if (2 * (count + 1) > slots.size()) {
+            grow();
+            i = probe(name);
+        }
+        count++;
+        slots[i].name = arena.intern(name);
+        return slots[i];
+    }
+
+private:
+    StringArena &arena;
+    vector<Binding> slots;      // power-of-two size, at most half full
+    size_t count = 0;
+
+    size_t probe(string_view name) const {
+        size_t mask = slots.size() - 1;
+        size_t i = hash<string_view>()(name) & mask;
+        while (slots[i].name.data() && slots[i].name != name) i = (i + 1) & mask;
+        return i;
+    }
+
+    void grow() {
+        vector<Binding> old(slots.size() * 2);
+        old.swap(slots);
+        for (const Binding &b : old)
+            if (b.name.data()) slots[probe(b.name)] = b;
+    }
 };
 
 vector<SymbolEntry> symbolTable;
+StringArena symbolArena;
+unordered_map<SymbolKey, int, SymbolKeyHash> symbolIndex;   // constants -> index in symbolTable
+ScopedSymbols scopedSymbols(symbolArena);
 
-bool isKeyword(string s) {
-    return keywords.find(s) != keywords.end();
+bool isKeyword(string_view s) {
+    return Keywords::contains(s);
 }
 
 bool isIdentifierStart(char c) {
@@ -27,28 +206,272 @@ bool isIdentifierChar(char c) {
     return isalnum(c) || c == '_';
 }
 
-void addToSymbolTable(string lexeme, string type, int line) {
-    // check for existing entry
-    for (auto &e : symbolTable) {
-        if (e.lexeme == lexeme && e.tokenType == type) {
-            e.lineUsed.push_back(line);
-            return;
-        }
+// Source text is UTF-8 (utf8.h). An identifier may also start with an
+// XID_Start character and go on with XID_Continue ones; ≠ ≤ ≥ are the
+// operators != <= >=. Anything else non-ASCII is one unrecognized symbol,
+// and bytes that are not UTF-8 are an error, in literals and comments too.
+bool isUnicodeIdentifierStart(const char *p, const char *end) {
+    size_t n = utf8SequenceLength(p, end);
+    return n && isXidStart(decodeUtf8(p, n));
+}
+
+const char *identifierEnd(const char *p, const char *end) {
+    for (;;) {
+        while (p < end && isIdentifierChar(*p)) p++;
+        const char *q = skipXidContinue(p, end);
+        if (q == p) return p;
+        p = q;
+    }
+}
+
+// The operator the n-byte character at p spells, if this lexer has it.
+string_view unicodeOperator(const char *p, size_t n) {
+    string_view op = asciiOperator(decodeUtf8(p, n));
+    return !op.empty() && MultiOps::contains(op) ? op : string_view();
+}
+
+string invalidUtf8Message(string_view bytes) {
+    return "Invalid UTF-8 sequence '" + utf8Escaped(bytes) + "'";
+}
+
+void addToSymbolTable(string_view lexeme, SymbolType type, int line) {
+    auto it = symbolIndex.find(SymbolKey{lexeme, type});
+    if (it != symbolIndex.end()) {
+        symbolTable[it->second].lineUsed.push_back(line);
+        return;
     }
     SymbolEntry newEntry;
     newEntry.entryNo = symbolTable.size() + 1;
-    newEntry.lexeme = lexeme;
+    newEntry.lexeme = symbolArena.intern(lexeme);
     newEntry.tokenType = type;
-    newEntry.lineDeclared = line;
+    newEntry.scope = -1;
+    newEntry.lineDeclared = 0;
     newEntry.lineUsed.push_back(line);
-    symbolTable.push_back(newEntry);
+    if (type == SymbolType::Integer || type == SymbolType::Float) decodeNumber(lexeme, newEntry.value);
+    symbolIndex.emplace(SymbolKey{newEntry.lexeme, type}, int(symbolTable.size()));
+    symbolTable.push_back(move(newEntry));
 }
 
-void process(const string &filename) {
+enum class TokenKind { Keyword, Identifier, Integer, Float, Literal, Operator, Special,
+                       UnterminatedLiteral, Unrecognized, InvalidUtf8 };
+
+// Scopes open at '{' and close at the matching '}'. A '(' opens one too,
+// so parameters and for-loop variables have somewhere to live: when the
+// ')' is followed by '{' the two are one scope, as in a function body or
+// loop body, and otherwise it closes at the ')'. The parentheses of a for
+// with an unbraced body stay open over that body instead, up to the ';'
+// that ends it or the '}' of a block inside it. An unmatched closer is
+// ignored.
+struct Scope {
+    size_t firstDecl;       // its declarations start here in scopeDecls
+    bool paren;
+    bool forHeader;         // the '(' of a for
+    bool forBody;           // ...whose ')' is behind us, in an unbraced body
+};
+
+vector<Scope> scopes;       // open scopes, innermost last; file scope is not on it
+vector<int> scopeDecls;     // entries declared in the open scopes, in order
+int openBraces = 0;
+bool parenClosing = false;  // a ')' has been seen; the next token decides
+bool afterFor = false;      // the last token was the keyword for
+
+// A declaration is a type keyword followed by declarators: every
+// identifier that comes where a declarator name can -- after the type,
+// after '*', or after a ',' at the declaration's own nesting level --
+// is declared. Everything else is a use.
+enum class DeclState { None, ExpectName, InDeclarator };
+DeclState declState = DeclState::None;
+size_t declDepth = 0;       // scopes.size() at the type keyword
+
+bool isTypeKeyword(string_view s) {
+    return s == "int" || s == "float" || s == "double" || s == "long" || s == "void";
+}
+
+void declareSymbol(string_view name, int line) {
+    ScopedSymbols::Binding &b = scopedSymbols.bind(name);
+    SymbolEntry newEntry;
+    newEntry.entryNo = symbolTable.size() + 1;
+    newEntry.lexeme = b.name;
+    newEntry.tokenType = SymbolType::Identifier;
+    newEntry.scope = int(scopes.size());
+    newEntry.lineDeclared = line;
+    newEntry.shadowed = b.entry;
+    b.entry = int(symbolTable.size());
+    if (!scopes.empty()) scopeDecls.push_back(b.entry);
+    symbolTable.push_back(move(newEntry));
+}
+
+void useSymbol(string_view name, int line) {
+    ScopedSymbols::Binding &b = scopedSymbols.bind(name);
+    if (b.entry < 0 && b.undeclared < 0) {
+        SymbolEntry newEntry;
+        newEntry.entryNo = symbolTable.size() + 1;
+        newEntry.lexeme = b.name;
+        newEntry.tokenType = SymbolType::Identifier;
+        newEntry.scope = -1;
+        newEntry.lineDeclared = 0;
+        b.undeclared = int(symbolTable.size());
+        symbolTable.push_back(move(newEntry));
+    }
+    symbolTable[b.entry >= 0 ? b.entry : b.undeclared].lineUsed.push_back(line);
+}
+
+void closeScope() {
+    Scope s = scopes.back();
+    scopes.pop_back();
+    if (!s.paren) openBraces--;
+    while (scopeDecls.size() > s.firstDecl) {
+        const SymbolEntry &e = symbolTable[scopeDecls.back()];
+        scopedSymbols.find(e.lexeme)->entry = e.shadowed;
+        scopeDecls.pop_back();
+    }
+}
+
+// Closes the bodies of unbraced for loops that end here.
+void closeForBodies() {
+    while (!scopes.empty() && scopes.back().forBody) closeScope();
+}
+
+// Feeds every token, in order, to the scope and declaration tracking.
+void trackSymbol(TokenKind kind, string_view text, int line) {
+    bool forParen = afterFor;
+    afterFor = kind == TokenKind::Keyword && text == "for";
+    if (parenClosing) {
+        parenClosing = false;
+        if (kind == TokenKind::Special && text[0] == '{') {
+            scopes.back().paren = false;
+            openBraces++;
+            declState = DeclState::None;
+            return;
+        }
+        if (scopes.back().forHeader) scopes.back().forBody = true;
+        else closeScope();
+    }
+
+    switch (kind) {
+    case TokenKind::Keyword:
+        if (isTypeKeyword(text)) {
+            declState = DeclState::ExpectName;
+            declDepth = scopes.size();
+        } else {
+            declState = DeclState::None;
+        }
+        break;
+    case TokenKind::Identifier:
+        if (declState == DeclState::ExpectName) {
+            declareSymbol(text, line);
+            declState = DeclState::InDeclarator;
+        } else {
+            useSymbol(text, line);
+        }
+        break;
+    case TokenKind::Literal:
+        addToSymbolTable(text, SymbolType::Literal, line);
+        if (declState == DeclState::ExpectName) declState = DeclState::None;
+        break;
+    case TokenKind::Integer:
+    case TokenKind::Float:
+        addToSymbolTable(text, kind == TokenKind::Float ? SymbolType::Float : SymbolType::Integer, line);
+        if (declState == DeclState::ExpectName) declState = DeclState::None;
+        break;
+    case TokenKind::Operator:
+        if (declState == DeclState::ExpectName && text != "*") declState = DeclState::None;
+        break;
+    case TokenKind::Special:
+        switch (text[0]) {
+        case '(':
+            scopes.push_back({scopeDecls.size(), true, forParen, false});
+            break;
+        case ')':
+            if (scopes.empty() || !scopes.back().paren || scopes.back().forBody) break;
+            if (declDepth == scopes.size()) declState = DeclState::None;
+            parenClosing = true;
+            break;
+        case '{':
+            declState = DeclState::None;
+            scopes.push_back({scopeDecls.size(), false, false, false});
+            openBraces++;
+            break;
+        case '}':
+            declState = DeclState::None;
+            if (openBraces == 0) break;
+            while (scopes.back().paren) closeScope();
+            closeScope();
+            closeForBodies();
+            break;
+        case ';':
+            declState = DeclState::None;
+            closeForBodies();
+            break;
+        case ',':
+            if (declState == DeclState::InDeclarator && declDepth == scopes.size())
+                declState = DeclState::ExpectName;
+            break;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+// "Kind: lexeme" / "Lexical Error: ... at line N" -- the listing this lexer
+// has always printed.
+class Lab3TextSink : public TokenSink {
+public:
+    void token(int, int, string_view kind, string_view lexeme) override {
+        out.put(kind);
+        out.put(string_view(": "));
+        out.put(lexeme);
+        out.put('\n');
+    }
+    void error(int line, int column, string_view message) override {
+        out.put(string_view("Lexical Error: "));
+        out.put(message);
+        out.put(string_view(" at line "));
+        out.put(line);
+        out.put(string_view(", column "));
+        out.put(column);
+        out.put('\n');
+    }
+};
+
+unique_ptr<TokenSink> sink;
+
+// Integer and Float lexemes end where the digits-and-dots rule says, as
+// they always have; their values are decoded as C literals
+// (numeric_literal.h). One too big for its type, or a bad octal one like
+// "08", is listed as usual and reported after it.
+void checkNumber(string_view text, int line, int column) {
+    NumberValue v;
+    switch (decodeNumber(text, v)) {
+    case NumberError::OutOfRange:
+        sink->error(line, column, "Numeric literal out of range '" + string(text) + "'");
+        break;
+    case NumberError::Malformed:
+        sink->error(line, column, "Invalid numeric literal '" + string(text) + "'");
+        break;
+    case NumberError::None:
+        break;
+    }
+}
+
+void printSymbolTable(ostream &os) {
+    os << "\n===== SYMBOL TABLE =====\n";
+    os << "Entry\tLexeme\t\tToken Type\tScope\tDeclared\tUsed Lines\n";
+    for (auto &e : symbolTable) {
+        os << e.entryNo << "\t" << e.lexeme << "\t\t" << symbolTypeName(e.tokenType) << "\t\t";
+        if (e.lineDeclared) os << e.scope << "\t" << e.lineDeclared << "\t\t";
+        else os << "-\t-\t\t";
+        for (int ln : e.lineUsed) os << ln << " ";
+        os << '\n';
+    }
+}
+
+bool process(const string &filename) {
     ifstream file(filename);
     if (!file.is_open()) {
         cout << "Error opening file\n";
-        return;
+        return false;
     }
 
     string line;
@@ -58,13 +481,20 @@ void process(const string &filename) {
     while (getline(file, line)) {
         lineNo++;
         int i = 0, len = line.length();
+        const char *text = line.data();
+        auto invalidUtf8 = [lineNo, text](const char *bad, size_t n) {
+            sink->error(lineNo, int(bad - text) + 1, invalidUtf8Message(string_view(bad, n)));
+        };
 
         while (i < len) {
             char c = line[i];
 
             if (isspace(c)) { i++; continue; }
 
-            if (c == '/' && i+1 < len && line[i+1] == '/') break;
+            if (c == '/' && i+1 < len && line[i+1] == '/') {
+                forEachInvalidUtf8(text + i + 2, text + len, invalidUtf8);
+                break;
+            }
 
             if (c == '/' && i+1 < len && line[i+1] == '*') {
                 inMultiComment = true;
@@ -76,10 +506,16 @@ void process(const string &filename) {
                 if (c == '*' && i+1 < len && line[i+1] == '/') {
                     inMultiComment = false;
                     i += 2;
+                } else if ((unsigned char)c >= 0x80) {
+                    size_t n = utf8SequenceLength(text + i, text + len);
+                    if (!n) invalidUtf8(text + i, n = utf8ErrorLength(text + i, text + len));
+                    i += n;
                 } else i++;
                 continue;
             }
 
+            int col = i + 1;
+
             if (c == '"') {
                 string literal = "";
                 i++; 
@@ -88,24 +524,25 @@ void process(const string &filename) {
                 }
                 if (i < len && line[i] == '"') {
                     i++;
-                    cout << "Literal: \"" << literal << "\"\n";
-                    addToSymbolTable("\"" + literal + "\"", "Literal", lineNo);
+                    string quoted = "\"" + literal + "\"";
+                    sink->token(lineNo, col, "Literal", quoted);
+                    trackSymbol(TokenKind::Literal, quoted, lineNo);
+                    forEachInvalidUtf8(text + col - 1, text + i, invalidUtf8);
                 } else {
-                    cout << "Lexical Error: Unterminated string literal at line " << lineNo << endl;
+                    sink->error(lineNo, col, "Unterminated string literal");
                 }
                 continue;
             }
 
-            if (isIdentifierStart(c)) {
-                string token = "";
-                while (i < len && isIdentifierChar(line[i])) {
-                    token += line[i++];
-                }
+            if (isIdentifierStart(c) || ((unsigned char)c >= 0x80 && isUnicodeIdentifierStart(text + i, text + len))) {
+                string_view token(text + i, identifierEnd(text + i, text + len) - (text + i));
+                i += token.size();
                 if (isKeyword(token)) {
-                    cout << "Keyword: " << token << endl;
+                    sink->token(lineNo, col, "Keyword", token);
+                    trackSymbol(TokenKind::Keyword, token, lineNo);
                 } else {
-                    cout << "Identifier: " << token << endl;
-                    addToSymbolTable(token, "Identifier", lineNo);
+                    sink->token(lineNo, col, "Identifier", token);
+                    trackSymbol(TokenKind::Identifier, token, lineNo);
                 }
                 continue;
             }
@@ -122,60 +559,383 @@ void process(const string &filename) {
                     number += line[i++];
                 }
                 if (isFloat) {
-                    cout << "Float: " << number << endl;
-                    addToSymbolTable(number, "Float", lineNo);
+                    sink->token(lineNo, col, "Float", number);
+                    trackSymbol(TokenKind::Float, number, lineNo);
                 } else {
-                    cout << "Integer: " << number << endl;
-                    addToSymbolTable(number, "Integer", lineNo);
+                    sink->token(lineNo, col, "Integer", number);
+                    trackSymbol(TokenKind::Integer, number, lineNo);
                 }
+                checkNumber(number, lineNo, col);
                 continue;
             }
 
             if (i+1 < len) {
-                string op = string(1, c) + line[i+1];
-                if (multiOp.find(op) != multiOp.end()) {
-                    cout << "Operator: " << op << endl;
+                string_view op(line.data() + i, 2);
+                if (MultiOps::contains(op)) {
+                    sink->token(lineNo, col, "Operator", op);
+                    trackSymbol(TokenKind::Operator, op, lineNo);
                     i += 2;
                     continue;
                 }
             }
 
         
-            if (singleOp.find(c) != singleOp.end()) {
-                cout << "Operator: " << c << endl;
+            if (singleOp.contains(c)) {
+                sink->token(lineNo, col, "Operator", string_view(&c, 1));
+                trackSymbol(TokenKind::Operator, string_view(&c, 1), lineNo);
                 i++;
                 continue;
             }
 
-            if (special.find(c) != special.end()) {
-                cout << "Special Symbol: " << c << endl;
+            if (special.contains(c)) {
+                sink->token(lineNo, col, "Special Symbol", string_view(&c, 1));
+                trackSymbol(TokenKind::Special, string_view(&c, 1), lineNo);
                 i++;
                 continue;
             }
 
-            cout << "Lexical Error: Unrecognized symbol '" << c << "' at line " << lineNo << endl;
+            if ((unsigned char)c >= 0x80) {
+                size_t n = utf8SequenceLength(text + i, text + len);
+                if (!n) {
+                    invalidUtf8(text + i, n = utf8ErrorLength(text + i, text + len));
+                } else if (string_view op = unicodeOperator(text + i, n); !op.empty()) {
+                    sink->token(lineNo, col, "Operator", op);
+                    trackSymbol(TokenKind::Operator, op, lineNo);
+                } else {
+                    sink->error(lineNo, col, "Unrecognized symbol '" + string(text + i, n) + "'");
+                }
+                i += n;
+                continue;
+            }
+
+            sink->error(lineNo, col, string("Unrecognized symbol '") + c + "'");
             i++;
         }
     }
 
     file.close();
-    
-    cout << "\n===== SYMBOL TABLE =====\n";
-    cout << "Entry\tLexeme\t\tToken Type\tDeclared\tUsed Lines\n";
-    for (auto &e : symbolTable) {
-        cout << e.entryNo << "\t" << e.lexeme << "\t\t" << e.tokenType << "\t\t"
-             << e.lineDeclared << "\t\t";
-        for (int ln : e.lineUsed) cout << ln << " ";
-        cout << endl;
+    return true;
+}
+
+// Token produced by the mapped lexer: a view into the mapped file, nothing is
+// copied until the lexeme is added to the symbol table. Its line and column
+// are looked up from its offset when it is printed.
+struct TokenView {
+    TokenKind kind;
+    size_t offset;
+    size_t length;
+};
+
+struct MappedFile {
+    const char *data = nullptr;
+    size_t size = 0;
+    int fd = -1;
+
+    bool open(const string &filename) {
+        fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) < 0) return false;
+        size = st.st_size;
+        if (size == 0) return true;          // mmap rejects empty mappings
+        void *p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) { size = 0; return false; }
+        madvise(p, size, MADV_SEQUENTIAL);
+        data = static_cast<const char *>(p);
+        return true;
+    }
+    ~MappedFile() {
+        if (data) munmap(const_cast<char *>(data), size);
+        if (fd >= 0) ::close(fd);
+    }
+};
+
+// Same rules as process(), but over the whole buffer: the lines come from
+// the buffer's line index, and the multi-line comment state is carried
+// across lines exactly as the getline loop does.
+template <class Emit>
+void lexMapped(const SourceBuffer &src, Emit emit) {
+    const char *buf = src.text().data();
+    const size_t size = src.text().size();
+    const vector<uint32_t> &starts = src.lineStarts();
+    bool inMultiComment = false;
+    auto invalidUtf8 = [&emit, buf](const char *bad, size_t n) {
+        emit(TokenView{TokenKind::InvalidUtf8, size_t(bad - buf), n});
+    };
+
+    for (size_t k = 0; k < starts.size(); k++) {
+        size_t len = k + 1 < starts.size() ? starts[k + 1] - 1 : size;   // end of line k, before its '\n'
+        size_t i = starts[k];
+
+        while (i < len) {
+            char c = buf[i];
+
+            if (isspace(c)) { i++; continue; }
+
+            if (c == '/' && i+1 < len && buf[i+1] == '/') {
+                forEachInvalidUtf8(buf + i + 2, buf + len, invalidUtf8);
+                break;
+            }
+
+            if (c == '/' && i+1 < len && buf[i+1] == '*') {
+                inMultiComment = true;
+                i += 2;
+                continue;
+            }
+
+            if (inMultiComment) {
+                if (c == '*' && i+1 < len && buf[i+1] == '/') {
+                    inMultiComment = false;
+                    i += 2;
+                } else if ((unsigned char)c >= 0x80) {
+                    size_t n = utf8SequenceLength(buf + i, buf + len);
+                    if (!n) invalidUtf8(buf + i, n = utf8ErrorLength(buf + i, buf + len));
+                    i += n;
+                } else i++;
+                continue;
+            }
+
+            size_t start = i;
+
+            if (c == '"') {
+                const char *q = static_cast<const char *>(memchr(buf + i + 1, '"', len - i - 1));
+                if (q) {
+                    i = q - buf + 1;
+                    emit(TokenView{TokenKind::Literal, start, i - start});
+                    forEachInvalidUtf8(buf + start, buf + i, invalidUtf8);
+                } else {
+                    i = len;
+                    emit(TokenView{TokenKind::UnterminatedLiteral, start, 1});
+                }
+                continue;
+            }
+
+            if (isIdentifierStart(c) || ((unsigned char)c >= 0x80 && isUnicodeIdentifierStart(buf + i, buf + len))) {
+                i = identifierEnd(buf + i, buf + len) - buf;
+                bool kw = isKeyword(string_view(buf + start, i - start));
+                emit(TokenView{kw ? TokenKind::Keyword : TokenKind::Identifier, start, i - start});
+                continue;
+            }
+
+            if (isdigit(c)) {
+                bool isFloat = false;
+                while (i < len && (isdigit(buf[i]) || buf[i] == '.')) {
+                    if (buf[i] == '.') {
+                        if (isFloat) break;
+                        isFloat = true;
+                    }
+                    i++;
+                }
+                emit(TokenView{isFloat ? TokenKind::Float : TokenKind::Integer, start, i - start});
+                continue;
+            }
+
+            if (i+1 < len && MultiOps::contains(string_view(buf + i, 2))) {
+                i += 2;
+                emit(TokenView{TokenKind::Operator, start, 2});
+                continue;
+            }
+
+            if (singleOp.contains(c)) {
+                emit(TokenView{TokenKind::Operator, start, 1});
+                i++;
+                continue;
+            }
+
+            if (special.contains(c)) {
+                emit(TokenView{TokenKind::Special, start, 1});
+                i++;
+                continue;
+            }
+
+            if ((unsigned char)c >= 0x80) {
+                size_t n = utf8SequenceLength(buf + i, buf + len);
+                if (!n) invalidUtf8(buf + i, n = utf8ErrorLength(buf + i, buf + len));
+                else emit(TokenView{unicodeOperator(buf + i, n).empty() ? TokenKind::Unrecognized : TokenKind::Operator, start, n});
+                i += n;
+                continue;
+            }
+
+            emit(TokenView{TokenKind::Unrecognized, start, 1});
+            i++;
+        }
     }
 }
-int main() {
-    string name;
-    cout << "Enter file name: ";
-    cin >> name;
-    process(name);
+
+void emitToken(const TokenView &t, string_view text, LineCol at) {
+    switch (t.kind) {
+    case TokenKind::Literal:
+        sink->token(at.line, at.column, "Literal", text);
+        break;
+    case TokenKind::UnterminatedLiteral:
+        sink->error(at.line, at.column, "Unterminated string literal");
+        break;
+    case TokenKind::Keyword:
+        sink->token(at.line, at.column, "Keyword", text);
+        break;
+    case TokenKind::Identifier:
+        sink->token(at.line, at.column, "Identifier", text);
+        break;
+    case TokenKind::Float:
+        sink->token(at.line, at.column, "Float", text);
+        checkNumber(text, at.line, at.column);
+        break;
+    case TokenKind::Integer:
+        sink->token(at.line, at.column, "Integer", text);
+        checkNumber(text, at.line, at.column);
+        break;
+    case TokenKind::Operator:
+        sink->token(at.line, at.column, "Operator", (unsigned char)text[0] >= 0x80 ? asciiOperator(text) : text);
+        break;
+    case TokenKind::Special:
+        sink->token(at.line, at.column, "Special Symbol", text);
+        break;
+    case TokenKind::Unrecognized:
+        sink->error(at.line, at.column, "Unrecognized symbol '" + string(text) + "'");
+        break;
+    case TokenKind::InvalidUtf8:
+        sink->error(at.line, at.column, invalidUtf8Message(text));
+        break;
+    }
 }
 
+// Cache entry layout. Lexemes and encoded line lists share one text section.
+enum CacheSection : uint32_t { CACHE_TOKENS = 1, CACHE_SYMBOLS, CACHE_SYMBOL_TEXT };
+const char *const CACHE_TOOL = "22BCE1126_LAB-3/6";
 
+struct CachedToken {
+    uint32_t offset, length;
+    TokenKind kind;
+};
+
+struct CachedSymbol {
+    uint32_t lexemeOffset, lexemeLength, linesOffset, linesLength;
+    int32_t scope, lineDeclared, lastLine;
+    SymbolType type;
+    NumberValue value;
+};
+
+// Replays a cached result: the listing from the stored tokens, the symbol
+// table as stored.
+void replayCached(const CacheEntry &hit, const SourceBuffer &src) {
+    LineCursor cursor(src);
+    for (const CachedToken &c : hit.array<CachedToken>(CACHE_TOKENS))
+        emitToken(TokenView{c.kind, c.offset, c.length}, src.text().substr(c.offset, c.length),
+                  cursor.locate(c.offset));
+
+    string_view text = hit.section(CACHE_SYMBOL_TEXT);
+    for (const CachedSymbol &c : hit.array<CachedSymbol>(CACHE_SYMBOLS)) {
+        SymbolEntry e;
+        e.entryNo = symbolTable.size() + 1;
+        e.lexeme = symbolArena.intern(text.substr(c.lexemeOffset, c.lexemeLength));
+        e.tokenType = c.type;
+        e.scope = c.scope;
+        e.lineDeclared = c.lineDeclared;
+        e.lineUsed.assign(text.substr(c.linesOffset, c.linesLength), c.lastLine);
+        e.value = c.value;
+        symbolTable.push_back(move(e));
+    }
+}
+
+void storeCached(TokenCache &cache, const CacheKey &key, const vector<CachedToken> &tokens) {
+    vector<CachedSymbol> symbols;
+    string text;
+    for (const SymbolEntry &e : symbolTable) {
+        CachedSymbol c{};
+        c.lexemeOffset = text.size();
+        c.lexemeLength = e.lexeme.size();
+        text += e.lexeme;
+        c.linesOffset = text.size();
+        c.linesLength = e.lineUsed.encoded().size();
+        text += e.lineUsed.encoded();
+        c.scope = e.scope;
+        c.lineDeclared = e.lineDeclared;
+        c.lastLine = e.lineUsed.lastLine();
+        c.type = e.tokenType;
+        c.value = e.value;
+        symbols.push_back(c);
+    }
+    CacheWriter w;
+    w.add(CACHE_TOKENS, tokens);
+    w.add(CACHE_SYMBOLS, symbols);
+    w.add(CACHE_SYMBOL_TEXT, text.data(), text.size());
+    cache.store(key, w);
+}
+
+// With a cache, an unchanged file is not lexed again: its listing and
+// symbol table come from the entry stored the first time.
+bool processMapped(const string &filename, TokenCache *cache = nullptr) {
+    MappedFile mf;
+    if (!mf.open(filename)) {
+        cout << "Error opening file\n";
+        return false;
+    }
+
+    const char *buf = mf.data;
+    SourceBuffer src(string_view(buf, mf.size));
+    CacheKey key{};
+    if (cache) {
+        key = makeCacheKey(src.text(), CACHE_TOOL);
+        if (CacheEntry hit = cache->lookup(key)) {
+            replayCached(hit, src);
+            return true;
+        }
+    }
 
+    vector<CachedToken> record;
+    LineCursor cursor(src);
+    lexMapped(src, [&](const TokenView &t) {
+        string_view text(buf + t.offset, t.length);
+        LineCol at = cursor.locate(t.offset);
+        emitToken(t, text, at);
+        trackSymbol(t.kind, text, at.line);
+        if (cache) record.push_back({uint32_t(t.offset), uint32_t(t.length), t.kind});
+    });
+    if (cache) storeCached(*cache, key, record);
+    return true;
+}
 
+int main(int argc, char *argv[]) {
+    // Usage: ./a.out [--mmap] [--format=text|csv|jsonl] [--quiet]
+    //               [--cache=DIR [--cache-size=MB]] [file]
+    //        (prompts for the file name if none given; --cache implies --mmap)
+    // With csv/jsonl the symbol table goes to stderr so stdout stays one
+    // record per line; --quiet prints only the symbol table.
+    bool useMmap = false, quiet = false;
+    string name, format = "text", cacheDir;
+    uint64_t cacheMB = 256;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--mmap") useMmap = true;
+        else if (arg == "--quiet") quiet = true;
+        else if (arg.rfind("--format=", 0) == 0) format = arg.substr(9);
+        else if (arg.rfind("--cache=", 0) == 0) cacheDir = arg.substr(8);
+        else if (arg.rfind("--cache-size=", 0) == 0) {
+            const char *first = arg.data() + 13, *last = arg.data() + arg.size();
+            from_chars_result r = from_chars(first, last, cacheMB);
+            if (r.ec != errc() || r.ptr != last || cacheMB > UINT64_MAX >> 20) {
+                cerr << "Bad --cache-size value '" << arg.substr(13) << "' (expected a number of MB)\n";
+                return 1;
+            }
+        }
+        else name = arg;
+    }
+    sink = makeTokenSink<Lab3TextSink>(format, quiet);
+    if (!sink) {
+        cerr << "Unknown format '" << format << "' (expected text, csv or jsonl)\n";
+        return 1;
+    }
+    if (name.empty()) {
+        cout << "Enter file name: ";
+        cin >> name;
+    }
+    bool ok;
+    if (!cacheDir.empty()) {
+        TokenCache cache(cacheDir, cacheMB << 20);
+        ok = processMapped(name, &cache);
+    } else {
+        ok = useMmap ? processMapped(name) : process(name);
+    }
+    sink->flush();
+    if (ok) printSymbolTable(format == "text" || quiet ? cout : cerr);
+}
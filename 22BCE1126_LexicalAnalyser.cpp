@@ -1,185 +1,461 @@
 #include <iostream>
 #include <fstream>
-#include <unordered_set>
 #include <string>
 #include <cctype>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <charconv>
+#include <filesystem>
+#include <thread>
+#include "token_sets.h"
+#include "token_sink.h"
+#include "source_buffer.h"
+#include "work_pool.h"
+#include "arena.h"
+#include "lex_profile.h"
+#include "utf8.h"
 using namespace std;
 
-unordered_set<string> keywords = {
-    "auto", "break", "case", "char", "const", "continue", "default", "do",
-    "double", "else", "enum", "float", "for", "goto", "if", "int", "long",
-    "register", "return", "short", "signed", "sizeof", "static", "struct",
-    "switch", "typedef", "union", "unsigned", "void", "volatile", "while"
+struct CKeywords {
+    static constexpr string_view words[] = {
+        "auto", "break", "case", "char", "const", "continue", "default", "do",
+        "double", "else", "enum", "float", "for", "goto", "if", "int", "long",
+        "register", "return", "short", "signed", "sizeof", "static", "struct",
+        "switch", "typedef", "union", "unsigned", "void", "volatile", "while"
+    };
 };
 
-unordered_set<string> operators = {
-    "+", "-", "*", "/", "%", "++", "--", "==", "!=", "<", "<=", ">", ">=",
-    "&&", "||", "!", "=", "+=", "-=", "*=", "/=", "%=", "&", "|", "^", "~", "<<", ">>"
+struct COperators {
+    static constexpr string_view words[] = {
+        "+", "-", "*", "/", "%", "++", "--", "==", "!=", "<", "<=", ">", ">=",
+        "&&", "||", "!", "=", "+=", "-=", "*=", "/=", "%=", "&", "|", "^", "~", "<<", ">>"
+    };
 };
 
-unordered_set<char> special_symbols = {'(', ')', '{', '}', ';', ','};
+using Keywords = PerfectHashSet<CKeywords>;
+using Operators = PerfectHashSet<COperators>;
+constexpr CharSet special_symbols("(){};,");
 
-bool isKeyword(const string& word);
-bool isOperator(const string& op);
+bool isKeyword(string_view word);
+bool isOperator(string_view op);
 bool isSpecialSymbol(char ch);
-bool isValidIdentifier(const string& word);
-bool isNumber(const string& word);
-void processFile(const string& filename);
+bool isValidIdentifier(string_view word);
+bool isNumber(string_view word);
 
-int keywordCount = 0, identifierCount = 0, numberCount = 0;
-int operatorCount = 0, specialCount = 0, literalCount = 0, errorCount = 0;
+// Per-file (and, in batch mode, per-thread) tallies; summed at the end.
+struct TokenCounts {
+    long long keywordCount = 0, identifierCount = 0, numberCount = 0;
+    long long operatorCount = 0, specialCount = 0, literalCount = 0, errorCount = 0;
 
-int main() {
-    string filename;
-    filename="hello.cpp";
-    
-    processFile(filename);
-    
-    cout << "\n--- Token Counts ---\n";
-    cout << "Keywords: " << keywordCount << endl;
-    cout << "Identifiers: " << identifierCount << endl;
-    cout << "Numbers: " << numberCount << endl;
-    cout << "Operators: " << operatorCount << endl;
-    cout << "Special Symbols: " << specialCount << endl;
-    cout << "Literals: " << literalCount << endl;
-    cout << "Errors: " << errorCount << endl;
+    TokenCounts& operator+=(const TokenCounts& o) {
+        keywordCount += o.keywordCount;
+        identifierCount += o.identifierCount;
+        numberCount += o.numberCount;
+        operatorCount += o.operatorCount;
+        specialCount += o.specialCount;
+        literalCount += o.literalCount;
+        errorCount += o.errorCount;
+        return *this;
+    }
+};
+
+template <class Profile>
+bool processFile(const string& filename, TokenSink& sink, TokenCounts& counts, Arena& arena, Profile& prof);
+
+// "[Line N] kind: lexeme" -- the listing this lexer has always printed.
+class AnalyserTextSink : public TokenSink {
+public:
+    void token(int line, int, string_view kind, string_view lexeme) override {
+        out.put(string_view("[Line "));
+        out.put(line);
+        out.put(string_view("] "));
+        out.put(kind);
+        out.put(string_view(": "));
+        out.put(lexeme);
+        out.put('\n');
+    }
+    void error(int line, int column, string_view message) override {
+        out.put(string_view("[Line "));
+        out.put(line);
+        out.put(string_view(", Col "));
+        out.put(column);
+        out.put(string_view("] ERROR: "));
+        out.put(message);
+        out.put('\n');
+    }
+};
+
+void printCounts(ostream& os, const TokenCounts& c) {
+    os << "\n--- Token Counts ---\n";
+    os << "Keywords: " << c.keywordCount << endl;
+    os << "Identifiers: " << c.identifierCount << endl;
+    os << "Numbers: " << c.numberCount << endl;
+    os << "Operators: " << c.operatorCount << endl;
+    os << "Special Symbols: " << c.specialCount << endl;
+    os << "Literals: " << c.literalCount << endl;
+    os << "Errors: " << c.errorCount << endl;
+}
+
+// Batch inputs: directories are walked recursively for C/C++ sources,
+// "@list" names a file with one path per line, anything else is a file.
+// The result is sorted so reports do not depend on directory order.
+vector<string> collectBatchFiles(const vector<string>& args) {
+    static const string_view sourceExts[] = {".c", ".h", ".cc", ".cpp", ".cxx", ".hpp"};
+    vector<string> files;
+    for (const string& arg : args) {
+        if (arg[0] == '@') {
+            ifstream list(arg.substr(1));
+            if (!list) cerr << "Error opening file list " << arg.substr(1) << "\n";
+            for (string line; getline(list, line); )
+                if (!line.empty()) files.push_back(line);
+        } else if (filesystem::is_directory(arg)) {
+            for (const auto& entry : filesystem::recursive_directory_iterator(arg)) {
+                string ext = entry.path().extension().string();
+                if (entry.is_regular_file() && find(begin(sourceExts), end(sourceExts), ext) != end(sourceExts))
+                    files.push_back(entry.path().string());
+            }
+        } else {
+            files.push_back(arg);
+        }
+    }
+    sort(files.begin(), files.end());
+    return files;
+}
+
+// Lexes every file on a work-stealing pool. Token records are dropped; each
+// worker adds into its own TokenCounts, and the per-file lines and the
+// merged totals are printed in file order once all workers are done.
+int runBatch(const vector<string>& files, unsigned jobs) {
+    struct FileResult {
+        TokenCounts counts;
+        bool opened = false;
+    };
+    struct alignas(64) WorkerState {
+        TokenCounts counts;
+        NullSink discard;
+        Arena text;             // the file being lexed; reused for the next one
+    };
+    vector<FileResult> results(files.size());
+    vector<WorkerState> perWorker(jobs);
+
+    runWorkStealing(files.size(), jobs, [&](size_t i, unsigned worker) {
+        WorkerState& w = perWorker[worker];
+        NoProfile unprofiled;
+        results[i].opened = processFile(files[i], w.discard, results[i].counts, w.text, unprofiled);
+        w.counts += results[i].counts;
+        w.text.reset();
+    });
+
+    TokenCounts total;
+    for (const WorkerState& w : perWorker) total += w.counts;
+
+    size_t failed = 0;
+    cout << "--- Batch Report (" << files.size() << " files) ---\n";
+    for (size_t i = 0; i < files.size(); i++) {
+        const TokenCounts& c = results[i].counts;
+        if (!results[i].opened) {
+            cout << files[i] << ": error opening file\n";
+            failed++;
+            continue;
+        }
+        cout << files[i] << ": keywords " << c.keywordCount << ", identifiers " << c.identifierCount
+             << ", numbers " << c.numberCount << ", operators " << c.operatorCount
+             << ", special symbols " << c.specialCount << ", literals " << c.literalCount
+             << ", errors " << c.errorCount << "\n";
+    }
+    printCounts(cout, total);
+    cout << "Files: " << files.size() - failed << " lexed, " << failed << " unreadable" << endl;
+    return failed ? 1 : 0;
+}
+
+int main(int argc, char* argv[]) {
+    // Usage: ./a.out [--format=text|csv|jsonl] [--quiet] [--profile[=FILE]] [file]
+    //        ./a.out --batch [--jobs=N] <dir|file|@list>...
+    string filename = "hello.cpp", format = "text", profileTo;
+    bool quiet = false, batch = false;
+    unsigned jobs = max(1u, thread::hardware_concurrency());
+    vector<string> inputs;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg.rfind("--format=", 0) == 0) format = arg.substr(9);
+        else if (arg == "--quiet") quiet = true;
+        else if (arg == "--batch") batch = true;
+        else if (arg.rfind("--jobs=", 0) == 0) {
+            const char* first = arg.data() + 7;
+            const char* last = arg.data() + arg.size();
+            from_chars_result r = from_chars(first, last, jobs);
+            if (r.ec != errc() || r.ptr != last || jobs == 0) {
+                cerr << "Bad --jobs value '" << arg.substr(7) << "' (expected a positive number)\n";
+                return 1;
+            }
+            jobs = min(jobs, maxJobs);
+        }
+        else if (arg == "--profile") profileTo = "-";
+        else if (arg.rfind("--profile=", 0) == 0) profileTo = arg.substr(10);
+        else inputs.push_back(filename = arg);
+    }
+
+    if (batch && !profileTo.empty()) {
+        cerr << "--profile does not apply to --batch\n";
+        return 1;
+    }
+    if (batch)
+        return runBatch(collectBatchFiles(inputs), jobs);
+
+    unique_ptr<TokenSink> sink = makeTokenSink<AnalyserTextSink>(format, quiet);
+    if (!sink) {
+        cerr << "Unknown format '" << format << "' (expected text, csv or jsonl)\n";
+        return 1;
+    }
     
+    TokenCounts counts;
+    Arena text;
+    ostream& report = quiet || format == "text" ? cout : cerr;
+    if (profileTo.empty()) {
+        NoProfile unprofiled;
+        processFile(filename, *sink, counts, text, unprofiled);
+        sink->flush();
+
+        // Machine-readable token streams stay clean on stdout; the counters then go to stderr
+        printCounts(report, counts);
+        return 0;
+    }
+
+    // Profiled run: the perf counters cover lexing and writing the records
+    LexProfile prof;
+    PerfCounters perf;
+    perf.start();
+    processFile(filename, *sink, counts, text, prof);
+    sink->flush();
+    perf.stop();
+    printCounts(report, counts);
+    if (profileTo == "-") {
+        report << "\n--- Lexer Profile ---\n";
+        writeProfileJson(report, "22BCE1126_LexicalAnalyser", prof, perf);
+        return 0;
+    }
+    ofstream out(profileTo);
+    if (!out) {
+        cerr << "Cannot write profile to " << profileTo << endl;
+        return 1;
+    }
+    writeProfileJson(out, "22BCE1126_LexicalAnalyser", prof, perf);
     return 0;
 }
 
-bool isKeyword(const string& word) {
-    return keywords.find(word) != keywords.end();
+bool isKeyword(string_view word) {
+    return Keywords::contains(word);
 }
 
-bool isOperator(const string& op) {
-    return operators.find(op) != operators.end();
+bool isOperator(string_view op) {
+    return Operators::contains(op);
 }
 
 bool isSpecialSymbol(char ch) {
-    return special_symbols.find(ch) != special_symbols.end();
+    return special_symbols.contains(ch);
 }
 
-bool isValidIdentifier(const string& word) {
-    if (word.empty() || !(isalpha(word[0]) || word[0] == '_'))
-        return false;
+bool isValidIdentifier(string_view word) {
+    if (word.empty() || !(isalpha((unsigned char)word[0]) || word[0] == '_'))
+        return isUnicodeIdentifier(word);
     for (char ch : word) {
-        if (!isalnum(ch) && ch != '_')
-            return false;
+        if (!isalnum((unsigned char)ch) && ch != '_')
+            return (unsigned char)ch >= 0x80 && isUnicodeIdentifier(word);
     }
     return true;
 }
 
-bool isNumber(const string& word) {
+bool isNumber(string_view word) {
     if (word.empty()) return false;
     bool dot = false;
     for (char ch : word) {
         if (ch == '.') {
             if (dot) return false;
             dot = true;
-        } else if (!isdigit(ch)) {
+        } else if (!isdigit((unsigned char)ch)) {
             return false;
         }
     }
     return true;
 }
 
-void processFile(const string& filename) {
-    ifstream file(filename);
+// The file is read whole into `arena` and scanned by index with the rules of the
+// original get()/peek() loop. Nothing in the loop looks for newlines: each
+// record's line (and, for errors, column) comes from the line index of the
+// buffer, looked up at the token's starting offset. `prof` times every
+// whitespace byte, comment and token (lex_profile.h), including handing it
+// to the sink.
+//
+// The text is UTF-8 (utf8.h): words take XID characters, ≠ ≤ ≥ ∧ ∨ are
+// operators, and each invalid sequence in a comment or literal is reported
+// after it, where it lies.
+template <class Profile>
+bool processFile(const string& filename, TokenSink& sink, TokenCounts& counts, Arena& arena, Profile& prof) {
+    ifstream file(filename, ios::binary);
     if (!file) {
         cerr << "Error opening file.\n";
-        return;
+        return false;
     }
+    string_view text = readAll(file, arena);
+    file.close();
+
+    SourceBuffer src(text);
+    LineCursor lines(src);
+    const char* buf = text.data();
+    const size_t n = text.size();
+    size_t i = 0;
+    auto peek = [&]() -> int { return i < n ? (unsigned char)buf[i] : EOF; };
+    auto invalidUtf8 = [&lines, &sink, &counts, buf](const char* bad, size_t len) {
+        LineCol at = lines.locate(bad - buf);
+        sink.error(at.line, at.column, "Invalid UTF-8 sequence '" + utf8Escaped(string_view(bad, len)) + "'");
+        counts.errorCount++;
+    };
+    // The rest of the word at `start`, and what it turned out to be
+    auto lexWord = [&](size_t start) {
+        for (;;) {
+            while (peek() > 0 && (isalnum(peek()) || peek() == '_' || peek() == '.')) i++;
+            if (peek() < 0x80) break;
+            size_t next = skipXidContinue(buf + i, buf + n) - buf;
+            if (next == i) break;
+            i = next;
+        }
+        string_view token(buf + start, i - start);
+        LineCol at = lines.locate(start);
 
-    string token;
-    char ch;
-    int current_line = 1;
+        if (isKeyword(token)) {
+            sink.token(at.line, at.column, "keyword", token);
+            counts.keywordCount++;
+            prof.end(LexPhase::Keyword, i);
+        } else if (isNumber(token)) {
+            sink.token(at.line, at.column, "number", token);
+            counts.numberCount++;
+            prof.end(LexPhase::Number, i);
+        } else if (isValidIdentifier(token)) {
+            sink.token(at.line, at.column, "identifier", token);
+            counts.identifierCount++;
+            prof.end(LexPhase::Identifier, i);
+        } else {
+            sink.error(at.line, at.column, "Invalid token '" + string(token) + "'");
+            counts.errorCount++;
+            prof.end(LexPhase::Error, i);
+        }
+    };
 
-    while (file.get(ch)) {
-        if (ch == '\n') current_line++;
+    while (i < n) {
+        size_t start = i;
+        prof.begin(start);
+        char ch = buf[i++];
 
-        if (isspace(ch)) continue;
+        if (isspace((unsigned char)ch)) {
+            prof.end(LexPhase::Whitespace, i);
+            continue;
+        }
 
         if (ch == '/') {
-            if (file.peek() == '/') {
-                while (file.get(ch) && ch != '\n');
+            if (peek() == '/') {
+                const char* nl = static_cast<const char*>(memchr(buf + i, '\n', n - i));
+                i = nl ? nl - buf + 1 : n;
+                prof.end(LexPhase::Comment, i);
+                forEachInvalidUtf8(buf + start, buf + i, invalidUtf8);
                 continue;
             }
-            else if (file.peek() == '*') {
-                file.get();
-                while (file.get(ch)) {
-                    if (ch == '*' && file.peek() == '/') {
-                        file.get();
+            else if (peek() == '*') {
+                i++;
+                while (i < n) {
+                    if (buf[i++] == '*' && peek() == '/') {
+                        i++;
                         break;
                     }
                 }
+                prof.end(LexPhase::Comment, i);
+                forEachInvalidUtf8(buf + start, buf + i, invalidUtf8);
                 continue;
             }
         }
 
         if (ch == '"') {
-            string literal = "\"";
-            int start_line = current_line;
-            while (file.get(ch) && ch != '"') {
-                literal += ch;
-            }
-            if (ch == '"') {
-                literal += '"';
-                cout << "[Line " << start_line << "] literal: " << literal << endl;
-                literalCount++;
+            int start_line = lines.locate(start).line;
+            const char* close = static_cast<const char*>(memchr(buf + i, '"', n - i));
+            if (close) {
+                i = close - buf + 1;
+                sink.token(start_line, lines.locate(start).column, "literal", string_view(buf + start, i - start));
+                counts.literalCount++;
+                prof.end(LexPhase::Literal, i);
+                forEachInvalidUtf8(buf + start, buf + i, invalidUtf8);
+            } else if (i == n) {
+                // A '"' that is the last byte reads as an empty literal
+                sink.token(start_line, lines.locate(start).column, "literal", "\"\"");
+                counts.literalCount++;
+                prof.end(LexPhase::Literal, i);
             } else {
-                cout << "[Line " << start_line << "] ERROR: Unterminated string\n";
-                errorCount++;
+                i = n;
+                sink.error(start_line, lines.locate(start).column, "Unterminated string");
+                counts.errorCount++;
+                prof.end(LexPhase::Error, i);
             }
             continue;
         }
 
-        if (isalpha(ch) || ch == '_' || isdigit(ch)) {
-            token = ch;
-            while (file.peek() && (isalnum(file.peek()) || file.peek() == '_' || file.peek() == '.')) {
-                file.get(ch);
-                token += ch;
-            }
-            
-            if (isKeyword(token)) {
-                cout << "[Line " << current_line << "] keyword: " << token << endl;
-                keywordCount++;
-            } else if (isNumber(token)) {
-                cout << "[Line " << current_line << "] number: " << token << endl;
-                numberCount++;
-            } else if (isValidIdentifier(token)) {
-                cout << "[Line " << current_line << "] identifier: " << token << endl;
-                identifierCount++;
-            } else {
-                cout << "[Line " << current_line << "] ERROR: Invalid token '" << token << "'\n";
-                errorCount++;
-            }
+        if (isalpha((unsigned char)ch) || ch == '_' || isdigit((unsigned char)ch)) {
+            lexWord(start);
             continue;
         }
 
-        if (isOperator(string(1, ch))) {
-            string op(1, ch);
-            if (isOperator(string(1, file.peek()))) {
-                string potentialOp = op + string(1, file.peek());
-                if (isOperator(potentialOp)) {
-                    file.get();
-                    op = potentialOp;
-                }
+        LineCol at = lines.locate(start);
+        if (isOperator(string_view(&ch, 1))) {
+            char op[2] = {ch, char(peek())};
+            string_view opText(op, 1);
+            if (isOperator(string_view(op + 1, 1)) && isOperator(string_view(op, 2))) {
+                i++;
+                opText = string_view(op, 2);
             }
-            cout << "[Line " << current_line << "] operator: " << op << endl;
-            operatorCount++;
+            sink.token(at.line, at.column, "operator", opText);
+            counts.operatorCount++;
+            prof.end(LexPhase::Operator, i);
             continue;
         }
         
         if (isSpecialSymbol(ch)) {
-            cout << "[Line " << current_line << "] special symbol: " << ch << endl;
-            specialCount++;
+            sink.token(at.line, at.column, "special symbol", string_view(&ch, 1));
+            counts.specialCount++;
+            prof.end(LexPhase::Special, i);
             continue;
         }
 
-        cout << "[Line " << current_line << "] ERROR: Unrecognized symbol '" << ch << "'\n";
-        errorCount++;
+        // A non-ASCII character is one whole UTF-8 sequence: the start of a
+        // word, an operator, or an error
+        if ((unsigned char)ch >= 0x80) {
+            size_t len = utf8SequenceLength(buf + start, buf + n);
+            if (len == 0) {
+                i = start + utf8ErrorLength(buf + start, buf + n);
+                invalidUtf8(buf + start, i - start);
+                prof.end(LexPhase::Error, i);
+                continue;
+            }
+            i = start + len;
+            char32_t c = decodeUtf8(buf + start, len);
+            if (isXidStart(c)) {
+                lexWord(start);
+                continue;
+            }
+            if (string_view op = asciiOperator(c); !op.empty()) {
+                sink.token(at.line, at.column, "operator", op);
+                counts.operatorCount++;
+                prof.end(LexPhase::Operator, i);
+                continue;
+            }
+            sink.error(at.line, at.column, "Unrecognized symbol '" + string(buf + start, len) + "'");
+            counts.errorCount++;
+            prof.end(LexPhase::Error, i);
+            continue;
+        }
+
+        sink.error(at.line, at.column, string("Unrecognized symbol '") + ch + "'");
+        counts.errorCount++;
+        prof.end(LexPhase::Error, i);
     }
 
-    file.close();
+    return true;
 }
-
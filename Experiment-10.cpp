@@ -1,4 +1,5 @@
 #include <bits/stdc++.h>
+#include "lexer.h"
 using namespace std;
 
 struct Quadruple {
@@ -38,63 +39,32 @@ void printTriples(const vector<Triple>& triples) {
     }
 }
 
-static inline bool isIdentChar(char c) {
-    return isalnum((unsigned char)c) || c == '_';
-}
-
-vector<string> tokenize(const string &s_in) {
-    string s = s_in;
-    for (size_t p = 0; p + 2 <= s.size(); ++p) {
-        if ((unsigned char)s[p] == 0xC2 || (unsigned char)s[p] == 0xE2) { /*skip - crude*/ }
-    }
-    
-    size_t pos;
-    while ((pos = s.find("≠")) != string::npos) s.replace(pos, 3, "!=");
-
+// Values of the numeric constants seen by tokenize(), by their text, and of
+// the constants folded from them. The lexer decodes the literals, so
+// folding never parses a string.
+unordered_map<string, NumberValue> constants;
+
+vector<string> tokenize(const string &s) {
+    // Scan with the streaming C lexer, then map its tokens onto the names the
+    // expression code uses (AND/OR, lower-case control words). The lexer
+    // reads UTF-8, so ≠ ≤ ≥ ∧ ∨ arrive as operators spelled in ASCII.
+    istringstream in(s);
+    Lexer<> lex(in);
     vector<string> toks;
-    for (size_t i = 0; i < s.size();) {
-        if (isspace((unsigned char)s[i])) { ++i; continue; }
-        char c = s[i];
-
-        // multi-char operators and punctuation
-        if (c == '&' && i + 1 < s.size() && s[i+1] == '&') { toks.push_back("AND"); i += 2; continue; }
-        if (c == '|' && i + 1 < s.size() && s[i+1] == '|') { toks.push_back("OR"); i += 2; continue; }
-        if (c == '=' && i + 1 < s.size() && s[i+1] == '=') { toks.push_back("=="); i += 2; continue; }
-        if (c == '!' && i + 1 < s.size() && s[i+1] == '=') { toks.push_back("!="); i += 2; continue; }
-        if (c == '<' && i + 1 < s.size() && s[i+1] == '=') { toks.push_back("<="); i += 2; continue; }
-        if (c == '>' && i + 1 < s.size() && s[i+1] == '=') { toks.push_back(">="); i += 2; continue; }
-
-        // single-char tokens
-        if (strchr("()+-*/<>{};:,", c)) {
-            toks.push_back(string(1, c));
-            ++i;
-            continue;
-        }
-
-        if (isalpha((unsigned char)c)) {
-            string id;
-            while (i < s.size() && isIdentChar(s[i])) { id.push_back(s[i]); ++i; }
-          
-            string low = id;
+    for (const LexToken& t : lex) {
+        string tok(tokenDisplayText(t.kind, t.text));
+        if (tok == "&&") tok = "AND";
+        else if (tok == "||") tok = "OR";
+        else if (t.kind == TokenKind::Id || t.kind == TokenKind::Keyword) {
+            string low = tok;
             for (auto &ch : low) ch = (char)tolower((unsigned char)ch);
-            if (low == "and") toks.push_back("AND");
-            else if (low == "or") toks.push_back("OR");
-            else if (low == "then") toks.push_back("then");
-            else if (low == "else") toks.push_back("else");
-            else if (low == "if") toks.push_back("if");
-            else if (low == "while") toks.push_back("while");
-            else toks.push_back(id); // preserve case (A,B vs a,b)
-            continue;
-        }
-
-        if (isdigit((unsigned char)c)) {
-            string num;
-            while (i < s.size() && (isdigit((unsigned char)s[i]) || s[i]=='.')) { num.push_back(s[i]); ++i; }
-            toks.push_back(num);
-            continue;
+            if (low == "and") tok = "AND";
+            else if (low == "or") tok = "OR";
+            else if (low == "then" || low == "else" || low == "if" || low == "while") tok = low;
+            // otherwise preserve case (A,B vs a,b)
         }
-        toks.push_back(string(1, c));
-        ++i;
+        else if (t.kind == TokenKind::Num) constants[tok] = t.number;
+        toks.push_back(tok);
     }
     return toks;
 }
@@ -141,6 +111,101 @@ vector<string> infixToPostfix(const vector<string> &tokens) {
     return output;
 }
 
+bool isSignedType(NumberType t) {
+    return t == NumberType::Int || t == NumberType::Long || t == NumberType::LongLong;
+}
+
+double realValue(const NumberValue &v) {
+    if (v.isReal()) return v.real;
+    return isSignedType(v.type) ? double((long long)v.integer) : double(v.integer);
+}
+
+template <class T>
+bool compareConstants(const string &op, T x, T y) {
+    if (op == "<") return x < y;
+    if (op == ">") return x > y;
+    if (op == "<=") return x <= y;
+    if (op == ">=") return x >= y;
+    if (op == "==") return x == y;
+    if (op == "!=") return x != y;
+    if (op == "AND") return x != 0 && y != 0;
+    return x != 0 || y != 0;
+}
+
+// Evaluates `a op b` for two constants with C's usual arithmetic
+// conversions. Gives up (false) on division by zero, on signed overflow,
+// which C leaves undefined, and on floating overflow; unsigned results wrap. Comparisons and AND/OR
+// give an int 0 or 1.
+bool foldConstants(const string &op, const NumberValue &a, const NumberValue &b, NumberValue &r) {
+    bool arithmetic = op == "+" || op == "-" || op == "*" || op == "/";
+    r = NumberValue();
+
+    if (a.isReal() || b.isReal()) {
+        double x = realValue(a), y = realValue(b);
+        if (!arithmetic) {
+            r.integer = compareConstants(op, x, y);
+            return true;
+        }
+        if (op == "/" && y == 0) return false;
+        double z = op == "+" ? x + y : op == "-" ? x - y : op == "*" ? x * y : x / y;
+        r.type = max(a.isReal() ? a.type : NumberType::Float, b.isReal() ? b.type : NumberType::Float);
+        r.real = r.type == NumberType::Float ? double(float(z)) : z;
+        return isfinite(r.real);       // an overflow has no literal to fold to
+    }
+
+    // Both integers: the common type is the higher rank, except that long
+    // long cannot hold every unsigned long.
+    NumberType t = max({a.type, b.type, NumberType::Int});
+    if (t == NumberType::LongLong && (a.type == NumberType::UnsignedLong || b.type == NumberType::UnsignedLong))
+        t = NumberType::UnsignedLongLong;
+    bool is32 = t == NumberType::Int || t == NumberType::UnsignedInt;
+    uint64_t mask = is32 ? 0xffffffffULL : ~0ULL;
+
+    if (isSignedType(t)) {
+        long long x = (long long)a.integer, y = (long long)b.integer, z;
+        if (!arithmetic) {
+            r.integer = compareConstants(op, x, y);
+            return true;
+        }
+        bool overflow = false;
+        if (op == "+") overflow = __builtin_add_overflow(x, y, &z);
+        else if (op == "-") overflow = __builtin_sub_overflow(x, y, &z);
+        else if (op == "*") overflow = __builtin_mul_overflow(x, y, &z);
+        else if (y == 0 || (x == LLONG_MIN && y == -1)) return false;
+        else z = x / y;
+        if (overflow || (is32 && (z < INT_MIN || z > INT_MAX))) return false;
+        r.type = t;
+        r.integer = (uint64_t)z;
+        return true;
+    }
+
+    uint64_t x = a.integer & mask, y = b.integer & mask;
+    if (!arithmetic) {
+        r.integer = compareConstants(op, x, y);
+        return true;
+    }
+    if (op == "/" && y == 0) return false;
+    r.type = t;
+    r.integer = (op == "+" ? x + y : op == "-" ? x - y : op == "*" ? x * y : x / y) & mask;
+    return true;
+}
+
+// Text for a folded constant, with the suffix that gives it its type back.
+string constantText(const NumberValue &v) {
+    if (v.isReal()) {
+        char buf[64];
+        char *end = to_chars(buf, buf + sizeof buf, v.real).ptr;
+        string text(buf, end);
+        if (text.find_first_of(".en") == string::npos) text += ".0";
+        if (v.type == NumberType::Float) text += "f";
+        else if (v.type == NumberType::LongDouble) text += "L";
+        return text;
+    }
+    static const char *const suffixes[] = {"", "u", "l", "ul", "ll", "ull"};
+    string digits = isSignedType(v.type) ? to_string((long long)v.integer) : to_string(v.integer);
+    return digits + suffixes[(int)v.type];
+}
+
 string generateFromPostfixAndAppend(const vector<string> &postfix,
                                    vector<Quadruple> &quads,
                                    vector<Triple> &triples,
@@ -168,6 +233,19 @@ string generateFromPostfixAndAppend(const vector<string> &postfix,
             string arg2_tr = tripleStack.top(); tripleStack.pop();
             string arg1_tr = tripleStack.top(); tripleStack.pop();
 
+            // Two constants: push the result instead of emitting code.
+            auto c1 = constants.find(arg1_q), c2 = constants.find(arg2_q);
+            NumberValue folded;
+            if (c1 != constants.end() && c2 != constants.end() &&
+                foldConstants(tok, c1->second, c2->second, folded)) {
+                string value = constantText(folded);
+                constants[value] = folded;
+                quadStack.push(value);
+                tripleStack.push(value);
+                equations.push_back(arg1_q + " " + tok + " " + arg2_q + " folds to " + value);
+                continue;
+            }
+
             string temp = "t" + to_string(tcount++);
 
             Quadruple q{tok, arg1_q, arg2_q, temp};
@@ -248,17 +326,18 @@ void processIfStatement(const string &ifStr,
 
     auto postfixCond = infixToPostfix(condTokens);
     size_t beforeCondTripleCount = triples.size();
-    generateFromPostfixAndAppend(postfixCond, quads, triples, equations, tcount);
+    // the condition's temp, or its operand/constant if no code was needed
+    string condTempName = generateFromPostfixAndAppend(postfixCond, quads, triples, equations, tcount);
     int condTripleIndex = (int)triples.size() - 1; // last triple index for condition result
-    string condTempName;
-    if (!quads.empty()) condTempName = quads.back().result; // last temp produced for condition
+    string condTripleArg = triples.size() > beforeCondTripleCount
+                               ? "(" + to_string(condTripleIndex) + ")" : condTempName;
 
     static int labelSerial = 1;
     string L1 = "L" + to_string(labelSerial++);
     string L2 = "L" + to_string(labelSerial++);
 
     quads.push_back({"IF_FALSE", condTempName, "-", L1});
-    triples.push_back({"IF_FALSE", "(" + to_string(condTripleIndex) + ")", L1});
+    triples.push_back({"IF_FALSE", condTripleArg, L1});
 
     vector<vector<string>> thenStmts;
     {
@@ -282,13 +361,12 @@ void processIfStatement(const string &ifStr,
             
                 int beforeRhsTriple = (int)triples.size();
                 string rhsTemp;
-                if (!postfixRhs.empty()) {
-                    generateFromPostfixAndAppend(postfixRhs, quads, triples, equations, tcount);
-                    if (!quads.empty()) rhsTemp = quads.back().result;
-                }
+                if (!postfixRhs.empty())
+                    rhsTemp = generateFromPostfixAndAppend(postfixRhs, quads, triples, equations, tcount);
          
-                if (rhsTemp.empty()) {
-                    string imm = rhsTokens.size() == 1 ? rhsTokens[0] : "";
+                // No code emitted: a single operand, or constants that folded
+                if ((int)triples.size() == beforeRhsTriple) {
+                    string imm = rhsTemp;
                     quads.push_back({"=", imm, "-", lhs});
                     triples.push_back({"=", imm, lhs});
                 } else {
@@ -325,13 +403,12 @@ void processIfStatement(const string &ifStr,
             vector<string> rhsTokens(itEq + 1, stmt.end());
             if (!rhsTokens.empty()) {
                 auto postfixRhs = infixToPostfix(rhsTokens);
+                int beforeRhsTriple = (int)triples.size();
                 string rhsTemp;
-                if (!postfixRhs.empty()) {
-                    generateFromPostfixAndAppend(postfixRhs, quads, triples, equations, tcount);
-                    if (!quads.empty()) rhsTemp = quads.back().result;
-                }
-                if (rhsTemp.empty()) {
-                    string imm = rhsTokens.size() == 1 ? rhsTokens[0] : "";
+                if (!postfixRhs.empty())
+                    rhsTemp = generateFromPostfixAndAppend(postfixRhs, quads, triples, equations, tcount);
+                if ((int)triples.size() == beforeRhsTriple) {
+                    string imm = rhsTemp;
                     quads.push_back({"=", imm, "-", lhs});
                     triples.push_back({"=", imm, lhs});
                 } else {
@@ -399,12 +476,13 @@ void processWhileStatement(const string &whileStr,
     triples.push_back({"Label", "-", L1});
 
     auto postfixCond = infixToPostfix(condTokens);
-    generateFromPostfixAndAppend(postfixCond, quads, triples, equations, tcount);
+    size_t beforeCond = triples.size();
+    string condTemp = generateFromPostfixAndAppend(postfixCond, quads, triples, equations, tcount);
     int condIdx = (int)triples.size() - 1;
-    string condTemp = (!quads.empty() ? quads.back().result : "");
+    string condArg = triples.size() > beforeCond ? "(" + to_string(condIdx) + ")" : condTemp;
 
     quads.push_back({"IF_FALSE", condTemp, "-", L2});
-    triples.push_back({"IF_FALSE", "(" + to_string(condIdx) + ")", L2});
+    triples.push_back({"IF_FALSE", condArg, L2});
 
     vector<vector<string>> stmts;
     {
@@ -425,13 +503,12 @@ void processWhileStatement(const string &whileStr,
             vector<string> rhs(itEq + 1, stmt.end());
             if (!rhs.empty()) {
                 auto postfixRhs = infixToPostfix(rhs);
+                int beforeRhs = (int)triples.size();
                 string rhsTemp;
-                if (!postfixRhs.empty()) {
-                    generateFromPostfixAndAppend(postfixRhs, quads, triples, equations, tcount);
-                    if (!quads.empty()) rhsTemp = quads.back().result;
-                }
-                if (rhsTemp.empty()) {
-                    string imm = rhs.size() == 1 ? rhs[0] : "";
+                if (!postfixRhs.empty())
+                    rhsTemp = generateFromPostfixAndAppend(postfixRhs, quads, triples, equations, tcount);
+                if ((int)triples.size() == beforeRhs) {
+                    string imm = rhsTemp;
                     quads.push_back({"=", imm, "-", lhs});
                     triples.push_back({"=", imm, lhs});
                 } else {
@@ -505,6 +582,22 @@ int main() {
     printQuadruples(quads3);
     printTriples(triples3);
 
+    // ---------- Test Case 4: Constant Folding ----------
+    string folding = "x * (0x10 + 2) - 1.5e1 / 3 + (1 < 2)";
+    cout << "\n******** Test Case 4: Constant Folding ********\n";
+    cout << "Expression: " << folding << "\n";
+    vector<Quadruple> quads4;
+    vector<Triple> triples4;
+    vector<string> eqs4;
+    int tcount4 = 1;
+    processArithmeticExpression(folding, quads4, triples4, eqs4, tcount4);
+    if (!eqs4.empty()) {
+        cout << "\nStep-by-step equations:\n";
+        for (auto &e : eqs4) cout << e << "\n";
+    }
+    printQuadruples(quads4);
+    printTriples(triples4);
+
     cout << "\n";
     return 0;
 }
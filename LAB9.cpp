@@ -1,4 +1,6 @@
 #include <bits/stdc++.h>
+#include "parse_tables.h"
+#include "parse_trace.h"
 using namespace std;
 
 struct Production {
@@ -22,6 +24,15 @@ vector<State> states;
 map<pair<int,char>, int> GOTO_TABLE;   
 map<pair<int,char>, string> ACTION;   
 
+// What parsing and the listings read: ACTION and GOTO_TABLE packed (see
+// parse_tables.h), built from them or loaded from a table file. Columns
+// are the terminals, '$', then the nonterminals; ACTION_CODES has just
+// the terminal ones and GOTO_CODES all of them, -1 where there is none.
+enum { T_SYMBOLS=1, T_ACTION=4, T_GOTO=8 };
+TableImage tables;
+SymbolIndex symbols;
+PackedTable ACTION_CODES, GOTO_CODES;
+
 bool is_terminal(char c) {
     return nonterminals.count(c)==0;
 }
@@ -188,6 +199,69 @@ void build_parsing_table() {
     }
 }
 
+int column(char c) {
+    return symbols.find(string_view(&c,1));
+}
+string action_text(int32_t act) {
+    switch(lrKind(act)) {
+        case LR_SHIFT: return "s"+to_string(lrTarget(act));
+        case LR_REDUCE: return "r"+to_string(lrTarget(act));
+        case LR_ACCEPT: return "acc";
+        default: return "";
+    }
+}
+
+// Tables are only good for the grammar they were built from.
+CacheKey table_key() {
+    string text;
+    for(auto &p:grammar) text+=string(1,p.lhs)+"->"+p.rhs+"\n";
+    text+=string(terminals.begin(),terminals.end())+"|"+string(nonterminals.begin(),nonterminals.end());
+    return makeCacheKey(text,"LAB9/slr-tables/1");
+}
+
+void pack_tables() {
+    vector<string> names;
+    for(char t:terminals) names.push_back(string(1,t));
+    names.push_back("$");
+    for(char A:nonterminals) names.push_back(string(1,A));
+    size_t n=states.size(), terms=terminals.size()+1, cols=names.size();
+    auto col=[&](char c) { return size_t(find(names.begin(),names.end(),string(1,c))-names.begin()); };
+
+    vector<int32_t> act(n*terms,0), go(n*cols,-1);
+    for(auto &e:ACTION) {
+        size_t c=col(e.first.second);
+        const string &a=e.second;
+        if(c>=terms || a=="") continue;
+        if(a=="acc") act[e.first.first*terms+c]=lrAction(LR_ACCEPT);
+        else if(a[0]=='s') act[e.first.first*terms+c]=lrAction(LR_SHIFT,stoi(a.substr(1)));
+        else if(a[0]=='r') act[e.first.first*terms+c]=lrAction(LR_REDUCE,stoi(a.substr(1)));
+    }
+    for(auto &e:GOTO_TABLE) go[e.first.first*cols+col(e.first.second)]=e.second;
+
+    CacheWriter w;
+    addSymbolIndex(w,T_SYMBOLS,names);
+    addPackedTable(w,T_ACTION,act,uint32_t(n),uint32_t(terms),0);
+    addPackedTable(w,T_GOTO,go,uint32_t(n),uint32_t(cols),-1);
+    tables=TableImage(w,table_key());
+}
+
+// Points the views at `tables`, checking every state and production in
+// them once so that parse() can trust them.
+bool bind_tables() {
+    if(!tables.get(T_SYMBOLS,symbols) || !tables.get(T_ACTION,ACTION_CODES) || !tables.get(T_GOTO,GOTO_CODES))
+        return false;
+    uint32_t n=ACTION_CODES.rows;
+    if(n==0 || GOTO_CODES.rows!=n || GOTO_CODES.columns!=symbols.size() || ACTION_CODES.columns>symbols.size())
+        return false;
+    for(int32_t a:ACTION_CODES.value) {
+        if(lrKind(a)==LR_SHIFT && uint32_t(lrTarget(a))>=n) return false;
+        if(lrKind(a)==LR_REDUCE && size_t(lrTarget(a))>=grammar.size()) return false;
+    }
+    for(int32_t g:GOTO_CODES.value)
+        if(g<-1 || g>=int32_t(n)) return false;
+    return ACTION_CODES.empty==0 && GOTO_CODES.empty==-1;
+}
+
 void print_grammar() {
     cout<<"Grammar Rules:\n";
     for(int i=0;i<grammar.size();i++)
@@ -212,8 +286,14 @@ void print_states() {
 }
 void print_dfa() {
     cout<<"DFA of Item Sets (state transitions):\n";
-    for(auto &e:GOTO_TABLE)
-        cout<<"I"<<e.first.first<<" --"<<e.first.second<<"--> I"<<e.second<<"\n";
+    vector<char> syms;
+    for(size_t c=0;c<symbols.size();c++) syms.push_back(symbols[c][0]);
+    sort(syms.begin(),syms.end());
+    for(int i=0;i<(int)GOTO_CODES.rows;i++)
+        for(char X:syms) {
+            int j=GOTO_CODES(i,column(X));
+            if(j>=0) cout<<"I"<<i<<" --"<<X<<"--> I"<<j<<"\n";
+        }
     cout<<"\n";
 }
 void print_table() {
@@ -225,14 +305,15 @@ void print_table() {
     for(char t:terms) cout<<setw(8)<<t;
     for(char A:nonterms) cout<<setw(8)<<A;
     cout<<"\n";
-    for(int i=0;i<states.size();i++) {
+    for(int i=0;i<(int)ACTION_CODES.rows;i++) {
         cout<<setw(7)<<i;
         for(char t:terms) {
-            string act=ACTION[{i,t}];
+            string act=action_text(ACTION_CODES(i,column(t)));
             cout<<setw(8)<<act;
         }
         for(char A:nonterms) {
-            string g=ACTION[{i,A}];
+            int j=GOTO_CODES(i,column(A));
+            string g=j>=0?"g"+to_string(j):"";
             cout<<setw(8)<<g;
         }
         cout<<"\n";
@@ -240,46 +321,96 @@ void print_table() {
     cout<<"\n";
 }
 
-void parse(string input) {
-    cout<<"Parsing input string: "<<input<<"\n";
-    input+="$";
+// input ends in '$'. Only the state stack is kept: the symbol under each
+// state is the one every transition into that state reads.
+template <class Tracer>
+bool parse(const string &input, Tracer &trace) {
     vector<int> stateStack={0};
-    vector<char> symStack={'$'};
     int ip=0;
-    cout<<setw(15)<<"StateStack"<<setw(15)<<"SymbolStack"<<setw(15)<<"Input"<<setw(15)<<"Action"<<"\n";
     while(true) {
         int s=stateStack.back();
-        char a=input[ip];
-        string act=ACTION[{s,a}];
+        int a=column(input[ip]);
+        int32_t act=a>=0?ACTION_CODES(s,a):0;
+        if(lrKind(act)==LR_ERROR) {
+            trace.step(TraceAction::Error,0,stateStack.size(),ip);
+            trace.finish(stateStack);
+            return false;
+        }
+        if(lrKind(act)==LR_ACCEPT) {
+            trace.step(TraceAction::Accept,0,stateStack.size(),ip);
+            trace.finish(stateStack);
+            return true;
+        }
+        if(lrKind(act)==LR_SHIFT) {
+            trace.step(TraceAction::Shift,0,stateStack.size(),ip);
+            stateStack.push_back(lrTarget(act));
+            ip++;
+        } else {
+            int k=lrTarget(act);
+            trace.step(TraceAction::Reduce,k,stateStack.size(),ip);
+            const Production &p=grammar[k];
+            for(size_t j=0;j<p.rhs.size() && p.rhs!="#";j++) stateStack.pop_back();
+            int t=stateStack.back();
+            stateStack.push_back(GOTO_CODES(t,column(p.lhs)));
+        }
+    }
+}
+
+// The step listing. The state stack before the oldest kept step comes from
+// undoing the kept steps, last first, on the final stack: a reduction is
+// undone by following the transitions on its right-hand side again.
+void print_trace(const Trace<int> &trace, const string &input) {
+    vector<char> symbolOf(GOTO_CODES.rows,'$');
+    for(int i=0;i<(int)GOTO_CODES.rows;i++)
+        for(size_t c=0;c<symbols.size();c++) {
+            int j=GOTO_CODES(i,c);
+            if(j>=0) symbolOf[j]=symbols[c][0];
+        }
+
+    vector<int> stateStack=trace.finalStack();
+    for(size_t k=trace.size();k-->0;) {
+        const TraceStep &step=trace[k];
+        if(step.action==TraceAction::Shift) stateStack.pop_back();
+        else if(step.action==TraceAction::Reduce) {
+            const Production &p=grammar[step.production];
+            stateStack.pop_back();
+            if(p.rhs!="#") for(char X:p.rhs) stateStack.push_back(GOTO_CODES(stateStack.back(),column(X)));
+        }
+    }
+
+    cout<<setw(15)<<"StateStack"<<setw(15)<<"SymbolStack"<<setw(15)<<"Input"<<setw(15)<<"Action"<<"\n";
+    if(trace.dropped()) cout<<"("<<trace.dropped()<<" earlier steps not kept)\n";
+    for(size_t k=0;k<trace.size();k++) {
+        const TraceStep &step=trace[k];
+        int a=column(input[step.input]);
+        string act=action_text(a>=0?ACTION_CODES(stateStack.back(),a):0);
         cout<<setw(15);
         for(int x:stateStack) cout<<x<<" ";
         cout<<setw(15);
-        for(char c:symStack) cout<<c<<" ";
-        cout<<setw(15)<<input.substr(ip)<<setw(15)<<act<<"\n";
-        if(act=="") { cout<<"Error!\n"; break; }
-        if(act=="acc") { cout<<"Accepted!\n"; break; }
-        if(act[0]=='s') {
-            int j=stoi(act.substr(1));
-            stateStack.push_back(j);
-            symStack.push_back(a);
-            ip++;
-        } else if(act[0]=='r') {
-            int k=stoi(act.substr(1));
-            Production p=grammar[k];
-            for(int j=0;j<p.rhs.size() && p.rhs!="#";j++) {
-                stateStack.pop_back();
-                symStack.pop_back();
-            }
+        for(int x:stateStack) cout<<symbolOf[x]<<" ";
+        cout<<setw(15)<<input.substr(step.input)<<setw(15)<<act<<"\n";
+        if(step.action==TraceAction::Shift) stateStack.push_back(stoi(act.substr(1)));
+        else if(step.action==TraceAction::Reduce) {
+            const Production &p=grammar[step.production];
+            for(size_t j=0;j<p.rhs.size() && p.rhs!="#";j++) stateStack.pop_back();
             int t=stateStack.back();
-            symStack.push_back(p.lhs);
-            string g=ACTION[{t,p.lhs}];
-            int j=stoi(g.substr(1));
-            stateStack.push_back(j);
+            stateStack.push_back(GOTO_CODES(t,column(p.lhs)));
         }
     }
 }
 
-int main() {
+int main(int argc, char *argv[]) {
+    // Usage: ./a.out [--no-trace] [--tables=FILE]
+    //   --no-trace skips the step listing; --tables=FILE loads the parse
+    //   tables from FILE if it holds them for this grammar, and otherwise
+    //   builds them and saves them there.
+    bool trace=true;
+    string table_file;
+    for(int i=1;i<argc;i++) {
+        string arg=argv[i];
+        if(arg=="--no-trace") trace=false;
+        else if(arg.rfind("--tables=",0)==0) table_file=arg.substr(9);
+    }
     grammar={
         {'Q',"S"},
         {'S',"CC"},
@@ -289,14 +420,33 @@ int main() {
     nonterminals={'Q','S','C'};
     terminals={'c','d'};
 
-    build_states();
-    build_parsing_table();
+    bool loaded=table_file!="" && tables.load(table_file,table_key()) && bind_tables();
+    if(!loaded) {
+        if(table_file!="" && ifstream(table_file)) cerr<<"Parse tables in '"<<table_file<<"' are stale or damaged; rebuilding\n";
+        build_states();
+        build_parsing_table();
+        pack_tables();
+        if(!bind_tables()) throw logic_error("parse tables do not match the grammar");
+        if(table_file!="" && !tables.save(table_file)) cerr<<"Cannot write parse tables to '"<<table_file<<"'\n";
+    }
 
     print_grammar();
-    print_states();
+    if(loaded) cout<<"Parse tables loaded from "<<table_file<<" (the LR(0) items are not kept there).\n\n";
+    else print_states();
     print_dfa();
     print_table();
-    parse("ccdd"); 
+    string input="ccdd";
+    cout<<"Parsing input string: "<<input<<"\n";
+    bool accepted;
+    if(trace) {
+        Trace<int> steps;
+        accepted=parse(input+"$",steps);
+        print_trace(steps,input+"$");
+    } else {
+        NoTrace quiet;
+        accepted=parse(input+"$",quiet);
+    }
+    cout<<(accepted?"Accepted!\n":"Error!\n");
 
     return 0;
 }
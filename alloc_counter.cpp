@@ -0,0 +1,78 @@
+// Counts the heap allocations a program makes, for lexer_benchmark.
+//
+//     g++ -std=c++17 -O2 -shared -fPIC -o alloc_counter.so alloc_counter.cpp
+//     ALLOC_COUNTER_OUT=counts.txt LD_PRELOAD=./alloc_counter.so ./program ...
+//
+// Wraps the C allocation functions (operator new goes through malloc) and,
+// when the program exits, writes "allocations N bytes B" to the file named
+// by ALLOC_COUNTER_OUT. Every call that returns memory counts once,
+// reallocs included; frees are not counted.
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *p, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+}
+
+static std::atomic<unsigned long long> allocations{0}, allocatedBytes{0};
+
+static void count(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+extern "C" {
+
+void *malloc(size_t size) {
+    count(size);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+    count(n * size);
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *p, size_t size) {
+    count(size);
+    return __libc_realloc(p, size);
+}
+
+void *memalign(size_t alignment, size_t size) {
+    count(size);
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+    count(size);
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **p, size_t alignment, size_t size) {
+    count(size);
+    *p = __libc_memalign(alignment, size);
+    return *p ? 0 : ENOMEM;
+}
+
+}
+
+__attribute__((destructor)) static void report() {
+    const char *path = getenv("ALLOC_COUNTER_OUT");
+    if (!path) return;
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return;
+    char line[96];
+    int n = snprintf(line, sizeof line, "allocations %llu bytes %llu\n",
+                     allocations.load(), allocatedBytes.load());
+    ssize_t written = write(fd, line, n);
+    (void)written;
+    close(fd);
+}
@@ -0,0 +1,94 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+// Bump-pointer allocator for the text of one lexing session: the source,
+// lexemes, diagnostics. Token records hold string_views (or offsets) into
+// it, and nothing is freed one by one.
+//
+//     Arena arena;
+//     std::string_view text = readAll(file, arena);
+//     std::string_view msg = arena.copy(lexErrorMessage(...));
+//     arena.reset();      // batch drivers: next file reuses the same blocks
+//
+// Memory comes in blocks that double in size, so a session of any length
+// is a handful of allocations, and destroying the arena frees that handful.
+// reset() keeps every block and starts filling from the first one again;
+// a block too small for a request is skipped until the next reset.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <istream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class Arena {
+    struct Block {
+        std::unique_ptr<char[]> data;
+        size_t size;
+    };
+    std::vector<Block> blocks;
+    size_t current = 0;             // block being filled, when there are any
+    char* cur = nullptr;
+    char* limit = nullptr;
+    size_t firstBlock;
+
+    // Moves to the next block that can hold `n` bytes, allocating one if
+    // no block after the current one is big enough.
+    void nextBlock(size_t n) {
+        size_t next = blocks.empty() ? 0 : current + 1;
+        while (next < blocks.size() && blocks[next].size < n) next++;
+        if (next == blocks.size()) {
+            size_t size = blocks.empty() ? firstBlock : blocks.back().size * 2;
+            blocks.push_back({std::unique_ptr<char[]>(new char[std::max(size, n)]), std::max(size, n)});
+        }
+        current = next;
+        cur = blocks[next].data.get();
+        limit = cur + blocks[next].size;
+    }
+
+public:
+    explicit Arena(size_t firstBlockBytes = 64 * 1024) : firstBlock(firstBlockBytes) {}
+
+    // `n` bytes, valid until reset() or the arena is destroyed. Text only:
+    // no alignment is guaranteed.
+    char* allocate(size_t n) {
+        if (size_t(limit - cur) < n) nextBlock(n);
+        char* p = cur;
+        cur += n;
+        return p;
+    }
+
+    std::string_view copy(std::string_view s) {
+        char* p = allocate(s.size());
+        if (!s.empty()) memcpy(p, s.data(), s.size());
+        return {p, s.size()};
+    }
+
+    void reset() {
+        current = 0;
+        cur = blocks.empty() ? nullptr : blocks[0].data.get();
+        limit = blocks.empty() ? nullptr : cur + blocks[0].size;
+    }
+};
+
+// Reads the rest of `in` into one piece of `arena`. Seekable streams are
+// read in one go; anything else is buffered first.
+inline std::string_view readAll(std::istream& in, Arena& arena) {
+    std::istream::pos_type here = in.tellg();
+    if (here != std::istream::pos_type(-1) && in.seekg(0, std::ios::end)) {
+        size_t size = size_t(in.tellg() - here);
+        in.seekg(here);
+        char* p = arena.allocate(size);
+        in.read(p, std::streamsize(size));
+        return {p, size_t(in.gcount())};
+    }
+    in.clear();
+    std::string buffered(std::istreambuf_iterator<char>(in), {});
+    return arena.copy(buffered);
+}
+
+#endif
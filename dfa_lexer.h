@@ -0,0 +1,471 @@
+#ifndef DFA_LEXER_H
+#define DFA_LEXER_H
+
+// Lexer generator: token rules as regular expressions in, a minimal DFA
+// as a flat transition table out.
+//
+//     DfaSpec spec;
+//     spec.literal("while", KEYWORD);           // earlier rules win ties
+//     spec.regex("[A-Za-z_][A-Za-z0-9_]*", ID);
+//     DfaTable dfa(spec);
+//     int rule;
+//     size_t n = dfa.match(p, end, rule);       // longest match at p; 0 if none
+//
+// The rules become one Thompson NFA, subset construction turns it into a
+// DFA and Hopcroft's algorithm minimises that. Bytes that no rule tells
+// apart share an equivalence class, so a table row has one column per
+// class rather than 256. match() is maximal munch: it walks the table a
+// byte at a time and remembers the last accepting state it passed.
+//
+// Regex syntax: literal bytes, \-escapes (\n \t \r \v \f \xHH, or any
+// other byte taken literally), [...] classes with ranges and ^, '.' for
+// any byte at all (newline included), ( ), |, *, + and ?.
+
+#include <algorithm>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class DfaSpec {
+public:
+    struct Rule {
+        std::string pattern;
+        bool isRegex;
+        int value;      // returned by match(); what it means is up to the caller
+    };
+
+    void regex(std::string_view pattern, int value) { rules.push_back({std::string(pattern), true, value}); }
+    void literal(std::string_view text, int value) { rules.push_back({std::string(text), false, value}); }
+
+    const std::vector<Rule>& all() const { return rules; }
+
+private:
+    std::vector<Rule> rules;
+};
+
+namespace dfa_detail {
+
+using ByteSet = std::bitset<256>;
+
+struct Nfa {
+    struct State {
+        ByteSet on;                 // bytes that move to `next`
+        int next = -1;
+        std::vector<int> eps;
+        int rule = -1;              // accepting for this rule (index into the spec)
+    };
+    std::vector<State> states;
+
+    int add() {
+        states.emplace_back();
+        return int(states.size()) - 1;
+    }
+};
+
+struct Fragment {
+    int start, end;
+};
+
+// Recursive descent over one pattern, building Thompson fragments.
+class RegexParser {
+    Nfa& nfa;
+    std::string_view re;
+    size_t pos = 0;
+
+    [[noreturn]] void fail(const char* what) const {
+        throw std::invalid_argument("regex '" + std::string(re) + "' at " + std::to_string(pos) + ": " + what);
+    }
+    bool more() const { return pos < re.size(); }
+    char peek() const { return re[pos]; }
+
+    static int hexDigit(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    unsigned char escape() {
+        if (!more()) fail("trailing backslash");
+        char c = re[pos++];
+        switch (c) {
+        case 'n': return '\n';
+        case 't': return '\t';
+        case 'r': return '\r';
+        case 'v': return '\v';
+        case 'f': return '\f';
+        case 'x': {
+            if (pos + 2 > re.size() || hexDigit(re[pos]) < 0 || hexDigit(re[pos + 1]) < 0) fail("bad \\x escape");
+            unsigned char b = (unsigned char)(hexDigit(re[pos]) * 16 + hexDigit(re[pos + 1]));
+            pos += 2;
+            return b;
+        }
+        default: return (unsigned char)c;
+        }
+    }
+
+    Fragment byteSet(const ByteSet& s) {
+        int a = nfa.add(), b = nfa.add();
+        nfa.states[a].on = s;
+        nfa.states[a].next = b;
+        return {a, b};
+    }
+
+    Fragment charClass() {
+        ByteSet s;
+        bool negate = more() && peek() == '^';
+        if (negate) pos++;
+        bool first = true;
+        while (more() && (peek() != ']' || first)) {
+            first = false;
+            unsigned char lo = peek() == '\\' ? (pos++, escape()) : (unsigned char)re[pos++];
+            unsigned char hi = lo;
+            if (pos + 1 < re.size() && peek() == '-' && re[pos + 1] != ']') {
+                pos++;
+                hi = peek() == '\\' ? (pos++, escape()) : (unsigned char)re[pos++];
+                if (hi < lo) fail("reversed range");
+            }
+            for (unsigned c = lo; c <= hi; c++) s.set(c);
+        }
+        if (!more()) fail("missing ]");
+        pos++;
+        if (negate) s.flip();
+        return byteSet(s);
+    }
+
+    Fragment atom() {
+        char c = re[pos++];
+        ByteSet s;
+        switch (c) {
+        case '(': {
+            Fragment f = alternation();
+            if (!more() || peek() != ')') fail("missing )");
+            pos++;
+            return f;
+        }
+        case '[': return charClass();
+        case '.': return byteSet(s.set());
+        case '\\': return byteSet(s.set(escape()));
+        case '*': case '+': case '?': case ')': case '|':
+            pos--;
+            fail("nothing to repeat or group");
+        default: return byteSet(s.set((unsigned char)c));
+        }
+    }
+
+    Fragment repetition() {
+        Fragment f = atom();
+        while (more() && (peek() == '*' || peek() == '+' || peek() == '?')) {
+            char op = re[pos++];
+            int a = nfa.add(), b = nfa.add();
+            nfa.states[a].eps.push_back(f.start);
+            nfa.states[f.end].eps.push_back(b);
+            if (op != '+') nfa.states[a].eps.push_back(b);           // zero times
+            if (op != '?') nfa.states[f.end].eps.push_back(f.start); // again
+            f = {a, b};
+        }
+        return f;
+    }
+
+    Fragment concatenation() {
+        if (!more() || peek() == '|' || peek() == ')') {
+            int a = nfa.add();
+            return {a, a};
+        }
+        Fragment f = repetition();
+        while (more() && peek() != '|' && peek() != ')') {
+            Fragment g = repetition();
+            nfa.states[f.end].eps.push_back(g.start);
+            f.end = g.end;
+        }
+        return f;
+    }
+
+    Fragment alternation() {
+        Fragment f = concatenation();
+        while (more() && peek() == '|') {
+            pos++;
+            Fragment g = concatenation();
+            int a = nfa.add(), b = nfa.add();
+            nfa.states[a].eps = {f.start, g.start};
+            nfa.states[f.end].eps.push_back(b);
+            nfa.states[g.end].eps.push_back(b);
+            f = {a, b};
+        }
+        return f;
+    }
+
+public:
+    RegexParser(Nfa& n, std::string_view pattern) : nfa(n), re(pattern) {}
+
+    Fragment parse() {
+        Fragment f = alternation();
+        if (more()) fail("unbalanced )");
+        return f;
+    }
+};
+
+inline Fragment literalFragment(Nfa& nfa, std::string_view text) {
+    int start = nfa.add(), end = start;
+    for (char c : text) {
+        int next = nfa.add();
+        nfa.states[end].on.set((unsigned char)c);
+        nfa.states[end].next = next;
+        end = next;
+    }
+    return {start, end};
+}
+
+}  // namespace dfa_detail
+
+class DfaTable {
+public:
+    explicit DfaTable(const DfaSpec& spec) {
+        using namespace dfa_detail;
+        Nfa nfa;
+        int start = nfa.add();
+        for (size_t r = 0; r < spec.all().size(); r++) {
+            const DfaSpec::Rule& rule = spec.all()[r];
+            Fragment f = rule.isRegex ? RegexParser(nfa, rule.pattern).parse()
+                                      : literalFragment(nfa, rule.pattern);
+            nfa.states[start].eps.push_back(f.start);
+            nfa.states[f.end].rule = int(r);
+            values.push_back(rule.value);
+        }
+
+        std::vector<int> nfaClass = byteClasses(nfa);
+        std::vector<std::vector<int>> delta;
+        std::vector<int> accept;
+        subsetConstruction(nfa, start, nfaClass, delta, accept);
+        int first = minimise(delta, accept);
+        buildTable(nfaClass, delta, accept, first);
+    }
+
+    // Length of the longest prefix of [p, end) that some rule matches, with
+    // the value of the first such rule in `value`; 0 (and value -1) if no
+    // rule matches a non-empty prefix.
+    size_t match(const char* p, const char* end, int& value) const {
+        const uint16_t* t = table.data();
+        const unsigned width = unsigned(classCount) + 1;
+        unsigned row = startRow;
+        const char* q = p;
+        const char* last = p;
+        unsigned lastRule = 0;
+        while (q < end) {
+            row = t[row + classOf[(unsigned char)*q++]];
+            if (row == 0) break;
+            if (unsigned r = t[row + width - 1]) {
+                last = q;
+                lastRule = r;
+            }
+        }
+        value = lastRule ? values[lastRule - 1] : -1;
+        return size_t(last - p);
+    }
+
+    size_t stateCount() const { return table.size() / (classCount + 1); }
+    int classes() const { return classCount; }
+    size_t tableBytes() const { return table.size() * sizeof(uint16_t) + sizeof classOf; }
+
+private:
+    // Row-major, one row per state: a column per byte class holding the
+    // next state's row offset, then the state's rule + 1 (0: not
+    // accepting). Row 0 is the dead state.
+    std::vector<uint16_t> table;
+    uint8_t classOf[256];
+    int classCount = 0;
+    unsigned startRow = 0;
+    std::vector<int> values;
+
+    // Splits the 256 bytes into classes that every NFA edge either
+    // contains whole or not at all.
+    static std::vector<int> byteClasses(const dfa_detail::Nfa& nfa) {
+        std::vector<dfa_detail::ByteSet> sets;
+        for (const auto& s : nfa.states)
+            if (s.next >= 0 && std::find(sets.begin(), sets.end(), s.on) == sets.end()) sets.push_back(s.on);
+        std::map<std::vector<bool>, int> ids;
+        std::vector<int> cls(256);
+        for (int b = 0; b < 256; b++) {
+            std::vector<bool> sig(sets.size());
+            for (size_t i = 0; i < sets.size(); i++) sig[i] = sets[i][b];
+            cls[b] = ids.emplace(sig, int(ids.size())).first->second;
+        }
+        return cls;
+    }
+
+    static void closure(const dfa_detail::Nfa& nfa, std::vector<int>& set) {
+        std::vector<bool> seen(nfa.states.size());
+        std::vector<int> stack(set);
+        for (int s : set) seen[s] = true;
+        while (!stack.empty()) {
+            int s = stack.back();
+            stack.pop_back();
+            for (int t : nfa.states[s].eps)
+                if (!seen[t]) {
+                    seen[t] = true;
+                    set.push_back(t);
+                    stack.push_back(t);
+                }
+        }
+        std::sort(set.begin(), set.end());
+    }
+
+    // DFA state 0 is the dead state (the empty set), state 1 the start.
+    static void subsetConstruction(const dfa_detail::Nfa& nfa, int start, const std::vector<int>& cls,
+                                   std::vector<std::vector<int>>& delta, std::vector<int>& accept) {
+        int nClasses = *std::max_element(cls.begin(), cls.end()) + 1;
+        std::vector<unsigned char> representative(nClasses);
+        for (int b = 255; b >= 0; b--) representative[cls[b]] = (unsigned char)b;
+
+        std::map<std::vector<int>, int> ids;
+        std::vector<std::vector<int>> sets;
+        auto intern = [&](std::vector<int>& set) {
+            auto it = ids.find(set);
+            if (it != ids.end()) return it->second;
+            int id = int(sets.size());
+            ids.emplace(set, id);
+            sets.push_back(set);
+            delta.emplace_back(nClasses, 0);
+            int rule = -1;
+            for (int s : set)
+                if (nfa.states[s].rule >= 0 && (rule < 0 || nfa.states[s].rule < rule)) rule = nfa.states[s].rule;
+            accept.push_back(rule);
+            return id;
+        };
+
+        std::vector<int> dead, first = {start};
+        intern(dead);
+        closure(nfa, first);
+        intern(first);
+        for (size_t d = 1; d < sets.size(); d++) {
+            for (int c = 0; c < nClasses; c++) {
+                std::vector<int> moved;
+                for (int s : sets[d])
+                    if (nfa.states[s].next >= 0 && nfa.states[s].on[representative[c]])
+                        moved.push_back(nfa.states[s].next);
+                if (moved.empty()) continue;
+                closure(nfa, moved);
+                int target = intern(moved);
+                delta[d][c] = target;
+            }
+        }
+    }
+
+    // Hopcroft's partition refinement. Blocks start as "dead or not
+    // accepting" and one block per rule; a block is split whenever some
+    // class sends only part of it into a splitter block. Afterwards the
+    // dead state's block is 0; returns the start state's (1, unless no rule
+    // can match anything).
+    static int minimise(std::vector<std::vector<int>>& delta, std::vector<int>& accept) {
+        int n = int(delta.size()), nClasses = int(delta[0].size());
+
+        std::vector<std::vector<std::vector<int>>> inverse(nClasses, std::vector<std::vector<int>>(n));
+        for (int s = 0; s < n; s++)
+            for (int c = 0; c < nClasses; c++) inverse[c][delta[s][c]].push_back(s);
+
+        std::vector<int> blockOf(n);
+        std::vector<std::vector<int>> blocks;
+        std::map<int, int> byRule;
+        for (int s = 0; s < n; s++) {
+            auto it = byRule.emplace(accept[s], int(blocks.size())).first;
+            if (it->second == int(blocks.size())) blocks.emplace_back();
+            blockOf[s] = it->second;
+            blocks[it->second].push_back(s);
+        }
+
+        std::vector<int> work;
+        std::vector<bool> inWork(blocks.size(), true);
+        for (int b = 0; b < int(blocks.size()); b++) work.push_back(b);
+
+        std::vector<int> hits(n, 0);        // per block: members seen in the current X
+        std::vector<bool> marked(n, false);
+        while (!work.empty()) {
+            int a = work.back();
+            work.pop_back();
+            inWork[a] = false;
+            std::vector<int> splitter = blocks[a];
+            for (int c = 0; c < nClasses; c++) {
+                std::vector<int> x, touched;
+                for (int t : splitter)
+                    for (int s : inverse[c][t]) x.push_back(s);
+                for (int s : x) {
+                    marked[s] = true;
+                    if (hits[blockOf[s]]++ == 0) touched.push_back(blockOf[s]);
+                }
+                for (int y : touched) {
+                    if (hits[y] < int(blocks[y].size())) {
+                        std::vector<int> in, out;
+                        for (int s : blocks[y]) (marked[s] ? in : out).push_back(s);
+                        int z = int(blocks.size());
+                        blocks[y] = std::move(in);
+                        blocks.push_back(std::move(out));
+                        for (int s : blocks[z]) blockOf[s] = z;
+                        inWork.push_back(false);
+                        if (inWork[y]) {
+                            work.push_back(z);
+                            inWork[z] = true;
+                        } else {
+                            int smaller = blocks[y].size() <= blocks[z].size() ? y : z;
+                            work.push_back(smaller);
+                            inWork[smaller] = true;
+                        }
+                    }
+                    hits[y] = 0;
+                }
+                for (int s : x) marked[s] = false;
+            }
+        }
+
+        // Renumber blocks so the dead state's is 0 and the start's is 1.
+        std::vector<int> order(blocks.size(), -1);
+        int next = 0;
+        order[blockOf[0]] = next++;
+        if (order[blockOf[1]] < 0) order[blockOf[1]] = next++;
+        for (size_t b = 0; b < blocks.size(); b++)
+            if (order[b] < 0) order[b] = next++;
+
+        std::vector<std::vector<int>> minDelta(blocks.size(), std::vector<int>(nClasses));
+        std::vector<int> minAccept(blocks.size());
+        for (size_t b = 0; b < blocks.size(); b++) {
+            int s = blocks[b][0];
+            for (int c = 0; c < nClasses; c++) minDelta[order[b]][c] = order[blockOf[delta[s][c]]];
+            minAccept[order[b]] = accept[s];
+        }
+        delta.swap(minDelta);
+        accept.swap(minAccept);
+        return order[blockOf[1]];
+    }
+
+    // Merges byte classes whose columns came out identical in the minimal
+    // DFA, then lays the rows out with row offsets as the entries.
+    void buildTable(const std::vector<int>& nfaClass, const std::vector<std::vector<int>>& delta,
+                    const std::vector<int>& accept, int start) {
+        size_t n = delta.size();
+        std::map<std::vector<int>, int> columns;
+        std::vector<int> merged(delta[0].size());
+        for (size_t c = 0; c < merged.size(); c++) {
+            std::vector<int> col(n);
+            for (size_t s = 0; s < n; s++) col[s] = delta[s][c];
+            merged[c] = columns.emplace(col, int(columns.size())).first->second;
+        }
+        classCount = int(columns.size());
+        for (int b = 0; b < 256; b++) classOf[b] = uint8_t(merged[nfaClass[b]]);
+
+        size_t width = size_t(classCount) + 1;
+        if (n * width > 0xffff) throw std::length_error("DfaTable: too many states for 16-bit rows");
+        table.assign(n * width, 0);
+        for (size_t s = 0; s < n; s++) {
+            for (size_t c = 0; c < delta[s].size(); c++)
+                table[s * width + merged[c]] = uint16_t(delta[s][c] * width);
+            table[s * width + width - 1] = uint16_t(accept[s] + 1);
+        }
+        startRow = unsigned(start * width);
+    }
+};
+
+#endif
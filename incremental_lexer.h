@@ -0,0 +1,203 @@
+#ifndef INCREMENTAL_LEXER_H
+#define INCREMENTAL_LEXER_H
+
+// Token stream of an edited buffer, kept up to date edit by edit.
+//
+//     IncrementalLexer<> doc(source);
+//     doc.edit(offset, removedLength, "inserted text");
+//     for (size_t i = 0; i < doc.size(); i++) doc[i] ...
+//
+// An edit relexes from the last token that cannot have changed and stops
+// at the first new token that starts where an old token after the edit
+// started. Every token starts with the Lexer at the top of its loop in Code
+// state, and from there the output depends only on the bytes that follow
+// and the line count. So once both streams start a token at the same place
+// in identical text, the rest of the old stream is still right, with its
+// lines moved by a constant. InvalidUtf8 diagnostics are the exception:
+// those from inside a literal or comment do not start at the top of the
+// loop, so no diagnostic of that kind is used as a restart or resync point.
+//
+// The text and the token stream are gap buffers whose gaps sit where the
+// last relex started. Tokens after the gap are stored relative to the end
+// of the text and to the final line count, so an edit never touches them.
+// The cost of an edit is the distance the gaps move plus the relexed
+// tokens, not the size of the buffer.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "lexer.h"
+
+template <class KeywordWords = CKeywords, class OperatorWords = COperators>
+class IncrementalLexer {
+    struct Entry {
+        uint32_t offset;    // after the gap: bytes from the token to the end of the text
+        uint32_t length;
+        int32_t line;       // after the gap: lines from the token to endLine
+        TokenKind kind;
+        LexErrorKind error;
+    };
+
+public:
+    explicit IncrementalLexer(std::string_view text)
+        : buf(text.begin(), text.end()), gapBegin(0), gapEnd(0) {
+        relex(0, 1, 0);
+    }
+
+    size_t size() const { return front.size() + back.size(); }
+    size_t textSize() const { return buf.size() - (gapEnd - gapBegin); }
+    int endLine() const { return lastLine; }
+
+    // Views into the buffer; valid until the next edit.
+    LexToken operator[](size_t i) const {
+        Entry e = i < front.size() ? front[i] : absolute(back[back.size() - 1 - (i - front.size())]);
+        const char* at = e.offset < gapBegin ? buf.data() + e.offset
+                                             : buf.data() + gapEnd + (e.offset - gapBegin);
+        LexToken t{e.kind, e.error, std::string_view(at, e.length), e.offset, e.line, columnOf(e.offset)};
+        if (e.kind == TokenKind::Num) decodeNumber(t.text, t.number);    // not stored; cheap to redo
+        return t;
+    }
+
+    std::string text() const {
+        std::string s(buf.data(), gapBegin);
+        s.append(buf.data() + gapEnd, buf.size() - gapEnd);
+        return s;
+    }
+
+    // Replaces `removed` bytes at `offset` with `inserted`. Returns the
+    // number of tokens that were lexed again.
+    size_t edit(size_t offset, size_t removed, std::string_view inserted) {
+        if (offset > textSize() || removed > textSize() - offset)
+            throw std::out_of_range("IncrementalLexer::edit: range past end of text");
+
+        // Tokens ending before the edit -- with the byte after them, which
+        // the lexer may have peeked at -- stay in front; the last of them
+        // is where lexing restarts.
+        while (!front.empty() && uint64_t(front.back().offset) + front.back().length >= offset) {
+            back.push_back(relative(front.back()));
+            front.pop_back();
+        }
+        while (!back.empty()) {
+            Entry e = absolute(back.back());
+            if (uint64_t(e.offset) + e.length >= offset) break;
+            front.push_back(e);
+            back.pop_back();
+        }
+        while (!front.empty() && isUtf8Diagnostic(front.back())) {
+            back.push_back(relative(front.back()));
+            front.pop_back();
+        }
+        size_t restart = 0;
+        int restartLine = 1;
+        if (!front.empty()) {
+            restart = front.back().offset;
+            restartLine = front.back().line;
+            front.pop_back();
+        }
+
+        // Old tokens overlapping the replaced bytes can never be resync points.
+        size_t oldSize = textSize();
+        while (!back.empty() && back.back().offset > oldSize - offset - removed) back.pop_back();
+
+        moveGap(offset);
+        gapEnd += removed;
+        if (gapEnd - gapBegin < inserted.size()) grow(inserted.size());
+        if (!inserted.empty()) memcpy(buf.data() + gapBegin, inserted.data(), inserted.size());
+        gapBegin += inserted.size();
+        moveGap(restart);
+
+        return relex(restart, restartLine, offset + inserted.size());
+    }
+
+private:
+    std::vector<char> buf;          // text is buf[0, gapBegin) + buf[gapEnd, end)
+    size_t gapBegin, gapEnd;
+    std::vector<Entry> front;       // tokens before the gap, in order
+    std::vector<Entry> back;        // tokens after the gap, last token first
+    int lastLine = 1;               // the lexer's line count at end of text
+
+    Entry absolute(Entry e) const {
+        e.offset = uint32_t(textSize() - e.offset);
+        e.line = lastLine - e.line;
+        return e;
+    }
+    Entry relative(Entry e) const { return absolute(e); }   // the mapping is its own inverse
+
+    static bool isUtf8Diagnostic(const Entry& e) {
+        return e.kind == TokenKind::Error && e.error == LexErrorKind::InvalidUtf8;
+    }
+
+    // Relexing starts mid-line, so columns are not stored; they are
+    // counted back to the previous '\n', on both sides of the gap.
+    int columnOf(size_t offset) const {
+        const char* b = buf.data();
+        if (offset > gapBegin) {
+            const char* after = b + gapEnd;
+            if (const void* nl = memrchr(after, '\n', offset - gapBegin))
+                return int(after + (offset - gapBegin) - static_cast<const char*>(nl));
+        }
+        size_t head = std::min(offset, gapBegin);
+        const void* nl = memrchr(b, '\n', head);
+        size_t lineStart = nl ? static_cast<const char*>(nl) - b + 1 : 0;
+        return int(offset - lineStart) + 1;
+    }
+
+    void moveGap(size_t pos) {
+        char* b = buf.data();
+        if (pos < gapBegin) {
+            size_t n = gapBegin - pos;
+            memmove(b + gapEnd - n, b + pos, n);
+            gapBegin -= n;
+            gapEnd -= n;
+        } else if (pos > gapBegin) {
+            size_t n = pos - gapBegin;
+            memmove(b + gapBegin, b + gapEnd, n);
+            gapBegin += n;
+            gapEnd += n;
+        }
+    }
+
+    void grow(size_t need) {
+        size_t tail = buf.size() - gapEnd;
+        size_t gap = std::max(need, buf.size() / 2 + 64);
+        std::vector<char> bigger(gapBegin + gap + tail);
+        if (gapBegin) memcpy(bigger.data(), buf.data(), gapBegin);
+        if (tail) memcpy(bigger.data() + gapBegin + gap, buf.data() + gapEnd, tail);
+        buf.swap(bigger);
+        gapEnd = gapBegin + gap;
+    }
+
+    // Lexes from `restart` (the gap) until a token starts at or after
+    // `clean` where an old token also started, or to the end of the text.
+    size_t relex(size_t restart, int restartLine, size_t clean) {
+        const char* begin = buf.data() + gapEnd;
+        const char* end = buf.data() + buf.size();
+        size_t total = textSize();
+        size_t produced = 0;
+        Lexer<KeywordWords, OperatorWords> lex(begin, begin, end, end, LexState::Code, restartLine);
+        LexToken t;
+        while (lex.next(t)) {
+            size_t at = restart + t.offset;
+            if (at >= clean && !(t.kind == TokenKind::Error && t.error == LexErrorKind::InvalidUtf8)) {
+                uint32_t rel = uint32_t(total - at);
+                while (!back.empty() && back.back().offset > rel) back.pop_back();
+                if (!back.empty() && back.back().offset == rel && !isUtf8Diagnostic(back.back())) {
+                    lastLine += t.line - (lastLine - back.back().line);
+                    return produced;
+                }
+            }
+            front.push_back({uint32_t(at), uint32_t(t.text.size()), t.line, t.kind, t.error});
+            produced++;
+        }
+        back.clear();
+        lastLine = lex.line();
+        return produced;
+    }
+};
+
+#endif
@@ -1,11 +1,19 @@
 #include <iostream>
-#include <map>
+#include <fstream>
 #include <set>
 #include <vector>
-#include <stack>
-#include <sstream>
 #include <iomanip>
-#include <algorithm> // for reverse()
+#include <charconv>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include "lexer.h"
+#include "parse_tables.h"
+#include "parse_trace.h"
+#include "work_pool.h"
 using namespace std;
 
 using Symbol = string;
@@ -15,268 +23,764 @@ struct Production {
     vector<Symbol> rhs;
 };
 
-vector<Production> productions;
-set<Symbol> terminals, nonTerminals;
-map<Symbol, set<Symbol>> FIRST, FOLLOW;
-map<pair<Symbol, Symbol>, vector<Symbol>> parsingTable;
-Symbol startSymbol;
-
+bool isBracket(char c) {
+    return c == '(' || c == ')' || c == '{' || c == '}' || c == '[' || c == ']';
+}
 
-bool isTerminal(const Symbol& s) {
-    return terminals.count(s) > 0;
+// Splits on whitespace, with every bracket a symbol of its own. Right-hand
+// sides are read this way, and by default so are strings to parse, so an
+// input spells each terminal as the grammar does. f(symbol, column) gets
+// 1-based columns.
+template <class F>
+void forEachSymbol(string_view str, F&& f) {
+    size_t pos = 0;
+    while (pos < str.size()) {
+        if (isspace((unsigned char)str[pos])) {
+            pos++;
+            continue;
+        }
+        size_t start = pos++;
+        if (!isBracket(str[start]))
+            while (pos < str.size() && !isspace((unsigned char)str[pos]) && !isBracket(str[pos])) pos++;
+        f(str.substr(start, pos - start), start + 1);
+    }
 }
 
 vector<Symbol> tokenizeWithParentheses(const string& str) {
     vector<Symbol> tokens;
-    stringstream ss(str);
-    string temp;
-    while (ss >> temp) {
-        size_t pos = 0;
-        while (pos < temp.size()) {
-            if (temp[pos] == '(' || temp[pos] == ')' ||
-                temp[pos] == '{' || temp[pos] == '}' ||
-                temp[pos] == '[' || temp[pos] == ']') {
-                tokens.push_back(string(1, temp[pos]));
-                pos++;
-            } else {
-                size_t start = pos;
-                while (pos < temp.size() &&
-                       temp[pos] != '(' && temp[pos] != ')' &&
-                       temp[pos] != '{' && temp[pos] != '}' &&
-                       temp[pos] != '[' && temp[pos] != ']')
-                    pos++;
-                tokens.push_back(temp.substr(start, pos - start));
-            }
-        }
-    }
+    forEachSymbol(str, [&](string_view s, size_t) { tokens.emplace_back(s); });
+    return tokens;
+}
+
+// With --c-tokens, strings to parse are split by the streaming C lexer
+// instead, so "id+id*id" and "id + id * id" give the same symbols.
+// Characters the lexer does not know (like '[' or '$') come back as
+// one-character diagnostics and are kept as symbols too. This only suits
+// grammars whose terminals are single C tokens as written: one the lexer
+// splits or rewrites, such as ":=", "a.b", "'x'" or "≤", never matches.
+vector<Symbol> lexInput(const string& str) {
+    Lexer<> lex(str.data(), str.data(), str.data() + str.size(), str.data() + str.size());
+    vector<Symbol> tokens;
+    for (const LexToken& t : lex) tokens.emplace_back(t.text);
     return tokens;
 }
 
+// The parser works on symbol ids, not names. Terminals come first -- they
+// are the columns of the parsing table, with "$" and then unknownSymbol
+// last -- and nonterminals after them. Every input token the grammar does
+// not have is unknownSymbol, a column no table entry uses. A name that is
+// both a terminal and a left-hand side is a nonterminal. Uppercase names
+// that only appear on right-hand sides come last, from firstUndefined on:
+// they have no productions and so derive nothing.
+using SymbolId = uint16_t;
+
+// A set of terminal ids, one bit each.
+class TerminalSet {
+    vector<uint64_t> words;
+public:
+    TerminalSet() = default;
+    explicit TerminalSet(size_t terminals) : words((terminals + 63) / 64) {}
 
-set<Symbol> computeFIRST(const Symbol &sym) {
-    if (FIRST.count(sym)) return FIRST[sym];
-    set<Symbol> result;
-    if (isTerminal(sym) || sym == "epsilon") {
-        result.insert(sym);
-        return FIRST[sym] = result;
+    void insert(SymbolId t) { words[t >> 6] |= uint64_t(1) << (t & 63); }
+    TerminalSet& operator|=(const TerminalSet& o) {
+        for (size_t i = 0; i < words.size(); ++i) words[i] |= o.words[i];
+        return *this;
     }
-    for (const auto& prod : productions) {
-        if (prod.lhs == sym) {
-            bool epsilonAll = true;
-            for (const Symbol& s : prod.rhs) {
-                set<Symbol> firstS = computeFIRST(s);
-                for (const Symbol& f : firstS) {
-                    if (f != "epsilon") result.insert(f);
-                }
-                if (!firstS.count("epsilon")) {
-                    epsilonAll = false;
-                    break;
+    template <class F> void forEach(F f) const {
+        for (size_t i = 0; i < words.size(); ++i)
+            for (uint64_t w = words[i]; w; w &= w - 1) f(SymbolId(i * 64 + __builtin_ctzll(w)));
+    }
+};
+
+// Closes the sets over a dependency graph: afterwards sets[v] includes
+// sets[w] for every w reachable from v. The members of a strongly connected
+// component all end up with the same set, so each component is merged once,
+// when Tarjan's algorithm completes it -- by then every component it
+// depends on is complete and final. Iterative, so deep grammars cannot
+// overflow the stack.
+void closeOverDependencies(const vector<vector<uint32_t>>& deps, vector<TerminalSet>& sets) {
+    size_t n = deps.size();
+    vector<uint32_t> index(n, UINT32_MAX), low(n), open;
+    vector<bool> onStack(n, false);
+    vector<pair<uint32_t, size_t>> calls;     // node, next edge to follow
+    uint32_t counter = 0;
+
+    for (uint32_t root = 0; root < n; ++root) {
+        if (index[root] != UINT32_MAX) continue;
+        index[root] = low[root] = counter++;
+        open.push_back(root);
+        onStack[root] = true;
+        calls.push_back({root, 0});
+        while (!calls.empty()) {
+            uint32_t v = calls.back().first;
+            if (calls.back().second < deps[v].size()) {
+                uint32_t w = deps[v][calls.back().second++];
+                if (index[w] == UINT32_MAX) {
+                    index[w] = low[w] = counter++;
+                    open.push_back(w);
+                    onStack[w] = true;
+                    calls.push_back({w, 0});
+                } else if (onStack[w]) {
+                    low[v] = min(low[v], index[w]);
                 }
+                continue;
+            }
+            calls.pop_back();
+            if (!calls.empty()) low[calls.back().first] = min(low[calls.back().first], low[v]);
+            if (low[v] != index[v]) continue;
+
+            size_t first = open.size();
+            do --first; while (open[first] != v);
+            TerminalSet merged = sets[v];
+            for (size_t i = first; i < open.size(); ++i) {
+                merged |= sets[open[i]];
+                for (uint32_t w : deps[open[i]]) merged |= sets[w];
             }
-            if (epsilonAll) result.insert("epsilon");
+            for (size_t i = first; i < open.size(); ++i) {
+                sets[open[i]] = merged;
+                onStack[open[i]] = false;
+            }
+            open.resize(first);
         }
     }
-    return FIRST[sym] = result;
 }
 
-set<Symbol> computeFOLLOW(const Symbol &sym) {
-    if (FOLLOW.count(sym)) return FOLLOW[sym];
-    set<Symbol> result;
-    if (sym == startSymbol) result.insert("$");
-    for (const auto &prod : productions) {
-        for (size_t i = 0; i < prod.rhs.size(); ++i) {
-            if (prod.rhs[i] == sym) {
-                bool epsilonAll = true;
-                for (size_t j = i + 1; j < prod.rhs.size(); ++j) {
-                    set<Symbol> firstS = computeFIRST(prod.rhs[j]);
-                    for (const Symbol& f : firstS) {
-                        if (f != "epsilon") result.insert(f);
-                    }
-                    if (!firstS.count("epsilon")) {
-                        epsilonAll = false;
-                        break;
-                    }
-                }
-                if (i + 1 == prod.rhs.size() || epsilonAll) {
-                    if (prod.lhs != sym) {
-                        set<Symbol> followLHS = computeFOLLOW(prod.lhs);
-                        result.insert(followLHS.begin(), followLHS.end());
-                    }
+struct ParseResult {
+    bool accepted;
+    size_t position;        // input position where the parser stopped
+};
+
+// Sections of an LL(1) table file (see parse_tables.h).
+enum : uint32_t {
+    LL1_INFO = 1,
+    LL1_SYMBOLS = 2,        // a SymbolIndex, 3 sections
+    LL1_LHS = 5,
+    LL1_RHS = 6,
+    LL1_RHS_BEGIN = 7,
+    LL1_TABLE = 8           // a PackedTable, 4 sections
+};
+
+// A grammar and its LL(1) table. The constructor does all the analysis and
+// writes what parsing needs into a table image; load() maps that image
+// from a file saved by an earlier run instead, with no analysis at all.
+// After that nothing changes, so any number of threads can parse against
+// one LL1Grammar at once, each with its own stack.
+class LL1Grammar {
+public:
+    explicit LL1Grammar(vector<Production> prods) : productions(move(prods)) {
+        for (const auto& prod : productions) {
+            nonTerminals.insert(prod.lhs);
+            for (const auto& tok : prod.rhs) {
+                if (!(isupper(tok[0]) && tok != "epsilon")) {
+                    if (tok != "epsilon")
+                        terminals.insert(tok);
                 }
             }
         }
+        internGrammar();
+        computeNullable();
+        computeFIRST();
+        computeFOLLOW();
+        buildParsingTable();
+        tables = TableImage(writeTables(), tableKey(productions));
+        if (!bindTables()) throw logic_error("parse tables do not match the grammar");
+        parsingTable = {};      // parsing reads the packed copy
     }
-    return FOLLOW[sym] = result;
-}
 
-void buildParsingTable() {
-    for (const auto &prod : productions) {
-        bool epsilonAll = true;
-        for (const Symbol &s : prod.rhs) {
-            set<Symbol> firstS = computeFIRST(s);
-            for (const Symbol& f : firstS) {
-                if (f != "epsilon")
-                    parsingTable[{prod.lhs, f}] = prod.rhs;
-            }
-            if (!firstS.count("epsilon")) {
-                epsilonAll = false;
+    // The grammar with the tables `file` holds for it, or null if the file is
+    // missing, damaged, or was saved for other productions.
+    static unique_ptr<LL1Grammar> load(const vector<Production>& prods, const string& file) {
+        TableImage image;
+        if (!image.load(file, tableKey(prods))) return nullptr;
+        unique_ptr<LL1Grammar> grammar(new LL1Grammar(prods, move(image)));
+        if (!grammar->bindTables()) return nullptr;
+        return grammar;
+    }
+
+    bool save(const string& file) const { return tables.save(file); }
+
+    // Whether FIRST and FOLLOW are at hand; table files do not keep them.
+    bool analysed() const { return !FIRST.empty(); }
+
+    // Input ids: anything that is not a terminal of the grammar is
+    // unknownSymbol. "$" and "?" name the end marker and unknownSymbol
+    // itself, so a "$" typed in the input is unknown too; only the end of
+    // the input is endOfInput().
+    SymbolId idOf(string_view token) const {
+        int64_t id = names.find(token);
+        return id >= 0 && id < endMarker ? SymbolId(id) : unknownSymbol;
+    }
+
+    // The ids of a whole input, ending with endOfInput().
+    vector<SymbolId> symbolIdsOf(const vector<Symbol>& tokens) const {
+        vector<SymbolId> ids;
+        ids.reserve(tokens.size() + 1);
+        for (const Symbol& t : tokens) ids.push_back(idOf(t));
+        ids.push_back(endOfInput());
+        return ids;
+    }
+
+    SymbolId endOfInput() const { return endMarker; }
+
+    // The loop touches nothing but ids: the stack, the input and the table.
+    // Steps go to the tracer; with NoTrace there is nothing else. The input
+    // ends with endOfInput().
+    template <class Tracer>
+    ParseResult parse(const vector<SymbolId>& input, vector<SymbolId>& st, Tracer& trace) const {
+        st.clear();
+        st.push_back(endMarker);
+        st.push_back(startId);
+
+        size_t ip = 0;
+        while (!st.empty()) {
+            SymbolId top = st.back();
+            SymbolId a = input[ip];
+            if (top == a) {
+                if (top == endMarker) {
+                    trace.step(TraceAction::Accept, 0, st.size(), ip);
+                    trace.finish(st);
+                    return {true, ip};
+                }
+                trace.step(TraceAction::Match, 0, st.size(), ip);
+                st.pop_back(); ++ip;
+            } else if (top >= firstNonTerminal && top < firstUndefined && table(top - firstNonTerminal, a) >= 0) {
+                int p = table(top - firstNonTerminal, a);
+                trace.step(TraceAction::Expand, p, st.size(), ip);
+                st.pop_back();
+                st.insert(st.end(), rhsIds.begin() + rhsStart[p], rhsIds.begin() + rhsStart[p + 1]);
+            } else {
+                trace.step(TraceAction::Error, 0, st.size(), ip);
                 break;
             }
         }
-        if (epsilonAll) {
-            for (const Symbol &f : computeFOLLOW(prod.lhs))
-                parsingTable[{prod.lhs, f}] = prod.rhs;
-        }
+        trace.finish(st);
+        return {false, ip};
     }
-}
 
-void displayFirstFollowCombined() {
-    cout << "\nFIRST and FOLLOW Sets (side-by-side):\n";
-    cout << "+--------------+-------------------------+-------------------------+\n";
-    cout << "| Non-Terminal | FIRST                   | FOLLOW                  |\n";
-    cout << "+--------------+-------------------------+-------------------------+\n";
-    for (const auto& nt : nonTerminals) {
-        cout << "| " << setw(12) << nt << " | ";
-
-        // Print FIRST set
-        for (const auto& f : FIRST[nt]) cout << f << " ";
-        int firstSetWidth = 25;
-        int firstSetLen = 0;
-        for (const auto& f : FIRST[nt]) firstSetLen += (int)f.size() + 1;
-        for (int i = 0; i < firstSetWidth - firstSetLen; i++) cout << " ";
-
-        cout << "| ";
-
-        // Print FOLLOW set
-        for (const auto& f : FOLLOW[nt]) cout << f << " ";
-        int followSetWidth = 25;
-        int followSetLen = 0;
-        for (const auto& f : FOLLOW[nt]) followSetLen += (int)f.size() + 1;
-        for (int i = 0; i < followSetWidth - followSetLen; i++) cout << " ";
-
-        cout << "|\n";
-    }
-    cout << "+--------------+-------------------------+-------------------------+\n";
-}
+    void displayFirstFollowCombined() const {
+        cout << "\nFIRST and FOLLOW Sets (side-by-side):\n";
+        cout << "+--------------+-------------------------+-------------------------+\n";
+        cout << "| Non-Terminal | FIRST                   | FOLLOW                  |\n";
+        cout << "+--------------+-------------------------+-------------------------+\n";
+        for (SymbolId nt = firstNonTerminal; nt < firstUndefined; ++nt) {
+            SymbolId id = nt - firstNonTerminal;
+            set<Symbol> first = namesOf(FIRST[id], nullable[id]), follow = namesOf(FOLLOW[id], false);
+            cout << "| " << setw(12) << symbolNames[nt] << " | ";
+
+            // Print FIRST set
+            for (const auto& f : first) cout << f << " ";
+            int firstSetWidth = 25;
+            int firstSetLen = 0;
+            for (const auto& f : first) firstSetLen += (int)f.size() + 1;
+            for (int i = 0; i < firstSetWidth - firstSetLen; i++) cout << " ";
+
+            cout << "| ";
 
-void displayParsingTable() {
-    vector<Symbol> termList(terminals.begin(), terminals.end());
-    termList.push_back("$");
-    cout << "\nLL(1) Parsing Table:\n";
-    cout << "+--------------";
-    for (const auto& t : termList) cout << "+-------------";
-    cout << "+\n| Non-Terminal";
-    for (const auto& t : termList) cout << "| " << setw(11) << t << " ";
-    cout << "|\n+--------------";
-    for (size_t i = 0; i < termList.size(); ++i) cout << "+-------------";
-    cout << "+\n";
-    for (const auto& nt : nonTerminals) {
-        cout << "| " << setw(12) << nt << " ";
-        for (const auto &t : termList) {
-            auto key = make_pair(nt, t);
-            if (parsingTable.count(key)) {
-                cout << "| " << nt << "->";
-                for (const auto& s : parsingTable[key]) cout << s << " ";
-                cout << " ";
-            } else cout << "|     -       ";
+            // Print FOLLOW set
+            for (const auto& f : follow) cout << f << " ";
+            int followSetWidth = 25;
+            int followSetLen = 0;
+            for (const auto& f : follow) followSetLen += (int)f.size() + 1;
+            for (int i = 0; i < followSetWidth - followSetLen; i++) cout << " ";
+
+            cout << "|\n";
         }
+        cout << "+--------------+-------------------------+-------------------------+\n";
+    }
+
+    void displayParsingTable() const {
+        cout << "\nLL(1) Parsing Table:\n";
+        cout << "+--------------";
+        for (SymbolId t = 0; t <= endMarker; ++t) cout << "+-------------";
+        cout << "+\n| Non-Terminal";
+        for (SymbolId t = 0; t <= endMarker; ++t) cout << "| " << setw(11) << names[t] << " ";
         cout << "|\n+--------------";
-        for (size_t i = 0; i < termList.size(); ++i) cout << "+-------------";
+        for (SymbolId t = 0; t <= endMarker; ++t) cout << "+-------------";
         cout << "+\n";
+        for (SymbolId nt = firstNonTerminal; nt < firstUndefined; ++nt) {
+            cout << "| " << setw(12) << names[nt] << " ";
+            for (SymbolId t = 0; t <= endMarker; ++t) {
+                int p = table(nt - firstNonTerminal, t);
+                if (p >= 0) {
+                    cout << "| " << names[nt] << "->";
+                    for (const auto& s : productions[p].rhs) cout << s << " ";
+                    cout << " ";
+                } else cout << "|     -       ";
+            }
+            cout << "|\n+--------------";
+            for (SymbolId t = 0; t <= endMarker; ++t) cout << "+-------------";
+            cout << "+\n";
+        }
     }
-}
 
-bool parseString(const vector<Symbol>& tokens) {
-    stack<Symbol> st;
-    st.push("$");
-    st.push(startSymbol);
-
-    size_t ip = 0;
-    cout << "\nParsing Steps:\n";
-    cout << left << setw(30) << "Stack" << setw(30) << "Input" << "Action\n";
-    cout << string(90, '-') << "\n";
-
-    while (!st.empty()) {
-        Symbol top = st.top();
-        string stackContent;
-        {
-            stack<Symbol> temp = st;
-            vector<Symbol> v;
-            while (!temp.empty()) { v.push_back(temp.top()); temp.pop(); }
-            reverse(v.begin(), v.end());
-            for (const auto& c : v) stackContent += c + " ";
+    // The step listing. The stack before the oldest kept step comes from
+    // undoing the kept steps, last first, on the final stack.
+    void printTrace(const Trace<SymbolId>& trace, const vector<Symbol>& lexed) const {
+        vector<SymbolId> input = symbolIdsOf(lexed);
+        vector<Symbol> tokens = lexed;
+        tokens.push_back("$");
+        vector<SymbolId> st = trace.finalStack();
+        for (size_t k = trace.size(); k-- > 0;) {
+            const TraceStep& step = trace[k];
+            if (step.action == TraceAction::Match) {
+                st.push_back(input[step.input]);
+            } else if (step.action == TraceAction::Expand) {
+                st.resize(st.size() - (rhsStart[step.production + 1] - rhsStart[step.production]));
+                st.push_back(lhsIds[step.production]);
+            }
         }
-        string inputBuffer;
-        for (size_t i = ip; i < tokens.size(); ++i) inputBuffer += tokens[i] + " ";
 
-        cout << setw(30) << stackContent << setw(30) << inputBuffer;
+        cout << "\nParsing Steps:\n";
+        cout << left << setw(30) << "Stack" << setw(30) << "Input" << "Action\n";
+        cout << string(90, '-') << "\n";
+        if (trace.dropped()) cout << "(" << trace.dropped() << " earlier steps not kept)\n";
+        for (size_t k = 0; k < trace.size(); ++k) {
+            const TraceStep& step = trace[k];
+            SymbolId top = st.back();
+            string stackContent;
+            for (SymbolId s : st) {
+                stackContent += names[s];
+                stackContent += ' ';
+            }
+            string inputBuffer;
+            for (size_t i = step.input; i < tokens.size(); ++i) inputBuffer += tokens[i] + " ";
+            cout << setw(30) << stackContent << setw(30) << inputBuffer;
 
-        if (top == tokens[ip]) {
-            if (top == "$") {
+            switch (step.action) {
+            case TraceAction::Accept:
                 cout << "ACCEPT\n";
-                return true;
-            }
-            st.pop(); ++ip;
-            cout << "Match " << top << "\n";
-        } else if (nonTerminals.count(top)) {
-            auto key = make_pair(top, tokens[ip]);
-            if (parsingTable.count(key)) {
-                st.pop();
-                const auto& prod = parsingTable[key];
-                cout << top << "->";
-                for (const auto& s : prod) cout << s << " ";
+                break;
+            case TraceAction::Match:
+                cout << "Match " << names[top] << "\n";
+                st.pop_back();
+                break;
+            case TraceAction::Expand: {
+                uint32_t p = step.production;
+                cout << names[top] << "->";
+                for (const auto& s : productions[p].rhs) cout << s << " ";
                 cout << "\n";
-                if (prod.size() == 1 && prod[0] == "epsilon") continue;
-                for (int i = (int)prod.size() - 1; i >= 0; --i) st.push(prod[i]);
-            } else {
-                cout << "ERROR: No rule for (" << top << ", " << tokens[ip] << ")\n";
-                return false;
+                st.pop_back();
+                st.insert(st.end(), rhsIds.begin() + rhsStart[p], rhsIds.begin() + rhsStart[p + 1]);
+                break;
             }
-        } else {
-            cout << "ERROR: Terminal mismatch (" << top << " vs " << tokens[ip] << ")\n";
+            default:
+                if (top >= firstNonTerminal && top < firstUndefined)
+                    cout << "ERROR: No rule for (" << names[top] << ", " << tokens[step.input] << ")\n";
+                else
+                    cout << "ERROR: Terminal mismatch (" << names[top] << " vs " << tokens[step.input] << ")\n";
+                break;
+            }
+        }
+    }
+
+private:
+    struct TableInfo {
+        uint32_t productions, columns;
+        SymbolId endMarker, unknownSymbol, firstNonTerminal, firstUndefined, startId, reserved;
+    };
+
+    LL1Grammar(const vector<Production>& prods, TableImage image) : productions(prods), tables(move(image)) {}
+
+    vector<Production> productions;
+    SymbolId endMarker, unknownSymbol, firstNonTerminal, firstUndefined, startId;
+    size_t columnCount;
+
+    // What parsing and the listings read: views into `tables`, which is
+    // either a mapped table file or the image the analysis was written to.
+    // They mirror the analysis data below.
+    TableImage tables;
+    SymbolIndex names;
+    CacheArray<SymbolId> lhsIds, rhsIds;
+    CacheArray<uint32_t> rhsStart;
+    PackedTable table;
+
+    // The analysis, empty for a grammar loaded from a table file.
+    set<Symbol> terminals, nonTerminals;
+    vector<Symbol> symbolNames;
+
+    // Left-hand sides as ids, and right-hand sides reversed so they are
+    // pushed in order, with "epsilon" left out. Production p's symbols are
+    // rhsCode[rhsBegin[p], rhsBegin[p + 1]).
+    vector<SymbolId> lhsCode, rhsCode;
+    vector<uint32_t> rhsBegin;
+
+    // Indexed by symbol - firstNonTerminal, undefined symbols included.
+    vector<bool> nullable;
+    vector<TerminalSet> FIRST, FOLLOW;
+
+    // The LL(1) table: production index by [nonterminal - firstNonTerminal]
+    // [terminal], -1 where there is none. Dropped once it is packed.
+    vector<int16_t> parsingTable;
+
+    int16_t& tableEntry(SymbolId nonTerminal, SymbolId terminal) {
+        return parsingTable[(nonTerminal - firstNonTerminal) * columnCount + terminal];
+    }
+
+    SymbolId lhsOf(size_t p) const { return lhsCode[p]; }
+
+    // Tables are only good for the productions they were built from, in the
+    // same order.
+    static CacheKey tableKey(const vector<Production>& prods) {
+        string text;
+        for (const auto& prod : prods) {
+            text += prod.lhs + "->";
+            for (const auto& s : prod.rhs) text += s + " ";
+            text += "\n";
+        }
+        return makeCacheKey(text, "lab5/ll1-tables/1");
+    }
+
+    CacheWriter writeTables() const {
+        TableInfo info = {uint32_t(productions.size()), uint32_t(columnCount), endMarker, unknownSymbol,
+                          firstNonTerminal, firstUndefined, startId, 0};
+        CacheWriter w;
+        w.add(LL1_INFO, &info, sizeof info);
+        addSymbolIndex(w, LL1_SYMBOLS, symbolNames);
+        w.add(LL1_LHS, lhsCode);
+        w.add(LL1_RHS, rhsCode);
+        w.add(LL1_RHS_BEGIN, rhsBegin);
+        addPackedTable(w, LL1_TABLE, parsingTable, uint32_t(firstUndefined - firstNonTerminal),
+                       uint32_t(columnCount), int16_t(-1));
+        return w;
+    }
+
+    // Points the views at `tables`, checking every id and index in them
+    // once so that parse() can trust them. False if anything is off.
+    bool bindTables() {
+        const TableInfo* info = tables.record<TableInfo>(LL1_INFO);
+        if (!info || !tables.get(LL1_SYMBOLS, names) || !tables.get(LL1_TABLE, table)) return false;
+        endMarker = info->endMarker;
+        unknownSymbol = info->unknownSymbol;
+        firstNonTerminal = info->firstNonTerminal;
+        firstUndefined = info->firstUndefined;
+        startId = info->startId;
+        columnCount = info->columns;
+        lhsIds = tables.array<SymbolId>(LL1_LHS);
+        rhsIds = tables.array<SymbolId>(LL1_RHS);
+        rhsStart = tables.array<uint32_t>(LL1_RHS_BEGIN);
+
+        size_t n = productions.size();
+        if (info->productions != n || lhsIds.size != n || rhsStart.size != n + 1) return false;
+        if (!(endMarker < unknownSymbol && unknownSymbol < columnCount && columnCount == firstNonTerminal &&
+              firstNonTerminal <= startId && startId < firstUndefined && firstUndefined <= names.size()))
             return false;
+        if (table.rows != size_t(firstUndefined - firstNonTerminal) || table.columns != columnCount) return false;
+        if (rhsStart[0] != 0 || rhsStart[n] != rhsIds.size) return false;
+        for (size_t p = 0; p < n; ++p)
+            if (rhsStart[p] > rhsStart[p + 1] || lhsIds[p] < firstNonTerminal || lhsIds[p] >= firstUndefined)
+                return false;
+        for (SymbolId x : rhsIds)
+            if (x >= names.size()) return false;
+        for (int32_t p : table.value)
+            if (p >= int32_t(n) || p < -1) return false;
+        return table.empty == -1;
+    }
+
+    void internGrammar() {
+        unordered_map<Symbol, SymbolId> ids;
+        auto intern = [&](const Symbol& name) {
+            auto it = ids.find(name);
+            if (it != ids.end()) return it->second;
+            if (symbolNames.size() >= UINT16_MAX) throw length_error("grammar has too many symbols");
+            symbolNames.push_back(name);
+            return ids[name] = SymbolId(symbolNames.size() - 1);
+        };
+        for (const Symbol& t : terminals)
+            if (!nonTerminals.count(t)) intern(t);
+        endMarker = intern("$");
+        unknownSymbol = SymbolId(symbolNames.size());
+        symbolNames.push_back("?");
+        columnCount = symbolNames.size();
+        firstNonTerminal = SymbolId(symbolNames.size());
+        for (const Symbol& nt : nonTerminals) intern(nt);
+        firstUndefined = SymbolId(symbolNames.size());
+        startId = ids[productions[0].lhs];
+
+        if (productions.size() > INT16_MAX) throw length_error("grammar has too many productions");
+        for (const auto& prod : productions) {
+            lhsCode.push_back(ids[prod.lhs]);
+            rhsBegin.push_back(uint32_t(rhsCode.size()));
+            for (auto s = prod.rhs.rbegin(); s != prod.rhs.rend(); ++s)
+                if (*s != "epsilon") rhsCode.push_back(intern(*s));
         }
+        rhsBegin.push_back(uint32_t(rhsCode.size()));
+        parsingTable.assign(nonTerminals.size() * columnCount, -1);
     }
-    return false;
-}
 
+    // A nullable symbol derives the empty string. A production becomes
+    // nullable once every symbol on its right-hand side is, so each
+    // production counts down its not-yet-nullable symbols and every newly
+    // nullable symbol is put on a worklist to update the productions it
+    // occurs in.
+    void computeNullable() {
+        size_t n = symbolNames.size() - firstNonTerminal;
+        nullable.assign(n, false);
+        vector<vector<uint32_t>> occurrences(n);
+        vector<uint32_t> remaining(productions.size());
+        vector<SymbolId> work;
+        for (size_t p = 0; p < productions.size(); ++p) {
+            remaining[p] = rhsBegin[p + 1] - rhsBegin[p];
+            for (uint32_t i = rhsBegin[p]; i < rhsBegin[p + 1]; ++i)
+                if (rhsCode[i] >= firstNonTerminal) occurrences[rhsCode[i] - firstNonTerminal].push_back(uint32_t(p));
+            SymbolId lhs = lhsOf(p);
+            if (remaining[p] == 0 && !nullable[lhs - firstNonTerminal]) {
+                nullable[lhs - firstNonTerminal] = true;
+                work.push_back(lhs);
+            }
+        }
+        while (!work.empty()) {
+            SymbolId x = work.back();
+            work.pop_back();
+            for (uint32_t p : occurrences[x - firstNonTerminal]) {
+                SymbolId lhs = lhsOf(p);
+                if (--remaining[p] == 0 && !nullable[lhs - firstNonTerminal]) {
+                    nullable[lhs - firstNonTerminal] = true;
+                    work.push_back(lhs);
+                }
+            }
+        }
+    }
 
-int main() {
-    int n;
-    cout << "Enter number of productions: ";
-    cin >> n; cin.ignore();
-    cout << "Enter productions (e.g., E->T E', E'->+ T E', E'->epsilon, T->( E )):\n";
+    // FIRST(A) is the terminals that can start a right-hand side of A, plus
+    // FIRST(B) for every B that can, after a nullable prefix.
+    void computeFIRST() {
+        size_t n = symbolNames.size() - firstNonTerminal;
+        FIRST.assign(n, TerminalSet(columnCount));
+        vector<vector<uint32_t>> deps(n);
+        for (size_t p = 0; p < productions.size(); ++p) {
+            uint32_t lhs = lhsOf(p) - firstNonTerminal;
+            for (uint32_t i = rhsBegin[p + 1]; i-- > rhsBegin[p];) {
+                SymbolId x = rhsCode[i];
+                if (x < firstNonTerminal) {
+                    FIRST[lhs].insert(x);
+                    break;
+                }
+                deps[lhs].push_back(x - firstNonTerminal);
+                if (!nullable[x - firstNonTerminal]) break;
+            }
+        }
+        closeOverDependencies(deps, FIRST);
+    }
+
+    // FOLLOW(B) gets FIRST of whatever comes after B on a right-hand side, and
+    // FOLLOW(A) too when that is nullable and the production is A's. Each
+    // right-hand side is walked from the end, carrying FIRST of its suffix.
+    void computeFOLLOW() {
+        size_t n = symbolNames.size() - firstNonTerminal;
+        FOLLOW.assign(n, TerminalSet(columnCount));
+        FOLLOW[startId - firstNonTerminal].insert(endMarker);
+        vector<vector<uint32_t>> deps(n);
+        for (size_t p = 0; p < productions.size(); ++p) {
+            uint32_t lhs = lhsOf(p) - firstNonTerminal;
+            TerminalSet trailer(columnCount);
+            bool suffixNullable = true;
+            for (uint32_t i = rhsBegin[p]; i < rhsBegin[p + 1]; ++i) {    // reversed: last symbol first
+                SymbolId x = rhsCode[i];
+                if (x < firstNonTerminal) {
+                    trailer = TerminalSet(columnCount);
+                    trailer.insert(x);
+                    suffixNullable = false;
+                    continue;
+                }
+                uint32_t b = x - firstNonTerminal;
+                FOLLOW[b] |= trailer;
+                if (suffixNullable) deps[b].push_back(lhs);
+                if (nullable[b]) {
+                    trailer |= FIRST[b];
+                } else {
+                    trailer = FIRST[b];
+                    suffixNullable = false;
+                }
+            }
+        }
+        closeOverDependencies(deps, FOLLOW);
+    }
+
+    void buildParsingTable() {
+        for (size_t p = 0; p < productions.size(); ++p) {
+            SymbolId lhs = lhsOf(p);
+            auto setEntry = [&](SymbolId t) { tableEntry(lhs, t) = int16_t(p); };
+            bool epsilonAll = true;
+            for (uint32_t i = rhsBegin[p + 1]; i-- > rhsBegin[p];) {
+                SymbolId x = rhsCode[i];
+                if (x < firstNonTerminal) {
+                    setEntry(x);
+                    epsilonAll = false;
+                    break;
+                }
+                FIRST[x - firstNonTerminal].forEach(setEntry);
+                if (!nullable[x - firstNonTerminal]) {
+                    epsilonAll = false;
+                    break;
+                }
+            }
+            if (epsilonAll) FOLLOW[lhs - firstNonTerminal].forEach(setEntry);
+        }
+    }
+
+    // The names in a set, in the order set<Symbol> keeps them.
+    set<Symbol> namesOf(const TerminalSet& ts, bool withEpsilon) const {
+        set<Symbol> names;
+        ts.forEach([&](SymbolId t) { names.insert(symbolNames[t]); });
+        if (withEpsilon) names.insert("epsilon");
+        return names;
+    }
+};
+
+// Productions as typed at the prompt, one per line: "E->T E'".
+vector<Production> readProductions(istream& in, int n) {
+    vector<Production> productions;
     for (int i = 0; i < n; ++i) {
-        string prod; getline(cin, prod);
+        string prod; getline(in, prod);
         size_t delim = prod.find("->");
         Symbol lhs = prod.substr(0, delim);
         Symbol rhs = prod.substr(delim+2);
-        vector<Symbol> rhsTokens = tokenizeWithParentheses(rhs);
-        productions.push_back({lhs, rhsTokens});
-        nonTerminals.insert(lhs);
-        for (const auto& tok : rhsTokens) {
-            if (!(isupper(tok[0]) && tok != "epsilon")) {
-                if (tok != "epsilon")
-                    terminals.insert(tok);
+        productions.push_back({lhs, tokenizeWithParentheses(rhs)});
+    }
+    return productions;
+}
+
+// Parses every line of `in` against one grammar on a work-stealing pool,
+// in chunks of lines so a task is worth handing out. Each worker keeps its
+// own token and stack vectors. Prints, in input order, "accept" or
+// "reject N", N being the column where the first token the parser could
+// not take starts (one past the end of the line if it ran out of input).
+int runBatch(const LL1Grammar& grammar, istream& in, unsigned jobs, bool cTokens) {
+    vector<string> lines;
+    for (string line; getline(in, line); ) lines.push_back(move(line));
+
+    const size_t chunk = 1024;
+    struct alignas(64) WorkerState {
+        vector<SymbolId> input, stack;
+        vector<uint32_t> columns;
+    };
+    vector<uint32_t> rejectedAt(lines.size());      // 0 if accepted
+    vector<WorkerState> perWorker(jobs);
+
+    runWorkStealing((lines.size() + chunk - 1) / chunk, jobs, [&](size_t c, unsigned worker) {
+        WorkerState& w = perWorker[worker];
+        for (size_t i = c * chunk; i < min(lines.size(), (c + 1) * chunk); ++i) {
+            const string& line = lines[i];
+            w.input.clear();
+            w.columns.clear();
+            auto add = [&](string_view text, size_t column) {
+                w.input.push_back(grammar.idOf(text));
+                w.columns.push_back(uint32_t(column));
+            };
+            if (cTokens) {
+                Lexer<> lex(line.data(), line.data(), line.data() + line.size(), line.data() + line.size());
+                for (const LexToken& t : lex) add(t.text, t.column);
+            } else {
+                forEachSymbol(line, add);
             }
+            w.input.push_back(grammar.endOfInput());
+            w.columns.push_back(uint32_t(line.size() + 1));
+
+            NoTrace quiet;
+            ParseResult r = grammar.parse(w.input, w.stack, quiet);
+            rejectedAt[i] = r.accepted ? 0 : w.columns[r.position];
         }
+    });
+
+    string out;
+    for (uint32_t col : rejectedAt) {
+        if (col) out += "reject " + to_string(col) + "\n";
+        else out += "accept\n";
+        if (out.size() >= (1 << 16)) { cout << out; out.clear(); }
+    }
+    cout << out << flush;
+    return 0;
+}
+// The grammar with the tables in `tableFile` if it holds them for these
+// productions; otherwise analysed, and the tables saved there for next time.
+unique_ptr<const LL1Grammar> loadGrammar(vector<Production> prods, const string& tableFile) {
+    if (tableFile.empty()) return make_unique<const LL1Grammar>(move(prods));
+    if (unique_ptr<const LL1Grammar> grammar = LL1Grammar::load(prods, tableFile)) return grammar;
+    if (ifstream(tableFile)) cerr << "Parse tables in '" << tableFile << "' are stale or damaged; rebuilding\n";
+    auto grammar = make_unique<const LL1Grammar>(move(prods));
+    if (!grammar->save(tableFile)) cerr << "Cannot write parse tables to '" << tableFile << "'\n";
+    return grammar;
+}
+
+int main(int argc, char* argv[]) {
+    // Usage: ./a.out [--no-trace] [--c-tokens] [--tables=TABLES]
+    //        (--no-trace prints only each result)
+    //        ./a.out --batch --grammar=FILE [--jobs=N] [--c-tokens] [--tables=TABLES] [inputs]
+    //        (FILE holds what the prompts ask for: the count, then the
+    //        productions; inputs are read from stdin if no file is given)
+    //        --tables=TABLES loads the parse tables from TABLES instead of
+    //        analysing the grammar, if it was saved for the same productions,
+    //        and otherwise analyses it and saves them there.
+    //        --c-tokens splits strings to parse with the C lexer (see lexInput)
+    //        instead of on whitespace and brackets.
+    bool trace = true, batch = false, cTokens = false;
+    string grammarFile, inputFile, tableFile;
+    unsigned jobs = max(1u, thread::hardware_concurrency());
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--no-trace") trace = false;
+        else if (arg == "--batch") batch = true;
+        else if (arg == "--c-tokens") cTokens = true;
+        else if (arg.rfind("--grammar=", 0) == 0) grammarFile = arg.substr(10);
+        else if (arg.rfind("--jobs=", 0) == 0) {
+            const char* first = arg.data() + 7;
+            const char* last = arg.data() + arg.size();
+            from_chars_result r = from_chars(first, last, jobs);
+            if (r.ec != errc() || r.ptr != last || r.ptr == first || jobs == 0) {
+                cerr << "Bad --jobs value '" << arg.substr(7) << "': expected a positive number\n";
+                return 1;
+            }
+            jobs = min(jobs, maxJobs);
+        }
+        else if (arg.rfind("--tables=", 0) == 0) tableFile = arg.substr(9);
+        else inputFile = arg;
+    }
+
+    if (batch) {
+        ifstream grammarIn(grammarFile);
+        if (!grammarIn) {
+            cerr << "Error opening grammar file '" << grammarFile << "'\n";
+            return 1;
+        }
+        int n;
+        grammarIn >> n; grammarIn.ignore();
+        unique_ptr<const LL1Grammar> grammar = loadGrammar(readProductions(grammarIn, n), tableFile);
+        if (inputFile.empty() || inputFile == "-") return runBatch(*grammar, cin, jobs, cTokens);
+        ifstream inputs(inputFile);
+        if (!inputs) {
+            cerr << "Error opening input file '" << inputFile << "'\n";
+            return 1;
+        }
+        return runBatch(*grammar, inputs, jobs, cTokens);
     }
-    startSymbol = productions[0].lhs;
-    for (const auto& nt : nonTerminals) computeFIRST(nt);
-    for (const auto& nt : nonTerminals) computeFOLLOW(nt);
-    displayFirstFollowCombined();
-    buildParsingTable();
-    displayParsingTable();
 
+    int n;
+    cout << "Enter number of productions: ";
+    cin >> n; cin.ignore();
+    cout << "Enter productions (e.g., E->T E', E'->+ T E', E'->epsilon, T->( E )):\n";
+    unique_ptr<const LL1Grammar> grammar = loadGrammar(readProductions(cin, n), tableFile);
+    if (grammar->analysed()) grammar->displayFirstFollowCombined();
+    else cout << "\nParse tables loaded from " << tableFile << " (FIRST and FOLLOW sets are not kept there).\n";
+    grammar->displayParsingTable();
+
+    vector<SymbolId> stack;
     while (true) {
         cout << "\nEnter string to parse (tokens separated by space, enter 0 to exit): ";
         string input; 
         getline(cin, input);
         if (input == "0") break;
 
-        vector<Symbol> tokens = tokenizeWithParentheses(input);
-        tokens.push_back("$");
-        bool accepted = parseString(tokens);
+        vector<Symbol> tokens = cTokens ? lexInput(input) : tokenizeWithParentheses(input);
+        vector<SymbolId> ids = grammar->symbolIdsOf(tokens);
+        bool accepted;
+        if (trace) {
+            Trace<SymbolId> steps;
+            accepted = grammar->parse(ids, stack, steps).accepted;
+            grammar->printTrace(steps, tokens);
+        } else {
+            NoTrace quiet;
+            accepted = grammar->parse(ids, stack, quiet).accepted;
+        }
 
         if (accepted)
             cout << "\nResult: The string IS accepted by the grammar.\n";
@@ -287,4 +791,3 @@ int main() {
     cout << "Parser terminated. Goodbye!\n";
     return 0;
 }
-
@@ -1,11 +1,11 @@
 #include <iostream>
-#include <stack>
 #include <string>
 #include <vector>
 #include <sstream>
 #include <algorithm>
 #include <iomanip>
 #include <cctype>
+#include "parse_trace.h"
 using namespace std;
 
 struct Production {
@@ -33,12 +33,9 @@ vector<string> tokenize(const string &str) {
     return tokens;
 }
 
-string stackToString(stack<string> stk) {
-    vector<string> elems;
-    while (!stk.empty()) { elems.push_back(stk.top()); stk.pop(); }
-    reverse(elems.begin(), elems.end());
+string stackToString(const vector<string> &stk) {
     string out;
-    for (auto &e : elems) out += e + " ";
+    for (auto &e : stk) out += e + " ";
     if (!out.empty()) out.pop_back();
     return out;
 }
@@ -50,24 +47,14 @@ string inputBufferToString(const vector<string> &tokens, int ip) {
     return out;
 }
 
-bool matchProduction(stack<string> &stk, const Production &prod) {
-    int n = prod.rhs.size();
-    if ((int)stk.size() < n) return false;
-    vector<string> topElems(n);
-    stack<string> temp = stk;
-    for (int i = n - 1; i >= 0; --i) {
-        topElems[i] = temp.top();
-        temp.pop();
-    }
-    for (int i = 0; i < n; ++i)
-        if (topElems[i] != prod.rhs[i]) return false;
-    return true;
+bool matchProduction(const vector<string> &stk, const Production &prod) {
+    size_t n = prod.rhs.size();
+    return stk.size() >= n && equal(prod.rhs.begin(), prod.rhs.end(), stk.end() - n);
 }
 
-void doReduce(stack<string> &stk, const Production &prod) {
-    int n = prod.rhs.size();
-    for (int i = 0; i < n; ++i) stk.pop();
-    stk.push(prod.lhs);
+void doReduce(vector<string> &stk, const Production &prod) {
+    stk.resize(stk.size() - prod.rhs.size());
+    stk.push_back(prod.lhs);
 }
 
 bool shouldReduce(const Production &prod, const string &lookahead) {
@@ -80,7 +67,101 @@ bool shouldReduce(const Production &prod, const string &lookahead) {
     return true;
 }
 
-int main() {
+// Shift-reduce over the tokens, which end in "$". Reductions are tried in
+// production order, again and again until none applies, before each shift.
+template <class Tracer>
+bool parse(const vector<Production> &productions, const vector<string> &tokens, Tracer &trace) {
+    vector<string> stk;
+    stk.push_back("$");
+    size_t ip = 0;
+
+    while (true) {
+        // Accept
+        if (stk.size() == 2 && stk.back() == "E" && tokens[ip] == "$") {
+            trace.step(TraceAction::Accept, 0, stk.size(), ip);
+            trace.finish(stk);
+            return true;
+        }
+
+        // Try reductions repeatedly until no match
+        bool reduced = false;
+        while (true) {
+            bool didReduce = false;
+            for (size_t k = 0; k < productions.size(); ++k) {
+                const Production &prod = productions[k];
+                if (matchProduction(stk, prod) && shouldReduce(prod, tokens[ip])) {
+                    trace.step(TraceAction::Reduce, k, stk.size(), ip);
+                    doReduce(stk, prod);
+                    didReduce = true;
+                }
+            }
+            if (!didReduce) break;
+            reduced = true;
+        }
+
+        if (reduced) continue;
+
+        // Shift
+        if (tokens[ip] != "$") {
+            trace.step(TraceAction::Shift, 0, stk.size(), ip);
+            stk.push_back(tokens[ip]);
+            ++ip;
+        } else {
+            trace.step(TraceAction::Error, 0, stk.size(), ip);
+            trace.finish(stk);
+            return false;
+        }
+    }
+}
+
+// The step listing. The stack before the oldest kept step comes from
+// undoing the kept steps, last first, on the final stack.
+void printTrace(const Trace<string> &trace, const vector<Production> &productions, const vector<string> &tokens) {
+    vector<string> stk = trace.finalStack();
+    for (size_t k = trace.size(); k-- > 0;) {
+        const TraceStep &step = trace[k];
+        if (step.action == TraceAction::Shift) {
+            stk.pop_back();
+        } else if (step.action == TraceAction::Reduce) {
+            const Production &prod = productions[step.production];
+            stk.pop_back();
+            stk.insert(stk.end(), prod.rhs.begin(), prod.rhs.end());
+        }
+    }
+
+    cout << left << setw(25) << "Stack" << setw(25) << "Input Buffer" << "Action\n";
+    cout << string(65, '-') << "\n";
+    if (trace.dropped()) cout << "(" << trace.dropped() << " earlier steps not kept)\n";
+    for (size_t k = 0; k < trace.size(); ++k) {
+        const TraceStep &step = trace[k];
+        string actionStr;
+        switch (step.action) {
+        case TraceAction::Accept:
+            actionStr = "Accept";
+            break;
+        case TraceAction::Reduce: {
+            const Production &prod = productions[step.production];
+            actionStr = "Reduce by: " + prod.lhs + " ->";
+            for (auto &s : prod.rhs) actionStr += " " + s;
+            break;
+        }
+        case TraceAction::Shift:
+            actionStr = "Shift " + tokens[step.input];
+            break;
+        default:
+            actionStr = "Error: Unable to parse";
+            break;
+        }
+        cout << left << setw(25) << stackToString(stk) << setw(25) << inputBufferToString(tokens, step.input)
+             << actionStr << "\n";
+        if (step.action == TraceAction::Reduce) doReduce(stk, productions[step.production]);
+        else if (step.action == TraceAction::Shift) stk.push_back(tokens[step.input]);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    // Usage: ./a.out [--no-trace]   (--no-trace prints only failures)
+    bool trace = !(argc > 1 && string(argv[1]) == "--no-trace");
     vector<Production> productions;
     int n;
 
@@ -119,59 +200,14 @@ int main() {
         vector<string> tokens = tokenize(raw);
         tokens.push_back("$");
 
-        stack<string> stk;
-        stk.push("$");
-        int ip = 0;
-
-        cout << left << setw(25) << "Stack" << setw(25) << "Input Buffer" << "Action\n";
-        cout << string(65, '-') << "\n";
-
-        bool accepted = false;
-
-        while (true) {
-            string stackStr = stackToString(stk);
-            string inputBufStr = inputBufferToString(tokens, ip);
-            string actionStr;
-
-            // Accept
-            if (stk.size() == 2 && stk.top() == "E" && tokens[ip] == "$") {
-                actionStr = "Accept";
-                cout << left << setw(25) << stackStr << setw(25) << inputBufStr << actionStr << "\n";
-                accepted = true;
-                break;
-            }
-
-            // Try reductions repeatedly until no match
-            bool reduced = false;
-            while (true) {
-                bool didReduce = false;
-                for (auto &prod : productions) {
-                    if (matchProduction(stk, prod) && shouldReduce(prod, tokens[ip])) {
-                        actionStr = "Reduce by: " + prod.lhs + " ->";
-                        for (auto &s : prod.rhs) actionStr += " " + s;
-                        cout << left << setw(25) << stackStr << setw(25) << inputBufStr << actionStr << "\n";
-                        doReduce(stk, prod);
-                        didReduce = true;
-                        stackStr = stackToString(stk); // update for next log
-                    }
-                }
-                if (!didReduce) break;
-                reduced = true;
-            }
-
-            if (reduced) continue;
-
-            // Shift
-            if (tokens[ip] != "$") {
-                actionStr = "Shift " + tokens[ip];
-                cout << left << setw(25) << stackStr << setw(25) << inputBufStr << actionStr << "\n";
-                stk.push(tokens[ip]);
-                ++ip;
-            } else {
-                actionStr = "Error: Unable to parse";
-                cout << left << setw(25) << stackStr << setw(25) << inputBufStr << actionStr << "\n";
-                break;
-            }
+        bool accepted;
+        if (trace) {
+            Trace<string> steps;
+            accepted = parse(productions, tokens, steps);
+            printTrace(steps, productions, tokens);
+        } else {
+            NoTrace quiet;
+            accepted = parse(productions, tokens, quiet);
         }
 
         if (!accepted) cout << "Parsing failed.\n";
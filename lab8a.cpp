@@ -1,8 +1,11 @@
 #include <iostream>
+#include <fstream>
 #include <vector>
 #include <string>
 #include <cstring>
 #include <cstdlib>
+#include <stdexcept>
+#include "parse_tables.h"
 using namespace std;
 
 #define MAX 100
@@ -39,6 +42,18 @@ vector<char> non_terminals;
 string action[STATES][SYMBOLS];
 int goto_table[STATES][SYMBOLS];
 
+// What parsing reads: action and goto_table packed (see parse_tables.h),
+// built from them or loaded from a table file. The symbols are the
+// terminals, then the non-terminals; goto_codes columns are non-terminal
+// indices, -1 where there is no entry. The DFA listing is kept with them
+// as (from, symbol, to) triples in the order build_states() finds them.
+enum { T_SYMBOLS = 1, T_ACTION = 4, T_GOTO = 8, T_DFA = 12 };
+TableImage tables;
+SymbolIndex symbols;
+PackedTable action_codes, goto_codes;
+vector<int32_t> transitions;
+CacheArray<int32_t> dfa;
+
 bool item_exists(State &state, Item item) {
     for (auto &it : state.items) {
         if (it.lhs == item.lhs && it.rhs == item.rhs && it.dot_position == item.dot_position) {
@@ -146,7 +161,7 @@ void build_states() {
     add_item(s0, start_item);
     closure(s0);
     states.push_back(s0);
-    cout << "\nDFA of Item Sets (Transitions):\n";
+    transitions.clear();
 
     for (int front = 0; front < states.size(); front++) {
         State curr = states[front];
@@ -167,10 +182,7 @@ void build_states() {
                 idx = states.size();
                 states.push_back(new_state);
             }
-            if (sym == 'Q')
-                cout << "I" << front << " --S'--> I" << idx << "\n";
-            else
-                cout << "I" << front << " --" << sym << "--> I" << idx << "\n";
+            transitions.insert(transitions.end(), { front, sym, idx });
 
             if (symbol_index(sym, terminals) != -1) {
                 int t_idx = symbol_index(sym, terminals);
@@ -216,6 +228,79 @@ void build_parsing_table() {
     }
 }
 
+// Tables are only good for the grammar they were built from.
+CacheKey table_key() {
+    string text;
+    for (auto &prod : grammar) text += string(1, prod.lhs) + "->" + prod.rhs + "\n";
+    text += string(terminals.begin(), terminals.end()) + "|" + string(non_terminals.begin(), non_terminals.end());
+    return makeCacheKey(text, "lab8a/lr0-tables/2");
+}
+
+void pack_tables() {
+    vector<string> names;
+    for (char t : terminals) names.push_back(string(1, t));
+    for (char nt : non_terminals) names.push_back(string(1, nt));
+    size_t n = states.size(), n_terms = terminals.size(), n_nonterms = non_terminals.size();
+
+    vector<int32_t> act(n * n_terms, 0), go(n * n_nonterms, -1);
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = 0; j < n_terms; j++) {
+            string &a = action[i][j];
+            if (a == "acc") act[i * n_terms + j] = lrAction(LR_ACCEPT);
+            else if (a[0] == 's') act[i * n_terms + j] = lrAction(LR_SHIFT, stoi(a.substr(1)));
+            else if (a[0] == 'r') act[i * n_terms + j] = lrAction(LR_REDUCE, stoi(a.substr(1)));
+        }
+        for (size_t j = 0; j < n_nonterms; j++) go[i * n_nonterms + j] = goto_table[i][j];
+    }
+
+    CacheWriter w;
+    addSymbolIndex(w, T_SYMBOLS, names);
+    addPackedTable(w, T_ACTION, act, uint32_t(n), uint32_t(n_terms), 0);
+    addPackedTable(w, T_GOTO, go, uint32_t(n), uint32_t(n_nonterms), -1);
+    w.add(T_DFA, transitions);
+    tables = TableImage(w, table_key());
+}
+
+// Points the views at `tables`, checking every state and production in
+// them once so that parse_input() can trust them.
+bool bind_tables() {
+    if (!tables.get(T_SYMBOLS, symbols) || !tables.get(T_ACTION, action_codes) || !tables.get(T_GOTO, goto_codes))
+        return false;
+    uint32_t n = action_codes.rows;
+    if (n == 0 || goto_codes.rows != n || action_codes.columns != terminals.size() ||
+        goto_codes.columns != non_terminals.size() || symbols.size() != terminals.size() + non_terminals.size())
+        return false;
+    for (int32_t a : action_codes.value) {
+        if (lrKind(a) == LR_SHIFT && uint32_t(lrTarget(a)) >= n) return false;
+        if (lrKind(a) == LR_REDUCE && size_t(lrTarget(a)) >= grammar.size()) return false;
+    }
+    for (int32_t g : goto_codes.value) {
+        if (g < -1 || g >= int32_t(n)) return false;
+    }
+    dfa = tables.array<int32_t>(T_DFA);
+    if (dfa.size == 0 || dfa.size % 3 != 0) return false;
+    return action_codes.empty == 0 && goto_codes.empty == -1;
+}
+
+void print_dfa() {
+    cout << "\nDFA of Item Sets (Transitions):\n";
+    for (size_t i = 0; i < dfa.size; i += 3) {
+        if (dfa[i + 1] == 'Q')
+            cout << "I" << dfa[i] << " --S'--> I" << dfa[i + 2] << "\n";
+        else
+            cout << "I" << dfa[i] << " --" << char(dfa[i + 1]) << "--> I" << dfa[i + 2] << "\n";
+    }
+}
+
+string action_text(int32_t act) {
+    switch (lrKind(act)) {
+    case LR_SHIFT: return "s" + to_string(lrTarget(act));
+    case LR_REDUCE: return "r" + to_string(lrTarget(act));
+    case LR_ACCEPT: return "acc";
+    default: return "error";
+    }
+}
+
 void print_parsing_table() {
     cout << "\nACTION and GOTO Table:\n";
     cout << "State\t";
@@ -223,14 +308,14 @@ void print_parsing_table() {
     for (auto nt : non_terminals) cout << nt << "\t";
     cout << "\n";
 
-    for (int i = 0; i < states.size(); i++) {
+    for (uint32_t i = 0; i < action_codes.rows; i++) {
         cout << i << "\t";
         for (int j = 0; j < terminals.size(); j++) {
-            cout << action[i][j] << "\t";
+            cout << action_text(action_codes(i, j)) << "\t";
         }
         for (int j = 0; j < non_terminals.size(); j++) {
-            if (goto_table[i][j] != -1)
-                cout << goto_table[i][j] << "\t";
+            if (goto_codes(i, j) != -1)
+                cout << goto_codes(i, j) << "\t";
             else
                 cout << "-\t";
         }
@@ -250,28 +335,29 @@ void parse_input(string input_str) {
     while (true) {
         int state = state_stack.top();
         char lookahead = input_str[ip];
-        int term_idx = symbol_index(lookahead, terminals);
+        int64_t term_idx = symbols.find(string_view(&lookahead, 1));
+        int32_t act = term_idx >= 0 && size_t(term_idx) < terminals.size() ? action_codes(state, term_idx) : 0;
 
         cout << "[";
         for (int i = 0; i < state_stack.items.size(); i++) cout << state_stack.items[i] << " ";
         cout << "]\t\t" << input_str.substr(ip) << "\t\t";
 
-        if (term_idx == -1 || action[state][term_idx] == "error") {
+        if (lrKind(act) == LR_ERROR) {
             cout << "Error\n";
             break;
         }
-        if (action[state][term_idx] == "acc") {
+        if (lrKind(act) == LR_ACCEPT) {
             cout << "Accept\n";
             break;
         }
-        if (action[state][term_idx][0] == 's') {
-            int next_state = stoi(action[state][term_idx].substr(1));
+        if (lrKind(act) == LR_SHIFT) {
+            int next_state = lrTarget(act);
             cout << "Shift " << lookahead << "\n";
             state_stack.push(next_state);
             symbol_stack.push(lookahead);
             ip++;
-        } else if (action[state][term_idx][0] == 'r') {
-            int prod_idx = stoi(action[state][term_idx].substr(1));
+        } else if (lrKind(act) == LR_REDUCE) {
+            int prod_idx = lrTarget(act);
             Production p = grammar[prod_idx];
             cout << "Reduce by " << p.lhs << " -> " << p.rhs << "\n";
             int rhs_len = p.rhs.size();
@@ -280,14 +366,22 @@ void parse_input(string input_str) {
                 symbol_stack.pop();
             }
             state = state_stack.top();
-            int nt_idx = symbol_index(p.lhs, non_terminals);
+            int nt_idx = symbols.find(string_view(&p.lhs, 1)) - terminals.size();
             symbol_stack.push(p.lhs);
-            state_stack.push(goto_table[state][nt_idx]);
+            state_stack.push(goto_codes(state, nt_idx));
         }
     }
 }
 
-int main() {
+int main(int argc, char *argv[]) {
+    // Usage: ./a.out [--tables=FILE]
+    // --tables=FILE loads the parse tables from FILE if it holds them for
+    // this grammar, and otherwise builds them and saves them there.
+    string table_file;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg.rfind("--tables=", 0) == 0) table_file = arg.substr(9);
+    }
   
     grammar.push_back({ 'S', "CC" });
     grammar.push_back({ 'C', "cC" });
@@ -300,11 +394,25 @@ int main() {
     non_terminals = { 'S', 'C', 'Q' };
 
 
-    build_parsing_table();
+    bool loaded = !table_file.empty() && tables.load(table_file, table_key()) && bind_tables();
+    if (!loaded) {
+        if (!table_file.empty() && ifstream(table_file))
+            cerr << "Parse tables in '" << table_file << "' are stale or damaged; rebuilding\n";
+        build_parsing_table();
+        pack_tables();
+        if (!bind_tables()) throw logic_error("parse tables do not match the grammar");
+        if (!table_file.empty() && !tables.save(table_file))
+            cerr << "Cannot write parse tables to '" << table_file << "'\n";
+    }
 
-    cout << "\nCanonical Collection of LR(0) Items:\n";
-    for (int i = 0; i < states.size(); i++) {
-        print_state(i);
+    print_dfa();
+    if (loaded) {
+        cout << "\nParse tables loaded from " << table_file << " (the LR(0) items are not kept there).\n";
+    } else {
+        cout << "\nCanonical Collection of LR(0) Items:\n";
+        for (int i = 0; i < states.size(); i++) {
+            print_state(i);
+        }
     }
 
     print_parsing_table();
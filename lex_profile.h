@@ -0,0 +1,219 @@
+#ifndef LEX_PROFILE_H
+#define LEX_PROFILE_H
+
+// Opt-in instrumentation for the lexers: time, count and bytes per phase,
+// plus process-wide hardware counters, written out as JSON.
+//
+//     Lexer<CKeywords, COperators, LexProfile> lex(in);   // or NoProfile
+//     PerfCounters perf;
+//     perf.start();
+//     ... lex ...
+//     perf.stop();
+//     writeProfileJson(cout, "lexical_analyser", lex.profile(), perf);
+//
+// A lexer takes the profile as a template parameter and calls begin() with
+// the offset where a token (or a run of whitespace, or a comment) starts
+// and end() with its phase and the offset where it ends. NoProfile's hooks
+// are empty inline functions, so the default instantiation compiles to the
+// same code as before; the cost of LexProfile -- two clock reads per token
+// -- is only paid by a build that asks for it.
+//
+// PerfCounters uses perf_event_open on Linux. Each counter is opened on
+// its own and left out of the report if the kernel refuses it (no PMU in a
+// VM, perf_event_paranoid); the reason is reported instead.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <string_view>
+#ifdef __linux__
+#include <cerrno>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+enum class LexPhase : uint8_t {
+    Whitespace, Comment, Literal, Keyword, Identifier, Number, Operator, Special, Error
+};
+const int lexPhaseCount = (int)LexPhase::Error + 1;
+
+inline const char* const lexPhaseNames[] = {
+    "whitespace", "comment", "literal", "keyword", "identifier", "number", "operator", "special", "error"
+};
+
+struct NoProfile {
+    void begin(uint64_t) {}
+    void end(LexPhase, uint64_t) {}
+};
+
+class LexProfile {
+public:
+    struct Phase {
+        uint64_t ns = 0;
+        uint64_t count = 0;
+        uint64_t bytes = 0;
+    };
+
+    void begin(uint64_t offset) {
+        startOffset = offset;
+        started = std::chrono::steady_clock::now();
+    }
+
+    void end(LexPhase phase, uint64_t offset) {
+        auto now = std::chrono::steady_clock::now();
+        uint64_t length = offset - startOffset;
+        Phase& p = phases[(int)phase];
+        p.ns += uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(now - started).count());
+        p.count++;
+        p.bytes += length;
+        if (phase != LexPhase::Whitespace && phase != LexPhase::Comment)
+            maxLength = std::max(maxLength, length);
+    }
+
+    const Phase& operator[](LexPhase phase) const { return phases[(int)phase]; }
+    uint64_t maxTokenLength() const { return maxLength; }
+
+    LexProfile& operator+=(const LexProfile& o) {
+        for (int i = 0; i < lexPhaseCount; i++) {
+            phases[i].ns += o.phases[i].ns;
+            phases[i].count += o.phases[i].count;
+            phases[i].bytes += o.phases[i].bytes;
+        }
+        maxLength = std::max(maxLength, o.maxLength);
+        return *this;
+    }
+
+private:
+    Phase phases[lexPhaseCount];
+    uint64_t maxLength = 0;
+    uint64_t startOffset = 0;
+    std::chrono::steady_clock::time_point started;
+};
+
+class PerfCounters {
+public:
+    struct Counter {
+        const char* name = nullptr;
+        int fd = -1;
+        uint64_t value = 0;
+        std::string error;          // why it could not be opened
+    };
+
+    static const int counterCount = 6;
+
+    PerfCounters() {
+        static const char* const names[counterCount] = {"cycles", "instructions", "branch_misses",
+                                                        "cache_misses", "task_clock_ns", "page_faults"};
+        for (int i = 0; i < counterCount; i++) counters[i].name = names[i];
+#ifdef __linux__
+        open(0, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+        open(1, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+        open(2, PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+        open(3, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+        open(4, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK);
+        open(5, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS);
+#else
+        for (Counter& c : counters) c.error = "perf_event_open needs Linux";
+#endif
+    }
+
+    ~PerfCounters() {
+#ifdef __linux__
+        for (Counter& c : counters)
+            if (c.fd >= 0) close(c.fd);
+#endif
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    void start() {
+#ifdef __linux__
+        for (Counter& c : counters)
+            if (c.fd >= 0) {
+                ioctl(c.fd, PERF_EVENT_IOC_RESET, 0);
+                ioctl(c.fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+#endif
+    }
+
+    void stop() {
+#ifdef __linux__
+        for (Counter& c : counters)
+            if (c.fd >= 0) {
+                ioctl(c.fd, PERF_EVENT_IOC_DISABLE, 0);
+                if (::read(c.fd, &c.value, sizeof c.value) != sizeof c.value) c.value = 0;
+            }
+#endif
+    }
+
+    const Counter* begin() const { return counters; }
+    const Counter* end() const { return counters + counterCount; }
+
+private:
+    Counter counters[counterCount];
+
+#ifdef __linux__
+    void open(int i, uint32_t type, uint64_t config) {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof attr);
+        attr.size = sizeof attr;
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        counters[i].fd = int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        if (counters[i].fd < 0) counters[i].error = strerror(errno);
+    }
+#endif
+};
+
+// One JSON object, on one line. In a whole-input run every byte is in
+// exactly one phase, so their bytes add up to the input size. Tokens are
+// everything but whitespace and comments; errors count as tokens, since
+// they consume input like one.
+inline void writeProfileJson(std::ostream& out, std::string_view tool, const LexProfile& prof,
+                             const PerfCounters& perf) {
+    uint64_t inputBytes = 0, tokens = 0, tokenBytes = 0, totalNs = 0;
+    for (int i = 0; i < lexPhaseCount; i++) {
+        const LexProfile::Phase& p = prof[LexPhase(i)];
+        inputBytes += p.bytes;
+        totalNs += p.ns;
+        if (LexPhase(i) != LexPhase::Whitespace && LexPhase(i) != LexPhase::Comment) {
+            tokens += p.count;
+            tokenBytes += p.bytes;
+        }
+    }
+
+    out << "{\"tool\":\"" << tool << "\",\"input_bytes\":" << inputBytes << ",\"tokens\":" << tokens
+        << ",\"bytes_per_token\":" << (tokens ? double(tokenBytes) / tokens : 0.0)
+        << ",\"max_token_length\":" << prof.maxTokenLength() << ",\"total_ns\":" << totalNs << ",\"phases\":{";
+    for (int i = 0; i < lexPhaseCount; i++) {
+        const LexProfile::Phase& p = prof[LexPhase(i)];
+        out << (i ? "," : "") << "\"" << lexPhaseNames[i] << "\":{\"ns\":" << p.ns << ",\"count\":" << p.count
+            << ",\"bytes\":" << p.bytes << "}";
+    }
+    out << "},\"perf\":{";
+    bool first = true;
+    for (const PerfCounters::Counter& c : perf) {
+        if (c.fd < 0) continue;
+        out << (first ? "" : ",") << "\"" << c.name << "\":" << c.value;
+        first = false;
+    }
+    out << (first ? "" : ",") << "\"unavailable\":{";
+    first = true;
+    for (const PerfCounters::Counter& c : perf) {
+        if (c.fd >= 0) continue;
+        out << (first ? "" : ",") << "\"" << c.name << "\":\"" << c.error << "\"";
+        first = false;
+    }
+    out << "}}}\n";
+}
+
+#endif
@@ -0,0 +1,559 @@
+#ifndef LEXER_H
+#define LEXER_H
+
+// Pull-based lexer for the C-like token language of lexical_analyser.cpp.
+//
+//     ifstream in("prog.c");
+//     Lexer<> lex(in);
+//     for (const LexToken& t : lex) ...
+//
+// Tokens come out one at a time from a bounded read buffer, so memory stays
+// flat however large the input is. A token's text is a view into that buffer
+// and is only valid until the next call to next(). Lexer objects share no
+// state, so several can run at once on different inputs.
+//
+// The scanning loops do not look for newlines. A token's line and column
+// are worked out when it is yielded, by counting the newlines since the
+// previous token in one vectorised pass (countNewlines in scan_kernels.h).
+//
+// Input is UTF-8 (utf8.h). Identifiers may use XID characters, and ≠ ≤ ≥ ∧ ∨
+// are operators. Comments and literals are checked with the validateUtf8
+// kernel; each invalid sequence in them comes out as an InvalidUtf8
+// diagnostic right after the literal or comment it is in.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "lex_profile.h"
+#include "numeric_literal.h"
+#include "scan_kernels.h"
+#include "source_buffer.h"
+#include "token_sets.h"
+#include "utf8.h"
+
+struct CKeywords {
+    static constexpr std::string_view words[] = {
+        "auto", "break", "case", "char", "const", "continue", "default", "do",
+        "double", "else", "enum", "float", "for", "goto", "if", "int", "long",
+        "register", "return", "short", "signed", "sizeof", "static", "struct",
+        "switch", "typedef", "union", "unsigned", "void", "volatile", "while"
+    };
+};
+
+struct COperators {
+    static constexpr std::string_view words[] = {
+        "+", "-", "*", "/", "%", "++", "--", "==", "!=", "<", "<=", ">", ">=",
+        "&&", "||", "!", "=", "+=", "-=", "*=", "/=", "%=", "&", "|", "^", "~", "<<", ">>"
+    };
+};
+
+// Error is not a token class; it marks a diagnostic in the token stream.
+enum class TokenKind : uint8_t { Keyword, Id, Num, Op, Special, Literal, Error };
+const int tokenKindCount = (int)TokenKind::Error;
+
+inline const char* const tokenTypeNames[] = {
+    "<keyword>", "<id>", "<num>", "<op>", "<special symbol>", "<literal>"
+};
+
+enum class LexErrorKind : uint8_t {
+    None, UnterminatedString, UnterminatedChar, InvalidToken, UnrecognizedSymbol, NumberOutOfRange, InvalidUtf8
+};
+
+struct LexToken {
+    TokenKind kind;
+    LexErrorKind error;
+    std::string_view text;
+    uint64_t offset;        // of text[0] from the start of the input
+    int line;
+    int column;             // in bytes, from 1
+    NumberValue number{};   // <num> tokens: the decoded literal
+};
+
+// The text a token prints as. Every token is a contiguous slice of the
+// input; the odd cases are a lone '"' at end of input, which the original
+// lexer printed as an empty literal, and the Unicode operators, which print
+// as their ASCII spelling.
+inline std::string_view tokenDisplayText(TokenKind kind, std::string_view text) {
+    if (kind == TokenKind::Literal && text.size() == 1) return "\"\"";
+    if (kind == TokenKind::Op && (unsigned char)text[0] >= 0x80) return asciiOperator(text);
+    return text;
+}
+
+inline std::string lexErrorMessage(LexErrorKind e, int line, int column, std::string_view text) {
+    std::string msg = "Error at line " + std::to_string(line) + ", column " + std::to_string(column);
+    switch (e) {
+    case LexErrorKind::UnterminatedString: return msg + ": Unterminated string literal";
+    case LexErrorKind::UnterminatedChar: return msg + ": Unterminated character literal";
+    case LexErrorKind::InvalidToken: return msg + ": Invalid token '" + std::string(text) + "'";
+    case LexErrorKind::UnrecognizedSymbol: return msg + ": Unrecognized symbol '" + std::string(text) + "'";
+    case LexErrorKind::NumberOutOfRange: return msg + ": Numeric literal out of range '" + std::string(text) + "'";
+    case LexErrorKind::InvalidUtf8: return msg + ": Invalid UTF-8 sequence '" + utf8Escaped(text) + "'";
+    case LexErrorKind::None: break;
+    }
+    return msg;
+}
+
+inline std::string lexErrorMessage(const LexToken& t) {
+    return lexErrorMessage(t.error, t.line, t.column, t.text);
+}
+
+// Where the lexer is when its input range ends. A range cut just after a
+// '\n' can only end inside a construct that may contain a newline: a block
+// comment, a string literal, or a character literal whose character was the
+// newline itself (its closing quote is still to come).
+enum class LexState : unsigned char { Code, BlockComment, String, CharClose };
+
+// The rules, quirks included, are those of the original get()/peek() loop:
+// a character literal swallows the byte after its character, and a lone
+// '"' at end of input reads as an empty literal. Line numbers are the real
+// ones: every '\n' counts, including the one ending a // comment. Numbers
+// are C literals (numeric_literal.h), and their value comes with the token.
+// Profile (lex_profile.h) times each token, whitespace run and comment.
+template <class KeywordWords = CKeywords, class OperatorWords = COperators, class Profile = NoProfile>
+class Lexer {
+    using Keywords = PerfectHashSet<KeywordWords>;
+    using Operators = PerfectHashSet<OperatorWords>;
+    static constexpr CharSet specialSymbols{"(){};,"};
+
+public:
+    // Streams `in` through a buffer of bufferSize bytes. The buffer only
+    // grows if a single token is longer than it.
+    explicit Lexer(std::istream& in, size_t bufferSize = 64 * 1024)
+        : in(&in), storage(bufferSize) {
+        base = p = lim = tokStart = lineMark = storage.data();
+    }
+
+    // Lexes the bytes [begin, end) of an in-memory file that starts at
+    // fileBegin and ends at fileEnd, as if the lexer were in state `start` at
+    // begin. Offsets are from fileBegin; lines count from firstLine, and
+    // columns are right if begin is at the start of a line.
+    Lexer(const char* fileBegin, const char* begin, const char* end, const char* fileEnd,
+          LexState start = LexState::Code, int firstLine = 1)
+        : base(fileBegin), p(begin), lim(end), tokStart(begin), inputDone(end == fileEnd),
+          state(start), lineMark(begin), markLine(firstLine), lineBegin(begin - fileBegin) {}
+
+    Lexer(const Lexer&) = delete;
+    Lexer& operator=(const Lexer&) = delete;
+
+    // Fills tok with the next token or diagnostic; false at end of input.
+    bool next(LexToken& tok) {
+        if (!ready) {           // the first call, or diagnostics are queued
+            if (!started) {
+                started = true;
+                if (!resume()) return hasDiagnostic() && popDiagnostic(tok);
+            }
+            if (hasDiagnostic()) return popDiagnostic(tok);
+            ready = true;
+        }
+        for (;;) {
+            tokStart = p;
+            if (!ensure(1)) return false;
+            prof.begin(offsetOf(tokStart));
+            char ch = *p++;
+
+            // Skip the rest of the whitespace run
+            if (isSpaceByte(ch)) {
+                skipSpace();
+                prof.end(LexPhase::Whitespace, offsetOf(p));
+                continue;
+            }
+
+            // Handle comments
+            if (ch == '/' && ensure(1)) {
+                if (*p == '/') {
+                    skipLine();
+                    prof.end(LexPhase::Comment, offsetOf(p));
+                    if (hasDiagnostic()) return popDiagnostic(tok);
+                    continue;
+                }
+                else if (*p == '*') {
+                    p++;
+                    if (!skipBlockComment()) state = LexState::BlockComment;
+                    prof.end(LexPhase::Comment, offsetOf(p));
+                    if (hasDiagnostic()) return popDiagnostic(tok);
+                    continue;
+                }
+            }
+
+            // Handle string literals
+            if (ch == '"') {
+                if (findStringEnd()) {
+                    p++;
+                    return yieldLiteral(tok);
+                }
+                if (lim - tokStart == 1 && inputDone)
+                    return yield(tok, TokenKind::Literal);   // see tokenDisplayText
+                if (inputDone) return yieldError(tok, LexErrorKind::UnterminatedString);
+                carry(LexState::String);
+                continue;
+            }
+
+            // Handle character literals; the character may be any UTF-8 sequence
+            if (ch == '\'') {
+                if (!ensure(1)) return yieldError(tok, LexErrorKind::UnterminatedChar);
+                if ((unsigned char)*p >= 0x80) ensure(4);
+                size_t n = utf8SequenceLength(p, lim);
+                p += n ? n : 1;
+                if (!ensure(1)) {
+                    if (inputDone) return yieldError(tok, LexErrorKind::UnterminatedChar);
+                    carry(LexState::CharClose);
+                    continue;
+                }
+                if (*p++ == '\'') return yieldLiteral(tok);
+                return yieldError(tok, LexErrorKind::UnterminatedChar);
+            }
+
+            // Handle words (identifiers/keywords/numbers). A word starting
+            // with a digit is a number, decoded here; signs after its
+            // exponent mark ("1e+5") are part of it.
+            if (isalpha((unsigned char)ch) || ch == '_') {
+                skipWord();
+                std::string_view word(tokStart, p - tokStart);
+                if (Keywords::contains(word)) return yield(tok, TokenKind::Keyword);
+                if (isValidIdentifier(word)) return yield(tok, TokenKind::Id);
+                return yieldError(tok, LexErrorKind::InvalidToken);
+            }
+            if (isdigit((unsigned char)ch)) {
+                skipWord();
+                while (ensure(2) && isExponentMark(p[-1]) && (*p == '+' || *p == '-') &&
+                       isdigit((unsigned char)p[1])) {
+                    p++;
+                    skipWord();
+                }
+                NumberValue value;
+                switch (decodeNumber(std::string_view(tokStart, p - tokStart), value)) {
+                case NumberError::None:
+                    yield(tok, TokenKind::Num);
+                    tok.number = value;
+                    return true;
+                case NumberError::OutOfRange: return yieldError(tok, LexErrorKind::NumberOutOfRange);
+                case NumberError::Malformed: break;
+                }
+                return yieldError(tok, LexErrorKind::InvalidToken);
+            }
+
+            // Handle operators
+            if (Operators::contains(std::string_view(tokStart, 1))) {
+                if (ensure(1) && Operators::contains(std::string_view(p, 1)) &&
+                    Operators::contains(std::string_view(tokStart, 2)))
+                    p++;
+                return yield(tok, TokenKind::Op);
+            }
+
+            // Handle special symbols
+            if (specialSymbols.contains(ch)) return yield(tok, TokenKind::Special);
+
+            if ((unsigned char)ch >= 0x80) return lexUnicode(tok);
+            return yieldError(tok, LexErrorKind::UnrecognizedSymbol);
+        }
+    }
+
+    class iterator {
+        Lexer* lex;
+        LexToken tok;
+    public:
+        explicit iterator(Lexer* l) : lex(l) { ++*this; }
+        const LexToken& operator*() const { return tok; }
+        const LexToken* operator->() const { return &tok; }
+        iterator& operator++() {
+            if (lex && !lex->next(tok)) lex = nullptr;
+            return *this;
+        }
+        bool operator!=(const iterator& o) const { return lex != o.lex; }
+    };
+    iterator begin() { return iterator(this); }
+    iterator end() { return iterator(nullptr); }
+
+    // After next() has returned false on a range that is not the end of the
+    // file, these describe how the range ended, for stitching chunks.
+    LexState endState() const { return state; }
+    int line() { return locate(p).line; }
+    bool carried() const { return hasCarry; }               // a literal is still open...
+    uint64_t carryStart() const { return carryOffset; }     // ...starting here
+    int carryLine() const { return carryStartLine; }
+    uint64_t carryEnd() const { return closeOffset; }       // end of a literal carried in, or 0
+    bool charClosed() const { return closedChar; }
+
+    const Profile& profile() const { return prof; }
+
+private:
+    std::istream* in = nullptr;
+    std::vector<char> storage;
+    const char* base;           // byte at offset `discarded`
+    const char* p;
+    const char* lim;
+    const char* tokStart;       // refills keep everything from here on
+    uint64_t discarded = 0;
+    bool inputDone = false;
+    bool started = false, ready = false;
+
+    LexState state = LexState::Code;
+    const char* lineMark;       // newlines before here are counted in markLine
+    int markLine = 1;
+    uint64_t lineBegin = 0;     // offset of the first byte of markLine
+    uint64_t carryOffset = 0, closeOffset = 0;
+    int carryStartLine = 0;
+    bool hasCarry = false, closedChar = false;
+    Profile prof;
+
+    // InvalidUtf8 diagnostics found inside a literal or comment, to come out
+    // before the next token. Their bytes are copied: a comment may be gone
+    // from the buffer by then.
+    struct Diagnostic {
+        uint64_t offset;
+        int line, column;
+        std::string bytes;
+    };
+    std::vector<Diagnostic> diagnostics;
+    size_t nextDiagnostic = 0;
+    std::string diagnosticBytes;    // of the one last returned
+
+    uint64_t offsetOf(const char* q) const { return discarded + (q - base); }
+
+    // Line and column of q, which must not be before lineMark.
+    LineCol locate(const char* q) {
+        if (size_t n = lexKernels.countNewlines(lineMark, q)) {
+            markLine += int(n);
+            const char* nl = static_cast<const char*>(memrchr(lineMark, '\n', q - lineMark));
+            lineBegin = offsetOf(nl) + 1;
+        }
+        lineMark = q;
+        return {markLine, int(offsetOf(q) - lineBegin) + 1};
+    }
+
+    // Slides the live part of the buffer to the front and reads more.
+    bool refill() {
+        if (!in || inputDone) return false;
+        locate(tokStart);           // count the newlines that are about to be dropped
+        char* b = storage.data();
+        size_t keep = tokStart - b, live = lim - tokStart, pOff = p - tokStart;
+        if (live == storage.size()) {
+            storage.resize(storage.size() * 2);
+            b = storage.data();
+        } else if (keep) {
+            memmove(b, tokStart, live);
+        }
+        discarded += keep;
+        in->read(b + live, storage.size() - live);
+        size_t n = in->gcount();
+        base = tokStart = lineMark = b;
+        p = b + pOff;
+        lim = b + live + n;
+        if (n == 0) inputDone = true;
+        return n > 0;
+    }
+
+    bool ensure(ptrdiff_t n) {
+        while (lim - p < n)
+            if (!refill()) return false;
+        return true;
+    }
+
+    // Finishes whatever construct the range started inside of.
+    bool resume() {
+        switch (state) {
+        case LexState::Code:
+            return true;
+        case LexState::CharClose:
+            if (!ensure(1)) return false;
+            closedChar = (*p++ == '\'');
+            break;
+        case LexState::BlockComment:
+            if (!skipBlockComment()) return false;
+            break;
+        case LexState::String:
+            if (!findStringEnd()) return false;
+            closeOffset = offsetOf(++p);
+            break;
+        }
+        state = LexState::Code;
+        return true;
+    }
+
+    void carry(LexState s) {
+        state = s;
+        hasCarry = true;
+        carryOffset = offsetOf(tokStart);
+        carryStartLine = locate(tokStart).line;
+        p = lim;
+    }
+
+    bool hasDiagnostic() const { return nextDiagnostic < diagnostics.size(); }
+
+    // The UTF-8 paths are out of line, so that the ASCII loop stays as
+    // tight as it was.
+    __attribute__((noinline)) bool popDiagnostic(LexToken& tok) {
+        Diagnostic& d = diagnostics[nextDiagnostic++];
+        diagnosticBytes.swap(d.bytes);
+        tok = {TokenKind::Error, LexErrorKind::InvalidUtf8, diagnosticBytes, d.offset, d.line, d.column, {}};
+        if (nextDiagnostic == diagnostics.size()) {
+            diagnostics.clear();
+            nextDiagnostic = 0;
+        }
+        return true;
+    }
+
+    // Queues a diagnostic for each invalid UTF-8 sequence in [from, to).
+    // While `more` input may follow, a sequence cut off at `to` is left for
+    // the next call; returns where that call should start.
+    const char* checkUtf8(const char* from, const char* to, bool more) {
+        const char* q = findInvalidUtf8(from, to);
+        return q == to ? to : queueUtf8Errors(q, to, more);
+    }
+
+    __attribute__((noinline)) const char* queueUtf8Errors(const char* q, const char* to, bool more) {
+        for (; q < to; q = lexKernels.validateUtf8(q, to)) {
+            if (more && isUtf8Prefix(q, to)) return q;
+            size_t n = utf8ErrorLength(q, to);
+            LineCol at = locate(q);
+            diagnostics.push_back({offsetOf(q), at.line, at.column, std::string(q, n)});
+            ready = false;
+            q += n;
+        }
+        return to;
+    }
+
+    // Runs that produce no token drop what they have scanned on refill.
+    void skipSpace() {
+        for (;;) {
+            p = lexKernels.skipSpace(p, lim);
+            if (p < lim) return;
+            tokStart = p;
+            if (!refill()) return;
+        }
+    }
+
+    // Comments are checked for UTF-8 as they are skipped; tokStart is where
+    // the check has got to.
+    void skipLine() {
+        for (;;) {
+            const char* nl = (const char*)memchr(p, '\n', lim - p);
+            if (nl) {
+                p = nl + 1;
+                checkUtf8(tokStart, p, false);
+                return;
+            }
+            tokStart = checkUtf8(tokStart, lim, true);
+            p = lim;
+            if (!refill()) {
+                checkUtf8(tokStart, lim, false);
+                return;
+            }
+        }
+    }
+
+    bool skipBlockComment() {
+        for (;;) {
+            const char* q = static_cast<const char*>(memchr(p, '*', lim - p));
+            if (!q) {
+                tokStart = checkUtf8(tokStart, lim, true);
+                p = lim;
+                if (!refill()) {
+                    checkUtf8(tokStart, lim, false);
+                    return false;
+                }
+                continue;
+            }
+            p = q + 1;
+            tokStart = checkUtf8(tokStart, p, false);
+            if (!ensure(1)) return false;
+            if (*p == '/') { p++; return true; }
+        }
+    }
+
+    // Leaves p on the closing quote; false if the input ran out first.
+    bool findStringEnd() {
+        for (;;) {
+            const char* q = static_cast<const char*>(memchr(p, '"', lim - p));
+            if (q) {
+                p = q;
+                return true;
+            }
+            p = lim;
+            if (!refill()) return false;
+        }
+    }
+
+    // ASCII word bytes and non-ASCII XID_Continue characters.
+    void skipWord() {
+        for (;;) {
+            p = lexKernels.skipWord(p, lim);
+            if (p < lim) {
+                if ((unsigned char)*p < 0x80 || !skipXidChars()) return;
+            } else if (!refill()) {
+                return;
+            }
+        }
+    }
+
+    __attribute__((noinline)) bool skipXidChars() {
+        ensure(4);
+        const char* q = skipXidContinue(p, lim);
+        if (q == p) return false;
+        p = q;
+        return true;
+    }
+
+    // A token that starts with a non-ASCII byte, at tokStart.
+    __attribute__((noinline)) bool lexUnicode(LexToken& tok) {
+        p = tokStart;
+        ensure(4);
+        size_t n = utf8SequenceLength(p, lim);
+        if (!n) {
+            p += utf8ErrorLength(p, lim);
+            return yieldError(tok, LexErrorKind::InvalidUtf8);
+        }
+        char32_t c = decodeUtf8(p, n);
+        p += n;
+        if (isXidStart(c)) {
+            skipWord();
+            if (isValidIdentifier(std::string_view(tokStart, p - tokStart))) return yield(tok, TokenKind::Id);
+            return yieldError(tok, LexErrorKind::InvalidToken);
+        }
+        if (!asciiOperator(c).empty()) return yield(tok, TokenKind::Op);
+        return yieldError(tok, LexErrorKind::UnrecognizedSymbol);
+    }
+
+    bool yield(LexToken& tok, TokenKind kind) {
+        static constexpr LexPhase phases[] = {LexPhase::Keyword, LexPhase::Identifier, LexPhase::Number,
+                                              LexPhase::Operator, LexPhase::Special, LexPhase::Literal,
+                                              LexPhase::Error};
+        prof.end(phases[(int)kind], offsetOf(p));
+        LineCol at = locate(tokStart);
+        tok = {kind, LexErrorKind::None, std::string_view(tokStart, p - tokStart), offsetOf(tokStart),
+               at.line, at.column};
+        return true;
+    }
+
+    bool yieldError(LexToken& tok, LexErrorKind e) {
+        yield(tok, TokenKind::Error);
+        tok.error = e;
+        return true;
+    }
+
+    bool yieldLiteral(LexToken& tok) {
+        yield(tok, TokenKind::Literal);
+        checkUtf8(tokStart, p, false);
+        return true;
+    }
+
+    static bool isValidIdentifier(std::string_view word) {
+        if (word.empty() || !(isalpha((unsigned char)word[0]) || word[0] == '_'))
+            return isUnicodeIdentifier(word);
+        for (char ch : word) {
+            if (!isalnum((unsigned char)ch) && ch != '_')
+                return (unsigned char)ch >= 0x80 && isUnicodeIdentifier(word);
+        }
+        return true;
+    }
+
+    static bool isExponentMark(char c) {
+        return c == 'e' || c == 'E' || c == 'p' || c == 'P';
+    }
+};
+
+#endif
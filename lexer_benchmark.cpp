@@ -0,0 +1,505 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <functional>
+#include <chrono>
+#include <filesystem>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+using namespace std;
+
+// Throughput benchmark for the three lexers.
+//
+// Generates deterministic C-like corpora and times the built lexer programs
+// on them, one process per run:
+//
+//     g++ -std=c++17 -O2 -o lexer_benchmark lexer_benchmark.cpp
+//     g++ -std=c++17 -O2 -shared -fPIC -o alloc_counter.so alloc_counter.cpp
+//     ./lexer_benchmark --sizes=1M,64M
+//
+// For every corpus and lexer it reports MB/s and tokens/s (best of --runs),
+// peak RSS (largest of the runs) and heap allocations per token (one more
+// run under alloc_counter.so; "n/a" if that is not built). Token counts are
+// taken from each lexer's own output, so they follow that lexer's rules.
+
+// splitmix64: the same corpus for the same seed on every platform, which
+// the <random> distributions do not promise.
+struct Rng {
+    uint64_t state;
+    explicit Rng(uint64_t seed) : state(seed) {}
+
+    uint64_t next() {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+    size_t below(size_t n) { return next() % n; }
+    bool chance(double p) { return (next() >> 11) * 0x1p-53 < p; }
+};
+
+struct CorpusMix {
+    double identifiers = 0.6;   // share of operands that are identifiers, the rest are numbers
+    double comments = 0.15;     // share of the bytes that are inside comments
+    int literalLength = 16;     // mean length of string literal contents
+    double errors = 0.001;      // share of statements with a stray '@', '$' or '`'
+};
+
+// Writes functions made of declarations, assignments, calls, ifs and loops
+// until the file reaches the requested size. Comments are placed between
+// statements whenever the comment share falls below the target.
+class CorpusGenerator {
+    Rng rng;
+    CorpusMix mix;
+    vector<string> names;
+    string out;
+    uint64_t written = 0, commentBytes = 0;
+    int functions = 0;
+
+    static constexpr const char *types[] = {"int", "float", "double", "char", "long", "unsigned"};
+    static constexpr const char *binaryOps[] = {"+", "-", "*", "/", "%", "<<", ">>", "&", "|", "^"};
+    static constexpr const char *compareOps[] = {"<", "<=", ">", ">=", "==", "!=", "&&", "||"};
+    static constexpr const char *words[] = {"the", "value", "is", "kept", "for", "later", "use",
+                                            "note", "this", "loop", "counts", "each", "entry",
+                                            "TODO", "check", "bounds", "before", "indexing"};
+
+    template <size_t N>
+    const char *pick(const char *const (&from)[N]) { return from[rng.below(N)]; }
+
+    void identifier() { out += names[rng.below(names.size())]; }
+
+    void number() {
+        if (rng.chance(0.25)) {
+            out += to_string(rng.below(1000));
+            out += '.';
+            out += to_string(rng.below(100000));
+        } else {
+            out += to_string(rng.below(100000));
+        }
+    }
+
+    void operand() {
+        if (rng.chance(mix.identifiers)) identifier();
+        else number();
+    }
+
+    void expression() {
+        operand();
+        for (size_t n = rng.below(4); n > 0; n--) {
+            out += ' ';
+            out += pick(binaryOps);
+            out += ' ';
+            operand();
+        }
+    }
+
+    void literal() {
+        size_t length = rng.below(2 * size_t(mix.literalLength) + 1);
+        out += '"';
+        for (size_t i = 0; i < length; i++) {
+            char c = char(' ' + rng.below(95));
+            out += (c == '"' || c == '\\') ? '_' : c;
+        }
+        out += '"';
+    }
+
+    void comment(const string &indent) {
+        size_t before = out.size();
+        bool block = rng.chance(0.3);
+        out += indent;
+        out += block ? "/*" : "//";
+        for (size_t lines = block ? 1 + rng.below(3) : 1; lines > 0; lines--) {
+            for (size_t n = 3 + rng.below(10); n > 0; n--) {
+                out += ' ';
+                out += pick(words);
+            }
+            if (block && lines > 1) out += "\n" + indent + "  ";
+        }
+        out += block ? " */\n" : "\n";
+        commentBytes += out.size() - before;
+    }
+
+    // A stray character where a token could start, or nothing.
+    void maybeError() {
+        if (rng.chance(mix.errors)) {
+            static const char stray[] = "@$`";
+            out += ' ';
+            out += stray[rng.below(3)];
+        }
+    }
+
+    void statement(const string &indent) {
+        if (double(commentBytes) < mix.comments * double(written + out.size())) comment(indent);
+        out += indent;
+        switch (rng.below(6)) {
+        case 0:
+            out += pick(types);
+            out += ' ';
+            identifier();
+            out += " = ";
+            expression();
+            break;
+        case 1:
+            identifier();
+            out += " = ";
+            expression();
+            break;
+        case 2:
+            identifier();
+            out += '(';
+            literal();
+            out += ", ";
+            expression();
+            out += ')';
+            break;
+        case 3:
+            out += "if (";
+            expression();
+            out += ' ';
+            out += pick(compareOps);
+            out += ' ';
+            operand();
+            out += ") {\n" + indent + "    ";
+            identifier();
+            out += " = ";
+            expression();
+            out += ";\n" + indent + "} else {\n" + indent + "    ";
+            identifier();
+            out += "++;\n" + indent + "}\n";
+            return;
+        case 4:
+            out += "while (";
+            identifier();
+            out += " < ";
+            operand();
+            out += ") ";
+            identifier();
+            out += " += ";
+            expression();
+            break;
+        default:
+            out += "for (i = 0; i < ";
+            operand();
+            out += "; i++) ";
+            identifier();
+            out += " -= ";
+            operand();
+            break;
+        }
+        maybeError();
+        out += ";\n";
+    }
+
+    void function() {
+        out += "int f" + to_string(functions++) + "(int a, int b) {\n";
+        for (size_t n = 4 + rng.below(12); n > 0; n--) statement("    ");
+        out += "    return a;\n}\n\n";
+    }
+
+public:
+    CorpusGenerator(uint64_t seed, const CorpusMix &m) : rng(seed), mix(m) {
+        static const char first[] = "abcdefghijklmnopqrstuvwxyz_ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+        static const char rest[] = "abcdefghijklmnopqrstuvwxyz_0123456789";
+        for (int i = 0; i < 4096; i++) {
+            string name(1, first[rng.below(sizeof first - 1)]);
+            for (size_t n = rng.below(12); n > 0; n--) name += rest[rng.below(sizeof rest - 1)];
+            names.push_back(name);
+        }
+    }
+
+    // Writes at least `size` bytes, ending after a whole function.
+    bool write(const string &path, uint64_t size) {
+        FILE *f = fopen(path.c_str(), "wb");
+        if (!f) return false;
+        out += "#include <stdio.h>\n\n";
+        while (written + out.size() < size) {
+            function();
+            if (out.size() >= (1 << 20)) {
+                fwrite(out.data(), 1, out.size(), f);
+                written += out.size();
+                out.clear();
+            }
+        }
+        fwrite(out.data(), 1, out.size(), f);
+        written += out.size();
+        out.clear();
+        return fclose(f) == 0;
+    }
+};
+
+struct LexerUnderTest {
+    string name;
+    string binary;
+    vector<string> args;          // timed runs; the corpus path is appended
+    vector<string> countArgs;     // the run whose output is counted
+    function<long long(const string &line)> tokensOnLine;
+};
+
+struct RunResult {
+    bool ok;
+    double seconds;
+    long peakRssKb;
+};
+
+// Runs `argv` with stdout to `out` (or to a pipe read line by line through
+// `onLine` when out is empty) and stderr to /dev/null.
+RunResult runProcess(const vector<string> &argv, const string &out,
+                     const function<void(const string &)> &onLine = nullptr,
+                     const vector<string> &env = {}) {
+    int fds[2] = {-1, -1};
+    if (out.empty() && pipe(fds) != 0) return {false, 0, 0};
+
+    auto t0 = chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid == 0) {
+        int null = open("/dev/null", O_RDWR);
+        dup2(null, 0);
+        dup2(null, 2);
+        if (out.empty()) {
+            dup2(fds[1], 1);
+            close(fds[0]);
+            close(fds[1]);
+        } else {
+            int o = open(out.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            dup2(o, 1);
+        }
+        for (const string &e : env) putenv(const_cast<char *>(e.c_str()));
+        vector<char *> args;
+        for (const string &a : argv) args.push_back(const_cast<char *>(a.c_str()));
+        args.push_back(nullptr);
+        execv(args[0], args.data());
+        _exit(127);
+    }
+    if (pid < 0) return {false, 0, 0};
+
+    if (out.empty()) {
+        close(fds[1]);
+        FILE *f = fdopen(fds[0], "r");
+        char *line = nullptr;
+        size_t cap = 0;
+        ssize_t n;
+        while ((n = getline(&line, &cap, f)) > 0) {
+            if (line[n - 1] == '\n') n--;
+            onLine(string(line, n));
+        }
+        free(line);
+        fclose(f);
+    }
+
+    int status;
+    struct rusage usage;
+    wait4(pid, &status, 0, &usage);
+    auto t1 = chrono::steady_clock::now();
+    bool ok = WIFEXITED(status) && WEXITSTATUS(status) != 127;
+    return {ok, chrono::duration<double>(t1 - t0).count(), usage.ru_maxrss};
+}
+
+// "Name: 12" -> 12
+long long countAfterColon(const string &line) {
+    size_t colon = line.rfind(": ");
+    return colon == string::npos ? 0 : atoll(line.c_str() + colon + 2);
+}
+
+vector<LexerUnderTest> lexersIn(const string &binDir) {
+    // LAB-3 has no counts of its own: count the CSV records that are not errors.
+    auto lab3Tokens = [](const string &line) -> long long {
+        return line != "line,column,kind,lexeme" && line.find(",\"error\",") == string::npos;
+    };
+    auto analyserTokens = [](const string &line) -> long long {
+        return line.find(':') != string::npos && line.rfind("Errors:", 0) != 0 ? countAfterColon(line) : 0;
+    };
+    auto listingTokens = [](const string &line) -> long long {
+        return line.rfind("Total <", 0) == 0 ? countAfterColon(line) : 0;
+    };
+    return {
+        {"22BCE1126_LAB-3", binDir + "/22BCE1126_LAB-3", {"--quiet"}, {"--format=csv"}, lab3Tokens},
+        {"22BCE1126_LAB-3 --mmap", binDir + "/22BCE1126_LAB-3", {"--quiet", "--mmap"},
+         {"--mmap", "--format=csv"}, lab3Tokens},
+        {"22BCE1126_LexicalAnalyser", binDir + "/22BCE1126_LexicalAnalyser", {"--quiet"}, {"--quiet"},
+         analyserTokens},
+        {"lexical_analyser", binDir + "/lexical_analyser", {}, {}, listingTokens},
+        {"lexical_analyser --dfa", binDir + "/lexical_analyser", {"--dfa"}, {"--dfa"}, listingTokens},
+    };
+}
+
+// "1M" -> 1048576; K, M and G suffixes, plain numbers are bytes.
+uint64_t parseSize(const string &s) {
+    size_t end;
+    uint64_t n = stoull(s, &end);
+    if (end < s.size()) {
+        switch (toupper(s[end])) {
+        case 'K': n <<= 10; break;
+        case 'M': n <<= 20; break;
+        case 'G': n <<= 30; break;
+        default: throw invalid_argument("size suffix");
+        }
+    }
+    return n;
+}
+
+string sizeName(uint64_t bytes) {
+    if (bytes % (1 << 30) == 0) return to_string(bytes >> 30) + "G";
+    if (bytes % (1 << 20) == 0) return to_string(bytes >> 20) + "M";
+    if (bytes % (1 << 10) == 0) return to_string(bytes >> 10) + "K";
+    return to_string(bytes);
+}
+
+void benchmarkCorpus(const string &path, const vector<LexerUnderTest> &lexers, int runs,
+                     const string &allocCounter, const string &scratch) {
+    uint64_t bytes = filesystem::file_size(path);
+    cout << "\n" << path << " (" << fixed << setprecision(1) << bytes / 1e6 << " MB)\n";
+    cout << left << setw(28) << "Lexer" << right << setw(10) << "MB/s" << setw(12) << "Mtokens/s"
+         << setw(12) << "Tokens" << setw(14) << "Peak RSS MB" << setw(14) << "Allocs/token" << "\n";
+
+    for (const LexerUnderTest &lx : lexers) {
+        cout << left << setw(28) << lx.name << right << flush;
+        if (access(lx.binary.c_str(), X_OK) != 0) {
+            cout << "  not built (" << lx.binary << ")\n";
+            continue;
+        }
+
+        vector<string> argv = {lx.binary};
+        argv.insert(argv.end(), lx.args.begin(), lx.args.end());
+        argv.push_back(path);
+        vector<string> countArgv = {lx.binary};
+        countArgv.insert(countArgv.end(), lx.countArgs.begin(), lx.countArgs.end());
+        countArgv.push_back(path);
+
+        long long tokens = 0;
+        RunResult counted = runProcess(countArgv, "", [&](const string &line) { tokens += lx.tokensOnLine(line); });
+
+        double best = 0;
+        long peak = 0;
+        bool ok = counted.ok;
+        for (int r = 0; r < runs && ok; r++) {
+            RunResult run = runProcess(argv, "/dev/null");
+            ok = run.ok;
+            if (r == 0 || run.seconds < best) best = run.seconds;
+            peak = max(peak, run.peakRssKb);
+        }
+        if (!ok) {
+            cout << "  failed\n";
+            continue;
+        }
+
+        string allocs = "n/a";
+        if (!allocCounter.empty()) {
+            string report = scratch + "/allocs.txt";
+            RunResult counting = runProcess(argv, "/dev/null", nullptr,
+                                            {"LD_PRELOAD=" + allocCounter, "ALLOC_COUNTER_OUT=" + report});
+            ifstream in(report);
+            string word;
+            unsigned long long n;
+            if (counting.ok && in >> word >> n && tokens > 0) {
+                ostringstream s;
+                s << fixed << setprecision(4) << double(n) / tokens;
+                allocs = s.str();
+            }
+            filesystem::remove(report);
+        }
+
+        cout << fixed << setprecision(1) << setw(10) << bytes / 1e6 / best
+             << setprecision(3) << setw(12) << tokens / 1e6 / best
+             << setw(12) << tokens
+             << setprecision(1) << setw(14) << peak / 1024.0
+             << setw(14) << allocs << "\n";
+    }
+}
+
+int main(int argc, char *argv[]) {
+    // Usage: ./lexer_benchmark [--sizes=1M,16M,...] [--runs=N] [--seed=N]
+    //                          [--identifiers=F] [--comments=F] [--literal-length=N] [--errors=F]
+    //                          [--bin-dir=DIR] [--alloc-counter=SO] [--dir=DIR]
+    //        ./lexer_benchmark --generate=FILE [--size=1M] [mix options]
+    // Corpora go to a temporary directory that is removed afterwards,
+    // unless --dir is given. --bin-dir holds the built lexers (default .),
+    // and alloc_counter.so is looked for there too.
+    CorpusMix mix;
+    vector<uint64_t> sizes = {1 << 20, 16 << 20};
+    uint64_t seed = 1;
+    int runs = 3;
+    string binDir = ".", allocCounter, corpusDir, generate;
+    bool allocCounterGiven = false;
+
+    try {
+        for (int i = 1; i < argc; i++) {
+            string arg = argv[i];
+            if (arg.rfind("--sizes=", 0) == 0 || arg.rfind("--size=", 0) == 0) {
+                sizes.clear();
+                stringstream list(arg.substr(arg.find('=') + 1));
+                for (string s; getline(list, s, ',');) sizes.push_back(parseSize(s));
+            }
+            else if (arg.rfind("--runs=", 0) == 0) runs = max(1, stoi(arg.substr(7)));
+            else if (arg.rfind("--seed=", 0) == 0) seed = stoull(arg.substr(7));
+            else if (arg.rfind("--identifiers=", 0) == 0) mix.identifiers = stod(arg.substr(14));
+            else if (arg.rfind("--comments=", 0) == 0) mix.comments = stod(arg.substr(11));
+            else if (arg.rfind("--literal-length=", 0) == 0) mix.literalLength = stoi(arg.substr(17));
+            else if (arg.rfind("--errors=", 0) == 0) mix.errors = stod(arg.substr(9));
+            else if (arg.rfind("--bin-dir=", 0) == 0) binDir = arg.substr(10);
+            else if (arg.rfind("--alloc-counter=", 0) == 0) {
+                allocCounter = arg.substr(16);
+                allocCounterGiven = true;
+            }
+            else if (arg.rfind("--dir=", 0) == 0) corpusDir = arg.substr(6);
+            else if (arg.rfind("--generate=", 0) == 0) generate = arg.substr(11);
+            else {
+                cerr << "Unknown option " << arg << endl;
+                return 1;
+            }
+        }
+    } catch (const exception &) {
+        cerr << "Bad option value" << endl;
+        return 1;
+    }
+
+    if (!generate.empty()) {
+        if (!CorpusGenerator(seed, mix).write(generate, sizes.front())) {
+            cerr << "Cannot write " << generate << endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    bool temporary = corpusDir.empty();
+    if (temporary) {
+        char dir[] = "/tmp/lexer_benchmark.XXXXXX";
+        if (!mkdtemp(dir)) {
+            cerr << "Cannot create a temporary directory" << endl;
+            return 1;
+        }
+        corpusDir = dir;
+    } else {
+        filesystem::create_directories(corpusDir);
+    }
+
+    if (!allocCounterGiven) allocCounter = binDir + "/alloc_counter.so";
+    if (access(allocCounter.c_str(), R_OK) != 0) allocCounter.clear();
+    else allocCounter = filesystem::absolute(allocCounter).string();
+
+    cout << "Corpus mix: identifiers " << mix.identifiers << ", comments " << mix.comments
+         << ", literal length " << mix.literalLength << ", errors " << mix.errors
+         << ", seed " << seed << "; best of " << runs << " runs\n";
+
+    vector<LexerUnderTest> lexers = lexersIn(binDir);
+    int status = 0;
+    for (uint64_t size : sizes) {
+        string path = corpusDir + "/corpus-" + sizeName(size) + "-" + to_string(seed) + ".c";
+        if (!CorpusGenerator(seed, mix).write(path, size)) {
+            cerr << "Cannot write " << path << endl;
+            status = 1;
+            break;
+        }
+        benchmarkCorpus(path, lexers, runs, allocCounter, corpusDir);
+        if (temporary) filesystem::remove(path);
+    }
+    if (temporary) filesystem::remove_all(corpusDir);
+    return status;
+}
@@ -1,242 +1,646 @@
 #include <iostream>
 #include <fstream>
-#include <unordered_set>
 #include <string>
 #include <cctype>
 #include <vector>
+#include <cstring>
+#include <cstdint>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <charconv>
+#include <memory>
+#include "lexer.h"
+#include "incremental_lexer.h"
+#include "token_cache.h"
+#include "arena.h"
+#include "dfa_lexer.h"
+#include "lex_profile.h"
+#include "token_stream.h"
 using namespace std;
 
-// Token sets
-unordered_set<string> keywords = {
-    "auto", "break", "case", "char", "const", "continue", "default", "do",
-    "double", "else", "enum", "float", "for", "goto", "if", "int", "long",
-    "register", "return", "short", "signed", "sizeof", "static", "struct",
-    "switch", "typedef", "union", "unsigned", "void", "volatile", "while"
+// Token structure for the whole-file modes, where the file is in `source`.
+// A token is a slice of it; its line and column, like its text, are only
+// worked out when the "<kind> : value" listing is printed.
+struct Token {
+    uint32_t offset;
+    uint32_t length;
+    TokenKind kind;
 };
+static_assert(sizeof(Token) <= 16, "Token should stay within 16 bytes");
+
+// Tokens stored column-wise (9 bytes each), so passes that only need the
+// kinds -- like the summary counts -- read one byte per token.
+struct TokenTable {
+    vector<TokenKind> kind;
+    vector<uint32_t> offset, length;
 
-unordered_set<string> operators = {
-    "+", "-", "*", "/", "%", "++", "--", "==", "!=", "<", "<=", ">", ">=",
-    "&&", "||", "!", "=", "+=", "-=", "*=", "/=", "%=", "&", "|", "^", "~", "<<", ">>"
+    size_t size() const { return kind.size(); }
+    void push_back(const Token& t) {
+        kind.push_back(t.kind);
+        offset.push_back(t.offset);
+        length.push_back(t.length);
+    }
+    Token operator[](size_t i) const { return {offset[i], length[i], kind[i]}; }
 };
 
-unordered_set<char> special_symbols = {
-    '(', ')', '{', '}', ';', ','
+// The session's text -- the source and the formatted diagnostics -- lives
+// in `session` and is freed with it in one go.
+Arena session;
+string_view source;
+TokenTable tokens;
+vector<string_view> error_messages;
+
+// With --emit-tokens, the stream goes here instead of the listing.
+TokenStreamWriter* tokenArchive = nullptr;
+
+// Chunks only record offsets, so their results need no adjusting for the
+// lines before them; messages are formatted once the chunks are stitched.
+struct LexError {
+    uint64_t offset;
+    LexErrorKind kind;
+    string_view text;   // into `source`
 };
 
-// Token structure
-struct Token {
-    string type;
-    string value;
-    int line;
+struct ChunkResult {
+    TokenTable tokens;
+    vector<LexError> errors;
+    LexState endState = LexState::Code;
+    bool carried = false;               // literal opened in this chunk and still open at its end
+    uint64_t carryStart = 0;
+    uint64_t carryEnd = 0;              // one past the quote closing a literal carried in
+    bool charClosed = false;            // CharClose start: was the first byte the closing quote?
 };
 
-vector<Token> tokens;
-vector<string> error_messages;
-int current_line = 1;
+// Lexes [begin, end) of `source` as if the lexer were in state `start` at begin.
+ChunkResult lexChunk(const char* begin, const char* end, const char* fileEnd, LexState start) {
+    ChunkResult r;
+    Lexer<CKeywords, COperators> lex(source.data(), begin, end, fileEnd, start);
+    for (const LexToken& t : lex) {
+        if (t.kind == TokenKind::Error)     // UTF-8 diagnostics carry a copy of their bytes
+            r.errors.push_back({t.offset, t.error, source.substr(t.offset, t.text.size())});
+        else
+            r.tokens.push_back({uint32_t(t.offset), uint32_t(t.text.size()), t.kind});
+    }
+    r.endState = lex.endState();
+    r.carried = lex.carried();
+    r.carryStart = lex.carryStart();
+    r.carryEnd = lex.carryEnd();
+    r.charClosed = lex.charClosed();
+    return r;
+}
+
+struct Chunk {
+    const char* begin;
+    const char* end;
+    ChunkResult runs[3];    // speculative results for Code, BlockComment, String
+};
 
-// Helper functions
-bool isKeyword(const string& word) {
-    return keywords.find(word) != keywords.end();
+// Splits [begin, end) into about n pieces, each ending just after a newline.
+static vector<Chunk> splitChunks(const char* begin, const char* end, size_t n) {
+    vector<Chunk> chunks;
+    size_t target = max<size_t>((end - begin) / n, 1);
+    const char* p = begin;
+    while (p < end) {
+        const char* cut = end;
+        if ((size_t)(end - p) > target) {
+            const char* nl = (const char*)memchr(p + target, '\n', end - p - target);
+            if (nl) cut = nl + 1;
+        }
+        chunks.push_back({p, cut, {}});
+        p = cut;
+    }
+    return chunks;
 }
 
-bool isOperator(const string& op) {
-    return operators.find(op) != operators.end();
+// Formats a diagnostic at `offset` of `source`.
+static string_view errorAt(const SourceBuffer& src, LexErrorKind kind, uint64_t offset, string_view text) {
+    LineCol at = src.locate(offset);
+    return session.copy(lexErrorMessage(kind, at.line, at.column, text));
 }
 
-bool isSpecialSymbol(char ch) {
-    return special_symbols.find(ch) != special_symbols.end();
+// Queues a diagnostic for each invalid UTF-8 sequence in [offset, offset + length) of `source`.
+static void checkUtf8(const SourceBuffer& src, uint64_t offset, size_t length) {
+    const char* begin = source.data();
+    forEachInvalidUtf8(begin + offset, begin + offset + length, [&](const char* bad, size_t n) {
+        error_messages.push_back(errorAt(src, LexErrorKind::InvalidUtf8, bad - begin, string_view(bad, n)));
+    });
 }
 
-bool isValidIdentifier(const string& word) {
-    if (word.empty() || !(isalpha(word[0]) || word[0] == '_'))
-        return false;
-    for (char ch : word) {
-        if (!isalnum(ch) && ch != '_')
-            return false;
+// Linear pass over the chunks: follow the real lexer state from chunk to
+// chunk, take the matching speculative run and close literals that
+// straddle a boundary. Chunks leave the UTF-8 check of a literal they
+// carry to here, where it is whole.
+static void stitchChunks(vector<Chunk>& chunks, const char* fileEnd, const SourceBuffer& src) {
+    LexState state = LexState::Code;
+    uint64_t openStart = 0;
+
+    for (Chunk& c : chunks) {
+        ChunkResult lazy;
+        ChunkResult* r;
+        if (state == LexState::CharClose) {
+            lazy = lexChunk(c.begin, c.end, fileEnd, state);   // rare; not worth speculating
+            r = &lazy;
+        } else {
+            r = &c.runs[(int)state];
+        }
+
+        if (state == LexState::String && r->carryEnd) {
+            tokens.push_back({uint32_t(openStart), uint32_t(r->carryEnd - openStart), TokenKind::Literal});
+            checkUtf8(src, openStart, r->carryEnd - openStart);
+        }
+        if (state == LexState::CharClose) {
+            if (r->charClosed)
+                tokens.push_back({uint32_t(openStart), 3, TokenKind::Literal});
+            else
+                error_messages.push_back(errorAt(src, LexErrorKind::UnterminatedChar, openStart, ""));
+        }
+
+        for (size_t i = 0; i < r->tokens.size(); i++) tokens.push_back(r->tokens[i]);
+        for (const LexError& e : r->errors)
+            error_messages.push_back(errorAt(src, e.kind, e.offset, e.text));
+
+        if (r->carried) openStart = r->carryStart;
+        state = r->endState;
     }
-    return true;
+
+    if (state == LexState::String)
+        error_messages.push_back(errorAt(src, LexErrorKind::UnterminatedString, openStart, ""));
 }
 
-bool isNumber(const string& word) {
-    if (word.empty()) return false;
-    size_t start = 0;
-    bool dot = false;
-    
-    for (size_t i = start; i < word.size(); i++) {
-        if (word[i] == '.') {
-            if (dot) return false;
-            dot = true;
-        } else if (!isdigit(word[i])) {
-            return false;
+// Prints the listing as tokens are pulled from next(LexToken&), then the
+// errors and the summary. Diagnostics in the stream are collected into
+// error_messages, which is the only thing kept in memory. With an archive,
+// every token, diagnostics included, is written to it and the listing is
+// left out.
+template <class Next>
+void displayResults(Next&& next) {
+    size_t counts[tokenKindCount] = {};
+    LexToken token;
+
+    if (!tokenArchive) cout << "\n--- Token Listing ---\n";
+    while (next(token)) {
+        if (tokenArchive) tokenArchive->add(token);
+        if (token.kind == TokenKind::Error) {
+            error_messages.push_back(session.copy(lexErrorMessage(token)));
+            continue;
         }
+        counts[(int)token.kind]++;
+        if (!tokenArchive)
+            cout << "[Line " << token.line << "] " << tokenTypeNames[(int)token.kind] << " : "
+                 << tokenDisplayText(token.kind, token.text) << endl;
     }
-    return true;
+
+    // Display error messages
+    if (!error_messages.empty()) {
+        cout << "\n--- Errors ---\n";
+        for (const auto& msg : error_messages) {
+            cout << msg << endl;
+        }
+    }
+
+    cout << "\n--- Token Summary ---\n";
+    for (int k = 0; k < tokenKindCount; k++)
+        cout << "Total " << tokenTypeNames[k] << " tokens: " << counts[k] << endl;
+    cout << "Total errors: " << error_messages.size() << endl;
+}
+
+// Prints `count` tokens given as columns over `source`, looking up each
+// token's line and column in the line index as it goes.
+template <class Kinds, class Offsets>
+void displayTokens(const SourceBuffer& src, size_t count, const Kinds& kind, const Offsets& offset,
+                   const Offsets& length) {
+    LineCursor cursor(src);
+    size_t i = 0;
+    displayResults([&](LexToken& t) {
+        if (i == count) return false;
+        LineCol at = cursor.locate(offset[i]);
+        t = {kind[i], LexErrorKind::None, string_view(source.data() + offset[i], length[i]), offset[i],
+             at.line, at.column};
+        i++;
+        return true;
+    });
+}
+
+// Files smaller than this per worker are lexed on one thread.
+static const size_t MIN_CHUNK_BYTES = 1 << 20;
+
+// Streams the file through a Lexer that times every phase, and writes the
+// profile as JSON to `profileTo` ("-" for stdout, after the summary). The
+// perf counters also cover printing the listing, which is interleaved with
+// lexing.
+void processProfiled(ifstream& file, const string& profileTo) {
+    Lexer<CKeywords, COperators, LexProfile> lex(file);
+    PerfCounters perf;
+    perf.start();
+    displayResults([&](LexToken& t) { return lex.next(t); });
+    perf.stop();
+
+    if (profileTo == "-") {
+        cout << "\n--- Lexer Profile ---\n";
+        writeProfileJson(cout, "lexical_analyser", lex.profile(), perf);
+        return;
+    }
+    ofstream out(profileTo);
+    if (!out) {
+        cerr << "Cannot write profile to " << profileTo << endl;
+        return;
+    }
+    writeProfileJson(out, "lexical_analyser", lex.profile(), perf);
 }
 
-void processFile(const string& filename) {
-    ifstream file(filename);
+// jobs == 1 streams the file through a Lexer straight into the listing.
+// Otherwise the whole file is read, cut into chunks that are lexed
+// speculatively from every start state on `jobs` threads, and stitched into
+// `tokens` before printing.
+void processFile(const string& filename, unsigned jobs = 1, const string& profileTo = "") {
+    ifstream file(filename, ios::binary);
     if (!file) {
         cerr << "Error opening file.\n";
         return;
     }
 
-    string word;
-    char ch;
+    if (!profileTo.empty()) {
+        processProfiled(file, profileTo);
+        return;
+    }
+    if (jobs <= 1) {
+        Lexer<CKeywords, COperators> lex(file);
+        displayResults([&](LexToken& t) { return lex.next(t); });
+        return;
+    }
 
-    while (file.get(ch)) {
-        // Track line numbers
-        if (ch == '\n') current_line++;
+    source = readAll(file, session);
+    file.close();
+    const char* begin = source.data();
+    const char* end = begin + source.size();
 
-        // Skip whitespace
-        if (isspace(ch)) continue;
+    vector<Chunk> chunks = splitChunks(begin, end, max<size_t>(min<size_t>(jobs * 4, source.size() / MIN_CHUNK_BYTES), 1));
+    // Task i lexes chunk i / 3 from start state i % 3; chunk 0 only needs Code.
+    atomic<size_t> next(0);
+    size_t nTasks = chunks.size() * 3;
+    auto worker = [&]() {
+        for (size_t i; (i = next++) < nTasks; ) {
+            Chunk& c = chunks[i / 3];
+            if (i < 3 && i != 0) continue;
+            c.runs[i % 3] = lexChunk(c.begin, c.end, end, LexState(i % 3));
+        }
+    };
+    vector<thread> pool;
+    for (unsigned t = 0; t < min<size_t>(jobs, nTasks); t++) pool.emplace_back(worker);
+    for (thread& t : pool) t.join();
 
-        // Handle comments
-        if (ch == '/') {
-            if (file.peek() == '/') {
-                while (file.get(ch) && ch != '\n') current_line += (ch == '\n');
-                continue;
-            }
-            else if (file.peek() == '*') {
-                file.get();
-                while (file.get(ch)) {
-                    if (ch == '\n') current_line++;
-                    if (ch == '*' && file.peek() == '/') {
-                        file.get();
-                        break;
-                    }
-                }
-                continue;
-            }
+    SourceBuffer src(source);
+    stitchChunks(chunks, end, src);
+    displayTokens(src, tokens.size(), tokens.kind, tokens.offset, tokens.length);
+}
+
+// Cache entry layout: the TokenTable columns and the error messages, each
+// message as a uint32_t length followed by its bytes.
+enum CacheSection : uint32_t { CACHE_KINDS = 1, CACHE_OFFSETS, CACHE_LENGTHS, CACHE_ERRORS };
+static const char* const CACHE_TOOL = "lexical_analyser/3";
+
+// Whole-file mode with a content-keyed cache. A hit prints straight from
+// the mapped entry; a miss lexes `source` into `tokens` and stores it.
+void processCached(const string& filename, TokenCache& cache) {
+    ifstream file(filename, ios::binary);
+    if (!file) {
+        cerr << "Error opening file.\n";
+        return;
+    }
+    source = readAll(file, session);
+    CacheKey key = makeCacheKey(source, CACHE_TOOL);
+    SourceBuffer src(source);
+
+    if (CacheEntry hit = cache.lookup(key)) {
+        CacheArray<TokenKind> kind = hit.array<TokenKind>(CACHE_KINDS);
+        CacheArray<uint32_t> offset = hit.array<uint32_t>(CACHE_OFFSETS);
+        CacheArray<uint32_t> length = hit.array<uint32_t>(CACHE_LENGTHS);
+        string_view errors = hit.section(CACHE_ERRORS);
+        for (size_t at = 0; at + 4 <= errors.size(); ) {
+            uint32_t n;
+            memcpy(&n, errors.data() + at, 4);
+            error_messages.push_back(errors.substr(at + 4, n));    // views into the entry
+            at += 4 + n;
         }
+        displayTokens(src, kind.size, kind, offset, length);
+        return;
+    }
 
-        // Handle string literals
-        if (ch == '"') {
-            string literal = "\"";
-            int start_line = current_line;
-            while (file.get(ch) && ch != '"') {
-                if (ch == '\n') current_line++;
-                literal += ch;
-            }
-            if (ch == '"') {
-                literal += '"';
-                tokens.push_back({"<literal>", literal, start_line});
-            } else {
-                error_messages.push_back("Error at line " + to_string(start_line) + 
-                                      ": Unterminated string literal");
-            }
+    const char* begin = source.data();
+    Lexer<CKeywords, COperators> lex(begin, begin, begin + source.size(), begin + source.size());
+    for (const LexToken& t : lex) {
+        if (t.kind == TokenKind::Error)
+            error_messages.push_back(session.copy(lexErrorMessage(t)));
+        else
+            tokens.push_back({uint32_t(t.offset), uint32_t(t.text.size()), t.kind});
+    }
+
+    CacheWriter w;
+    w.add(CACHE_KINDS, tokens.kind);
+    w.add(CACHE_OFFSETS, tokens.offset);
+    w.add(CACHE_LENGTHS, tokens.length);
+    string errors;
+    for (string_view msg : error_messages) {
+        uint32_t n = msg.size();
+        errors.append(reinterpret_cast<const char*>(&n), 4);
+        errors += msg;
+    }
+    w.add(CACHE_ERRORS, errors.data(), errors.size());
+    cache.store(key, w);
+
+    displayTokens(src, tokens.size(), tokens.kind, tokens.offset, tokens.length);
+}
+
+// The rules of Lexer (lexer.h) as a DFA spec, quirks included, for --dfa.
+// A rule's value is a TokenKind, DFA_ERROR + a LexErrorKind, DFA_SKIP, or
+// DFA_NUMBER for a word that starts with a digit, which is then decoded
+// like Lexer does. Ties go to the earlier rule: keywords over identifiers,
+// and a lone '"' at end of input reads as a literal, not an unterminated
+// string.
+//
+// The table is byte-based and knows no Unicode classes, so words and
+// symbols stay ASCII; processDfa hands tokens that start with, or run
+// into, a non-ASCII byte to Lexer. Character literals do take a whole
+// UTF-8 sequence, spelled out byte by byte.
+enum : int { DFA_ERROR = 16, DFA_SKIP = 32, DFA_NUMBER = 48 };
+
+static DfaSpec cTokenSpec() {
+    const string utf8Char =
+        "([\\xC2-\\xDF][\\x80-\\xBF]|\\xE0[\\xA0-\\xBF][\\x80-\\xBF]|[\\xE1-\\xEC\\xEE\\xEF][\\x80-\\xBF][\\x80-\\xBF]|"
+        "\\xED[\\x80-\\x9F][\\x80-\\xBF]|\\xF0[\\x90-\\xBF][\\x80-\\xBF][\\x80-\\xBF]|"
+        "[\\xF1-\\xF3][\\x80-\\xBF][\\x80-\\xBF][\\x80-\\xBF]|\\xF4[\\x80-\\x8F][\\x80-\\xBF][\\x80-\\xBF])";
+    DfaSpec spec;
+    for (string_view kw : CKeywords::words) spec.literal(kw, int(TokenKind::Keyword));
+    spec.regex("[A-Za-z_][A-Za-z0-9_]*", int(TokenKind::Id));
+    spec.regex("[A-Za-z_][A-Za-z0-9_.]*", DFA_ERROR + int(LexErrorKind::InvalidToken));
+    spec.regex("[0-9]([A-Za-z0-9_.]|[eEpP][+-][0-9])*", DFA_NUMBER);
+    for (string_view op : COperators::words) spec.literal(op, int(TokenKind::Op));
+    spec.regex("[(){};,]", int(TokenKind::Special));
+    spec.regex("[ \\t\\n\\v\\f\\r]+", DFA_SKIP);
+    spec.regex("//[^\\n]*\\n?", DFA_SKIP);
+    spec.regex("/\\*([^*]|\\*+[^*/])*\\*+/", DFA_SKIP);
+    spec.regex("/\\*([^*]|\\*+[^*/])*\\**", DFA_SKIP);           // unterminated: runs to the end
+    spec.regex("\"[^\"]*\"", int(TokenKind::Literal));
+    spec.literal("\"", int(TokenKind::Literal));
+    spec.regex("\"[^\"]*", DFA_ERROR + int(LexErrorKind::UnterminatedString));
+    spec.regex("'.'", int(TokenKind::Literal));
+    spec.regex("'" + utf8Char + "'", int(TokenKind::Literal));
+    spec.regex("'(" + utf8Char + "|.)?.?", DFA_ERROR + int(LexErrorKind::UnterminatedChar));
+    spec.regex(".", DFA_ERROR + int(LexErrorKind::UnrecognizedSymbol));
+    return spec;
+}
+
+// Whole-file mode driven by the generated table: every step of the scan
+// is one table lookup per byte, and every byte belongs to some match.
+void processDfa(const string& filename, bool stats) {
+    static const DfaTable dfa(cTokenSpec());
+    if (stats)
+        cerr << "dfa: " << dfa.stateCount() << " states, " << dfa.classes() << " byte classes, "
+             << dfa.tableBytes() << " table bytes\n";
+
+    ifstream file(filename, ios::binary);
+    if (!file) {
+        cerr << "Error opening file.\n";
+        return;
+    }
+    source = readAll(file, session);
+    SourceBuffer src(source);
+    const char* begin = source.data();
+    const char* end = begin + source.size();
+
+    for (const char* p = begin; p < end; ) {
+        int value;
+        size_t n = dfa.match(p, end, value);
+        uint32_t at = uint32_t(p - begin);
+        bool word = value == DFA_NUMBER || value == int(TokenKind::Keyword) || value == int(TokenKind::Id) ||
+                    value == DFA_ERROR + int(LexErrorKind::InvalidToken);
+        if ((unsigned char)*p >= 0x80 || (word && p + n < end && (unsigned char)p[n] >= 0x80)) {
+            Lexer<CKeywords, COperators> lex(begin, p, end, end);
+            LexToken t;
+            lex.next(t);
+            p += t.text.size();
+            if (t.kind == TokenKind::Error)
+                error_messages.push_back(errorAt(src, t.error, at, t.text));
+            else
+                tokens.push_back({at, uint32_t(t.text.size()), t.kind});
             continue;
         }
-
-        // Handle character literals
-        if (ch == '\'') {
-            string literal = "'";
-            int start_line = current_line;
-            file.get(ch);
-            literal += ch;
-            if (file.get() == '\'') {
-                literal += "'";
-                tokens.push_back({"<literal>", literal, start_line});
-            } else {
-                error_messages.push_back("Error at line " + to_string(start_line) + 
-                                      ": Unterminated character literal");
-            }
+        p += n;
+        if (value == DFA_SKIP) {
+            if (begin[at] == '/') checkUtf8(src, at, n);        // a comment
             continue;
         }
+        if (value == DFA_NUMBER) {
+            NumberValue number;
+            NumberError e = decodeNumber(string_view(begin + at, n), number);
+            if (e == NumberError::None) value = int(TokenKind::Num);
+            else if (e == NumberError::OutOfRange) value = DFA_ERROR + int(LexErrorKind::NumberOutOfRange);
+            else value = DFA_ERROR + int(LexErrorKind::InvalidToken);
+        }
+        if (value >= DFA_ERROR)
+            error_messages.push_back(errorAt(src, LexErrorKind(value - DFA_ERROR), at, string_view(begin + at, n)));
+        else
+            tokens.push_back({at, uint32_t(n), TokenKind(value)});
+        if (value == int(TokenKind::Literal)) checkUtf8(src, at, n);
+    }
+
+    displayTokens(src, tokens.size(), tokens.kind, tokens.offset, tokens.length);
+}
+
+// A whole number filling `s`, with nothing before or after it.
+template <class T>
+static bool parseNumber(const string& s, T& value) {
+    const char* end = s.data() + s.size();
+    from_chars_result r = from_chars(s.data(), end, value);
+    return r.ec == errc() && r.ptr == end;
+}
+
+struct Edit {
+    size_t offset, removed;
+    string inserted;
+};
+
+// --edit=OFFSET:REMOVED:TEXT, with \n and \\ escapes in TEXT.
+static bool parseEdit(const string& spec, Edit& e) {
+    size_t c1 = spec.find(':'), c2 = spec.find(':', c1 + 1);
+    if (c1 == string::npos || c2 == string::npos) return false;
+    if (!parseNumber(spec.substr(0, c1), e.offset) || !parseNumber(spec.substr(c1 + 1, c2 - c1 - 1), e.removed))
+        return false;
+    e.inserted.clear();
+    for (size_t i = c2 + 1; i < spec.size(); i++) {
+        if (spec[i] == '\\' && i + 1 < spec.size()) {
+            char n = spec[++i];
+            e.inserted += n == 'n' ? '\n' : n;
+        } else {
+            e.inserted += spec[i];
+        }
+    }
+    return true;
+}
+
+// Prints the listing of a token stream written by --emit-tokens, as the
+// run that wrote it would have, from the first token on `fromLine` on.
+void processArchive(const string& filename, int fromLine) {
+    ifstream file(filename, ios::binary);
+    if (!file) {
+        cerr << "Error opening file.\n";
+        return;
+    }
+    TokenStreamReader archive(readAll(file, session));
+    TokenStreamReader::Cursor cursor = archive.fromLine(fromLine);
+    displayResults([&](LexToken& t) { return cursor.next(t); });
+}
+
+// Applies the edits one by one through an IncrementalLexer, as an editor
+// would, and prints the listing of the edited buffer.
+void processEdits(const string& filename, const vector<Edit>& edits, bool timing) {
+    ifstream file(filename, ios::binary);
+    if (!file) {
+        cerr << "Error opening file.\n";
+        return;
+    }
+    string text(istreambuf_iterator<char>(file), {});
+    IncrementalLexer<CKeywords, COperators> doc(text);
+
+    for (const Edit& e : edits) {
+        auto t0 = chrono::steady_clock::now();
+        size_t relexed = doc.edit(e.offset, e.removed, e.inserted);
+        auto t1 = chrono::steady_clock::now();
+        if (timing)
+            cerr << "edit at " << e.offset << ": relexed " << relexed << " of " << doc.size()
+                 << " tokens in " << chrono::duration<double, micro>(t1 - t0).count() << " us\n";
+    }
 
-        // Handle words (identifiers/keywords/numbers)
-        if (isalpha(ch) || ch == '_' || isdigit(ch)) {
-            word = ch;
-            int start_line = current_line;
-            while (file.peek() && (isalnum(file.peek()) || file.peek() == '_' || file.peek() == '.')) {
-                file.get(ch);
-                if (ch == '\n') current_line++;
-                word += ch;
+    size_t i = 0;
+    displayResults([&](LexToken& t) {
+        if (i == doc.size()) return false;
+        t = doc[i++];
+        return true;
+    });
+}
+
+int main(int argc, char* argv[]) {
+    string filename;
+    bool throughput = false, useDfa = false;
+    unsigned jobs = 1;
+    vector<Edit> edits;
+    string cacheDir, profileTo, emitTo;
+    uint64_t cacheMB = 256;
+    bool readTokens = false;
+    int fromLine = 0;
+    filename = "hello.cpp";
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        Edit e;
+        if (arg == "--throughput") throughput = true;
+        else if (arg == "--dfa") useDfa = true;
+        else if (arg.rfind("--jobs=", 0) == 0) {
+            if (!parseNumber(arg.substr(7), jobs) || jobs == 0) {
+                cerr << "Bad --jobs value '" << arg.substr(7) << "' (expected a positive number)\n";
+                return 1;
             }
-            
-            if (isKeyword(word)) {
-                tokens.push_back({"<keyword>", word, start_line});
-            } else if (isNumber(word)) {
-                tokens.push_back({"<num>", word, start_line});
-            } else if (isValidIdentifier(word)) {
-                tokens.push_back({"<id>", word, start_line});
-            } else {
-                error_messages.push_back("Error at line " + to_string(start_line) + 
-                                      ": Invalid token '" + word + "'");
+        }
+        else if (arg == "--parallel") jobs = max(1u, thread::hardware_concurrency());
+        else if (arg.rfind("--edit=", 0) == 0) {
+            if (!parseEdit(arg.substr(7), e)) {
+                cerr << "Bad edit '" << arg.substr(7) << "' (expected OFFSET:REMOVED:TEXT)\n";
+                return 1;
             }
-            continue;
+            edits.push_back(e);
         }
-
-        // Handle operators
-        if (isOperator(string(1, ch))) {
-            string op(1, ch);
-            if (isOperator(string(1, file.peek()))) {
-                string potentialOp = op + string(1, file.peek());
-                if (isOperator(potentialOp)) {
-                    file.get();
-                    op = potentialOp;
-                }
+        else if (arg.rfind("--cache=", 0) == 0) cacheDir = arg.substr(8);
+        else if (arg.rfind("--cache-size=", 0) == 0) {
+            if (!parseNumber(arg.substr(13), cacheMB) || cacheMB > UINT64_MAX >> 20) {
+                cerr << "Bad --cache-size value '" << arg.substr(13) << "' (expected a number of MB)\n";
+                return 1;
             }
-            tokens.push_back({"<op>", op, current_line});
-            continue;
         }
-
-        // Handle special symbols
-        if (isSpecialSymbol(ch)) {
-            tokens.push_back({"<special symbol>", string(1, ch), current_line});
-            continue;
+        else if (arg == "--profile") profileTo = "-";
+        else if (arg.rfind("--profile=", 0) == 0) profileTo = arg.substr(10);
+        else if (arg.rfind("--emit-tokens=", 0) == 0) emitTo = arg.substr(14);
+        else if (arg == "--read-tokens") readTokens = true;
+        else if (arg.rfind("--from-line=", 0) == 0) {
+            if (!parseNumber(arg.substr(12), fromLine)) {
+                cerr << "Bad --from-line value '" << arg.substr(12) << "' (expected a line number)\n";
+                return 1;
+            }
         }
-
-        // Generate error message for unrecognized symbols
-        error_messages.push_back("Error at line " + to_string(current_line) + 
-                              ": Unrecognized symbol '" + string(1, ch) + "'");
+        else filename = arg;
     }
 
-    file.close();
-}
+    // Only the streaming lexer is instrumented
+    if (!profileTo.empty() && (!edits.empty() || !cacheDir.empty() || useDfa || jobs > 1)) {
+        cerr << "--profile only applies to the default single-threaded mode\n";
+        return 1;
+    }
 
-void displayResults() {
-    cout << "\n--- Token Listing ---\n";
-    for (const auto& token : tokens) {
-        cout << "[Line " << token.line << "] " << token.type << " : " << token.value << endl;
+    // The whole-file modes keep diagnostics apart from the tokens, so only
+    // the streaming modes can archive a complete stream
+    if (!emitTo.empty() && (!cacheDir.empty() || useDfa || jobs > 1 || !profileTo.empty() || readTokens)) {
+        cerr << "--emit-tokens only applies to the default single-threaded mode and --edit\n";
+        return 1;
+    }
+    if (fromLine && !readTokens) {
+        cerr << "--from-line only applies to --read-tokens\n";
+        return 1;
     }
 
-    // Display error messages
-    if (!error_messages.empty()) {
-        cout << "\n--- Errors ---\n";
-        for (const auto& msg : error_messages) {
-            cout << msg << endl;
+    if (readTokens) {
+        try {
+            processArchive(filename, fromLine);
+        } catch (const runtime_error& ex) {
+            cerr << ex.what() << endl;
+            return 1;
         }
+        return 0;
     }
 
-    // Count statistics
-    int keywordCount = 0, idCount = 0, numCount = 0;
-    int opCount = 0, specialCount = 0, literalCount = 0;
-
-    for (const auto& token : tokens) {
-        if (token.type == "<keyword>") keywordCount++;
-        else if (token.type == "<id>") idCount++;
-        else if (token.type == "<num>") numCount++;
-        else if (token.type == "<op>") opCount++;
-        else if (token.type == "<special symbol>") specialCount++;
-        else if (token.type == "<literal>") literalCount++;
+    ofstream archiveFile;
+    unique_ptr<TokenStreamWriter> archive;
+    if (!emitTo.empty()) {
+        archiveFile.open(emitTo, ios::binary);
+        if (!archiveFile) {
+            cerr << "Cannot write tokens to " << emitTo << endl;
+            return 1;
+        }
+        archive = make_unique<TokenStreamWriter>(archiveFile);
+        tokenArchive = archive.get();
     }
 
-    cout << "\n--- Token Summary ---\n";
-    cout << "Total <keyword> tokens: " << keywordCount << endl;
-    cout << "Total <id> tokens: " << idCount << endl;
-    cout << "Total <num> tokens: " << numCount << endl;
-    cout << "Total <op> tokens: " << opCount << endl;
-    cout << "Total <special symbol> tokens: " << specialCount << endl;
-    cout << "Total <literal> tokens: " << literalCount << endl;
-    cout << "Total errors: " << error_messages.size() << endl;
-}
+    if (!edits.empty()) {
+        try {
+            processEdits(filename, edits, throughput);
+        } catch (const out_of_range& ex) {
+            cerr << ex.what() << endl;
+            return 1;
+        }
+        if (archive) archive->finish();
+        return 0;
+    }
 
-int main() {
-    string filename;
-    filename="hello.cpp";
+    auto t0 = chrono::steady_clock::now();
+    if (!cacheDir.empty()) {
+        TokenCache cache(cacheDir, cacheMB << 20);
+        processCached(filename, cache);
+    } else if (useDfa) {
+        processDfa(filename, throughput);
+    } else {
+        processFile(filename, jobs, profileTo);
+    }
+    if (archive) archive->finish();
+    auto t1 = chrono::steady_clock::now();
 
-    processFile(filename);
-    displayResults();
+    // Lexing rate (including printing) goes to stderr so stdout stays
+    // comparable between builds
+    if (throughput) {
+        ifstream in(filename, ios::binary | ios::ate);
+        double mb = in ? in.tellg() / 1e6 : 0.0;
+        double sec = chrono::duration<double>(t1 - t0).count();
+        cerr << "lexed " << mb << " MB in " << sec << " s (" << mb / sec
+             << " MB/s, " << lexKernels.name << " kernels)\n";
+    }
 
     return 0;
 }
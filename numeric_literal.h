@@ -0,0 +1,173 @@
+#ifndef NUMERIC_LITERAL_H
+#define NUMERIC_LITERAL_H
+
+// C numeric literals decoded once, when they are scanned, so that nothing
+// downstream has to parse the text again.
+//
+//     NumberValue v;
+//     if (decodeNumber("0x1Fu", v) == NumberError::None)
+//         ...    // v.type == NumberType::UnsignedInt, v.integer == 31
+//
+// Integers: decimal, octal (leading 0), hex (0x) and binary (0b), with u,
+// l and ll suffixes in either order and either case. They take the first
+// type of C's list for their base and suffix that can hold the value
+// (LP64: long is 64 bits). A decimal too big for long long becomes
+// unsigned long long, as GCC does.
+//
+// Floating: a fraction and/or an exponent in decimal, or a hex mantissa
+// with a p exponent, with an f or l suffix. Long double values are kept
+// as double.
+//
+// The digits go through std::from_chars. OutOfRange means the value does
+// not fit the widest type the literal may have. Anything else that is not
+// a well-formed literal (a bad digit, a bad suffix, "0x") is Malformed.
+
+#include <cfloat>
+#include <charconv>
+#include <climits>
+#include <cstdint>
+#include <string_view>
+#include <system_error>
+
+enum class NumberType : uint8_t {
+    Int, UnsignedInt, Long, UnsignedLong, LongLong, UnsignedLongLong, Float, Double, LongDouble
+};
+
+inline const char* numberTypeName(NumberType t) {
+    static const char* const names[] = {"int", "unsigned int", "long", "unsigned long", "long long",
+                                        "unsigned long long", "float", "double", "long double"};
+    return names[(int)t];
+}
+
+struct NumberValue {
+    NumberType type = NumberType::Int;
+    uint64_t integer = 0;       // integer types
+    double real = 0;            // floating types
+
+    bool isReal() const { return type >= NumberType::Float; }
+};
+
+enum class NumberError : uint8_t { None, Malformed, OutOfRange };
+
+namespace numeric_literal_detail {
+
+inline bool isDigitIn(char c, int base) {
+    if (c >= '0' && c <= '9') return true;       // 8 and 9 in octal or binary: checked by from_chars
+    return base == 16 && ((c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F'));
+}
+
+inline NumberError integerType(uint64_t value, bool decimal, bool isUnsigned, int longs, NumberValue& v) {
+    struct Candidate {
+        NumberType type;
+        uint64_t max;
+        bool isUnsigned;
+        int longs;
+    };
+    static const Candidate all[] = {
+        {NumberType::Int, INT_MAX, false, 0},
+        {NumberType::UnsignedInt, UINT_MAX, true, 0},
+        {NumberType::Long, LONG_MAX, false, 1},
+        {NumberType::UnsignedLong, ULONG_MAX, true, 1},
+        {NumberType::LongLong, LLONG_MAX, false, 2},
+        {NumberType::UnsignedLongLong, ULLONG_MAX, true, 2},
+    };
+    for (const Candidate& c : all) {
+        if (c.longs < longs || (isUnsigned && !c.isUnsigned)) continue;
+        if (decimal && !isUnsigned && c.isUnsigned && c.type != NumberType::UnsignedLongLong) continue;
+        if (value <= c.max) {
+            v.type = c.type;
+            v.integer = value;
+            return NumberError::None;
+        }
+    }
+    return NumberError::OutOfRange;
+}
+
+}  // namespace numeric_literal_detail
+
+inline NumberError decodeNumber(std::string_view text, NumberValue& v) {
+    using namespace numeric_literal_detail;
+    v = NumberValue();
+    const char* s = text.data();
+    const char* end = s + text.size();
+
+    int base = 10;
+    const char* digits = s;
+    if (text.size() >= 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) base = 16, digits = s + 2;
+    else if (text.size() >= 2 && s[0] == '0' && (s[1] == 'b' || s[1] == 'B')) base = 2, digits = s + 2;
+
+    // Mantissa, then an optional exponent: e for decimal, p for hex.
+    const char* p = digits;
+    bool real = false, negativeExponent = false;
+    while (p < end && isDigitIn(*p, base)) p++;
+    if (p < end && *p == '.') {
+        real = true;
+        p++;
+        while (p < end && isDigitIn(*p, base)) p++;
+    }
+    if (p == digits || (real && p == digits + 1)) return NumberError::Malformed;
+    char mark = base == 16 ? 'p' : 'e';
+    if (base != 2 && p < end && (*p | 0x20) == mark) {
+        const char* e = p + 1;
+        if (e < end && (*e == '+' || *e == '-')) negativeExponent = *e++ == '-';
+        if (e == end || *e < '0' || *e > '9') return NumberError::Malformed;
+        while (e < end && *e >= '0' && *e <= '9') e++;
+        real = true;
+        p = e;
+    } else if (real && base == 16) {
+        return NumberError::Malformed;              // a hex fraction needs its exponent
+    }
+    if (real && base == 2) return NumberError::Malformed;
+    std::string_view suffix(p, end - p);
+
+    if (real) {
+        double d;
+        std::from_chars_result r = base == 16 ? std::from_chars(digits, p, d, std::chars_format::hex)
+                                              : std::from_chars(s, p, d);
+        if (r.ec == std::errc::result_out_of_range) {
+            if (!negativeExponent) return NumberError::OutOfRange;
+            d = 0;                                  // underflow: the nearest value is zero
+        } else if (r.ec != std::errc() || r.ptr != p) {
+            return NumberError::Malformed;
+        }
+        if (suffix.empty()) {
+            v.type = NumberType::Double;
+        } else if (suffix.size() == 1 && (suffix[0] | 0x20) == 'f') {
+            if (d > FLT_MAX) return NumberError::OutOfRange;
+            v.type = NumberType::Float;
+            d = float(d);
+        } else if (suffix.size() == 1 && (suffix[0] | 0x20) == 'l') {
+            v.type = NumberType::LongDouble;
+        } else {
+            return NumberError::Malformed;
+        }
+        v.real = d;
+        return NumberError::None;
+    }
+
+    // Integer suffix: at most one u and one l/ll (not lL), in either order.
+    bool isUnsigned = false;
+    int longs = 0;
+    for (size_t i = 0; i < suffix.size(); ) {
+        char c = suffix[i];
+        if ((c | 0x20) == 'u' && !isUnsigned) {
+            isUnsigned = true;
+            i++;
+        } else if ((c | 0x20) == 'l' && longs == 0) {
+            longs = i + 1 < suffix.size() && suffix[i + 1] == c ? 2 : 1;
+            i += longs;
+        } else {
+            return NumberError::Malformed;
+        }
+    }
+
+    bool decimal = base == 10;
+    if (base == 10 && p - digits > 1 && digits[0] == '0') base = 8, digits++;
+    uint64_t value;
+    std::from_chars_result r = std::from_chars(digits, p, value, base);
+    if (r.ec == std::errc::result_out_of_range) return NumberError::OutOfRange;
+    if (r.ec != std::errc() || r.ptr != p) return NumberError::Malformed;
+    return integerType(value, decimal, isUnsigned, longs, v);
+}
+
+#endif
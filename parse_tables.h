@@ -0,0 +1,250 @@
+#ifndef PARSE_TABLES_H
+#define PARSE_TABLES_H
+
+// Parse tables written to a file once and used in place on later runs.
+//
+//     CacheKey key = makeCacheKey(grammarText, "my_parser/1");
+//     TableImage tables;
+//     if (!tables.load(file, key)) {
+//         ... analyse the grammar ...
+//         CacheWriter w;
+//         addSymbolIndex(w, TABLE_SYMBOLS, names);
+//         addPackedTable(w, TABLE_ACTION, dense, rows, columns, 0);
+//         tables = TableImage(w, key);
+//         tables.save(file);
+//     }
+//     SymbolIndex symbols;
+//     PackedTable action;
+//     tables.get(TABLE_SYMBOLS, symbols) && tables.get(TABLE_ACTION, action);
+//
+// A table file is a token_cache.h entry: a versioned header, a section
+// table and 8-byte aligned sections. Everything in it is an index or an
+// offset from the start of the file, so it is read straight from a
+// read-only mapping and nothing is rebuilt. The key is a hash of the
+// grammar text and a tool string, so tables for another grammar, or from
+// another program, fail to load. Tables built in memory are the same
+// image held in a string, so a parser reads them the same way either way.
+//
+// Sparse tables are comb-compressed (row displacement): the entries of
+// each row go into one shared array, at the first offset where they do
+// not collide with the rows already placed, and each slot records which
+// row owns it. A lookup is an add and a compare. Symbol names are kept in
+// an open-addressed hash table of name indices, hashed with xxh64.
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <unistd.h>
+#include "token_cache.h"
+
+struct PackedTableHeader {
+    uint32_t rows, columns;
+    int32_t empty;
+    uint32_t reserved;
+};
+
+// A packed table: sections id (the header), id + 1 (a base offset per
+// row), id + 2 (the row owning each slot) and id + 3 (the values).
+struct PackedTable {
+    uint32_t rows = 0, columns = 0;
+    int32_t empty = 0;
+    CacheArray<uint32_t> base, check;
+    CacheArray<int32_t> value;
+
+    // row must be < rows; any column is fine, one outside the table is empty.
+    int32_t operator()(uint32_t row, uint32_t column) const {
+        uint32_t i = base[row] + column;        // wraps for columns left of the row's first entry
+        return i < check.size && check[i] == row ? value[i] : empty;
+    }
+};
+
+// A symbol index: sections id (the names, back to back), id + 1 (where
+// each name starts, plus the end) and id + 2 (the hash slots).
+struct SymbolIndex {
+    std::string_view text;
+    CacheArray<uint32_t> offsets, slots;
+
+    size_t size() const { return offsets.size - 1; }
+    std::string_view operator[](size_t i) const {
+        return text.substr(offsets[i], offsets[i + 1] - offsets[i]);
+    }
+
+    // The index of `name`, or -1.
+    int64_t find(std::string_view name) const {
+        size_t mask = slots.size - 1;
+        for (size_t i = xxh64(name.data(), name.size()) & mask;; i = (i + 1) & mask) {
+            uint32_t s = slots[i];
+            if (s == UINT32_MAX) return -1;
+            if ((*this)[s] == name) return s;
+        }
+    }
+};
+
+template <class T>
+void addPackedTable(CacheWriter &w, uint32_t id, const std::vector<T> &dense, uint32_t rows,
+                    uint32_t columns, T empty) {
+    // Fullest rows first: they are the hardest to fit once the array fills up.
+    std::vector<std::vector<uint32_t>> entries(rows);
+    for (uint32_t r = 0; r < rows; r++)
+        for (uint32_t c = 0; c < columns; c++)
+            if (dense[size_t(r) * columns + c] != empty) entries[r].push_back(c);
+    std::vector<uint32_t> order(rows);
+    for (uint32_t r = 0; r < rows; r++) order[r] = r;
+    std::stable_sort(order.begin(), order.end(),
+                     [&](uint32_t a, uint32_t b) { return entries[a].size() > entries[b].size(); });
+
+    std::vector<uint32_t> base(rows, 0), check;
+    std::vector<int32_t> value;
+    // A row is tried from `columns` slots before the end of the array on:
+    // the holes a row can still fill are among the last rows placed, and
+    // past the end it always fits, so each row tries at most `columns`
+    // offsets however large the array grows.
+    size_t firstFree = 0;
+    for (uint32_t r : order) {
+        const std::vector<uint32_t> &cols = entries[r];
+        if (cols.empty()) continue;
+        auto fits = [&](size_t slot) {
+            for (uint32_t c : cols) {
+                size_t i = slot + c - cols[0];
+                if (i < check.size() && check[i] != UINT32_MAX) return false;
+            }
+            return true;
+        };
+        size_t slot = std::max(firstFree, check.size() > columns ? check.size() - columns : 0);
+        while (!fits(slot)) slot++;
+        base[r] = uint32_t(slot - cols[0]);
+        if (slot + cols.back() - cols[0] >= check.size()) {
+            check.resize(slot + cols.back() - cols[0] + 1, UINT32_MAX);
+            value.resize(check.size(), int32_t(empty));
+        }
+        for (uint32_t c : cols) {
+            size_t i = slot + c - cols[0];
+            check[i] = r;
+            value[i] = int32_t(dense[size_t(r) * columns + c]);
+        }
+        while (firstFree < check.size() && check[firstFree] != UINT32_MAX) firstFree++;
+    }
+
+    PackedTableHeader h = {rows, columns, int32_t(empty), 0};
+    w.add(id, &h, sizeof h);
+    w.add(id + 1, base);
+    w.add(id + 2, check);
+    w.add(id + 3, value);
+}
+
+inline void addSymbolIndex(CacheWriter &w, uint32_t id, const std::vector<std::string> &names) {
+    std::string text;
+    std::vector<uint32_t> offsets;
+    for (const std::string &name : names) {
+        offsets.push_back(uint32_t(text.size()));
+        text += name;
+    }
+    offsets.push_back(uint32_t(text.size()));
+
+    size_t n = 2;
+    while (n < 2 * names.size()) n <<= 1;
+    std::vector<uint32_t> slots(n, UINT32_MAX);
+    for (uint32_t s = 0; s < names.size(); s++) {
+        size_t i = xxh64(names[s].data(), names[s].size()) & (n - 1);
+        while (slots[i] != UINT32_MAX) i = (i + 1) & (n - 1);
+        slots[i] = s;
+    }
+
+    w.add(id, text.data(), text.size());
+    w.add(id + 1, offsets);
+    w.add(id + 2, slots);
+}
+
+// A table file, mapped, or an image built in memory.
+class TableImage {
+    CacheEntry mapped;
+    std::string built;
+    const char *base = nullptr;
+
+public:
+    TableImage() = default;
+    TableImage(const CacheWriter &w, const CacheKey &key) : built(w.image(key)), base(built.data()) {}
+    TableImage(TableImage &&o) noexcept { *this = std::move(o); }
+    TableImage &operator=(TableImage &&o) noexcept {
+        mapped = std::move(o.mapped);
+        built = std::move(o.built);
+        base = o.base;
+        o.base = nullptr;
+        return *this;
+    }
+
+    explicit operator bool() const { return base != nullptr; }
+    size_t size() const { return mapped ? mapped.size() : built.size(); }
+
+    // False if the file is missing, damaged, of another format version or
+    // for another key; the image is left as it was.
+    bool load(const std::string &file, const CacheKey &key) {
+        CacheEntry entry = mapCacheFile(file, key);
+        if (!entry) return false;
+        mapped = std::move(entry);
+        built.clear();
+        base = mapped.data();
+        return true;
+    }
+
+    bool save(const std::string &file) const {
+        return base && replaceFile(file, file + ".tmp." + std::to_string(getpid()),
+                                   std::string_view(base, size()));
+    }
+
+    std::string_view section(uint32_t id) const { return token_cache_detail::section(base, id); }
+
+    template <class T>
+    CacheArray<T> array(uint32_t id) const {
+        std::string_view s = section(id);
+        return {reinterpret_cast<const T *>(s.data()), s.size() / sizeof(T)};
+    }
+
+    // A fixed-size record, or null if the section is missing or the wrong size.
+    template <class T>
+    const T *record(uint32_t id) const {
+        std::string_view s = section(id);
+        return s.size() == sizeof(T) ? reinterpret_cast<const T *>(s.data()) : nullptr;
+    }
+
+    // The views below are checked once here, so lookups need no checks of
+    // their own. False if a section is missing or inconsistent.
+    bool get(uint32_t id, PackedTable &t) const {
+        const PackedTableHeader *h = record<PackedTableHeader>(id);
+        if (!h) return false;
+        t.rows = h->rows;
+        t.columns = h->columns;
+        t.empty = h->empty;
+        t.base = array<uint32_t>(id + 1);
+        t.check = array<uint32_t>(id + 2);
+        t.value = array<int32_t>(id + 3);
+        return t.base.size == t.rows && t.value.size == t.check.size;
+    }
+
+    bool get(uint32_t id, SymbolIndex &s) const {
+        s.text = section(id);
+        s.offsets = array<uint32_t>(id + 1);
+        s.slots = array<uint32_t>(id + 2);
+        if (s.offsets.size == 0 || s.offsets[0] != 0 || s.offsets[s.offsets.size - 1] != s.text.size())
+            return false;
+        for (size_t i = 1; i < s.offsets.size; i++)
+            if (s.offsets[i] < s.offsets[i - 1]) return false;
+        if (s.slots.size <= s.size() || (s.slots.size & (s.slots.size - 1)) != 0) return false;
+        for (uint32_t slot : s.slots)
+            if (slot != UINT32_MAX && slot >= s.size()) return false;
+        return true;
+    }
+};
+
+// LR actions as table entries: the kind in the low two bits and the state
+// or production above them. 0 is an error.
+enum LRKind { LR_ERROR, LR_SHIFT, LR_REDUCE, LR_ACCEPT };
+
+inline int32_t lrAction(LRKind kind, int32_t target = 0) { return target << 2 | kind; }
+inline LRKind lrKind(int32_t action) { return LRKind(action & 3); }
+inline int32_t lrTarget(int32_t action) { return action >> 2; }
+
+#endif
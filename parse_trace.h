@@ -0,0 +1,77 @@
+#ifndef PARSE_TRACE_H
+#define PARSE_TRACE_H
+
+// Opt-in step trace for the table-driven parsers.
+//
+//     template <class Tracer> bool parse(..., Tracer& trace);
+//     NoTrace quiet;             parse(..., quiet);      // just the answer
+//     Trace<SymbolId> steps;     parse(..., steps);      // then render it
+//
+// A parser calls step() once per action, before applying it, with the
+// production it uses (0 if none), the stack depth and the input position,
+// and finish() with its stack when it stops. NoTrace's hooks are empty
+// inline functions, so a parser instantiated with it is just its loop.
+//
+// Trace keeps the step records -- 12 bytes each -- in a ring buffer, so a
+// long parse keeps its last `capacity` steps and counts the rest. Nothing
+// is formatted while parsing: a program renders its own listing from the
+// records afterwards, if at all. Every step can be undone given the
+// grammar and the input, so the stack at the oldest kept step is found by
+// undoing the kept steps from the final stack, and the listing is then
+// replayed forward from there.
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+enum class TraceAction : uint8_t {
+    Match,      // top-down: the top of the stack matched the input symbol
+    Expand,     // top-down: a nonterminal was replaced by a production
+    Shift,
+    Reduce,
+    Accept,
+    Error
+};
+
+struct TraceStep {
+    TraceAction action;
+    uint16_t production;
+    uint32_t depth;         // stack size before the step
+    uint32_t input;         // input position before the step
+};
+
+struct NoTrace {
+    void step(TraceAction, size_t, size_t, size_t) {}
+    template <class StackSymbol> void finish(const std::vector<StackSymbol>&) {}
+};
+
+template <class StackSymbol>
+class Trace {
+public:
+    explicit Trace(size_t capacity = 1 << 16) {
+        size_t n = 1;
+        while (n < capacity) n <<= 1;
+        ring.resize(n);
+    }
+
+    void step(TraceAction action, size_t production, size_t depth, size_t input) {
+        ring[total & (ring.size() - 1)] = TraceStep{action, uint16_t(production), uint32_t(depth), uint32_t(input)};
+        total++;
+    }
+    void finish(const std::vector<StackSymbol>& stack) { last = stack; }
+
+    // The kept steps, oldest first, and how many older ones were dropped.
+    size_t size() const { return total < ring.size() ? size_t(total) : ring.size(); }
+    uint64_t dropped() const { return total - size(); }
+    const TraceStep& operator[](size_t i) const { return ring[(dropped() + i) & (ring.size() - 1)]; }
+
+    // The stack when the parser stopped.
+    const std::vector<StackSymbol>& finalStack() const { return last; }
+
+private:
+    std::vector<TraceStep> ring;
+    uint64_t total = 0;
+    std::vector<StackSymbol> last;
+};
+
+#endif
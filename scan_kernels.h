@@ -0,0 +1,327 @@
+#ifndef SCAN_KERNELS_H
+#define SCAN_KERNELS_H
+
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LEX_X86 1
+#endif
+
+// ---------------------------------------------------------------------------
+// Scanning kernels. The skip kernels return the first byte at or after p
+// that ends the run they are looking for (or end); the newline kernels
+// count or list every '\n' in [p, end); the UTF-8 kernels return the first
+// byte of the first sequence in [p, end) that is invalid or cut off by
+// end (or end). The SSE2/AVX2 variants classify 16/32 bytes per step; the
+// scalar ones handle short tails and non-x86 builds.
+// ---------------------------------------------------------------------------
+
+static inline bool isWordByte(unsigned char c) {
+    return isalnum(c) || c == '_' || c == '.';
+}
+
+static inline bool isSpaceByte(unsigned char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static const char* skipWordScalar(const char* p, const char* end) {
+    while (p < end && isWordByte(*p)) p++;
+    return p;
+}
+
+static const char* skipSpaceScalar(const char* p, const char* end) {
+    while (p < end && isSpaceByte(*p)) p++;
+    return p;
+}
+
+static size_t countNewlinesScalar(const char* p, const char* end) {
+    size_t n = 0;
+    while (p < end) n += (*p++ == '\n');
+    return n;
+}
+
+// Length of the well-formed UTF-8 sequence at p (1 to 4), or 0 if the
+// bytes there are not one: a stray continuation byte, an overlong form, a
+// surrogate, a code point past U+10FFFF, or a sequence cut off by end.
+static inline size_t utf8SequenceLength(const char* p, const char* end) {
+    unsigned char c = p[0];
+    if (c < 0x80) return 1;
+    if (c < 0xC2 || c > 0xF4) return 0;
+    size_t need = c < 0xE0 ? 2 : c < 0xF0 ? 3 : 4;
+    if (size_t(end - p) < need) return 0;
+    unsigned char c1 = p[1];
+    if ((c == 0xE0 && c1 < 0xA0) || (c == 0xED && c1 > 0x9F) || (c == 0xF0 && c1 < 0x90) ||
+        (c == 0xF4 && c1 > 0x8F))
+        return 0;
+    for (size_t i = 1; i < need; i++)
+        if ((p[i] & 0xC0) != 0x80) return 0;
+    return need;
+}
+
+static const char* validateUtf8Scalar(const char* p, const char* end) {
+    while (p < end) {
+        uint64_t w;
+        if (end - p >= 8 && (memcpy(&w, p, 8), !(w & 0x8080808080808080ull))) {
+            p += 8;
+            continue;
+        }
+        if ((unsigned char)*p < 0x80) {
+            p++;
+            continue;
+        }
+        size_t n = utf8SequenceLength(p, end);
+        if (!n) return p;
+        p += n;
+    }
+    return end;
+}
+
+// Appends base + (offset of the byte after each '\n' from p).
+static void indexNewlinesScalar(const char* p, const char* end, uint32_t base, std::vector<uint32_t>& starts) {
+    for (const char* q = p; q < end; q++)
+        if (*q == '\n') starts.push_back(base + uint32_t(q - p) + 1);
+}
+
+#ifdef LEX_X86
+// Signed-compare trick: c is in [lo, hi] iff (c - lo - 128) < (hi - lo - 127) as int8.
+#define IN_RANGE_128(v, lo, hi) \
+    _mm_cmplt_epi8(_mm_sub_epi8(v, _mm_set1_epi8((char)((lo) + 128))), _mm_set1_epi8((char)((hi) - (lo) - 127)))
+#define IN_RANGE_256(v, lo, hi) \
+    _mm256_cmpgt_epi8(_mm256_set1_epi8((char)((hi) - (lo) - 127)), _mm256_sub_epi8(v, _mm256_set1_epi8((char)((lo) + 128))))
+
+__attribute__((target("sse2")))
+static const char* skipWordSSE2(const char* p, const char* end) {
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+        __m128i m = _mm_or_si128(IN_RANGE_128(lower, 'a', 'z'), IN_RANGE_128(v, '0', '9'));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('.')));
+        unsigned bits = ~(unsigned)_mm_movemask_epi8(m) & 0xFFFF;
+        if (bits) return p + __builtin_ctz(bits);
+        p += 16;
+    }
+    return skipWordScalar(p, end);
+}
+
+__attribute__((target("sse2")))
+static const char* skipSpaceSSE2(const char* p, const char* end) {
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        __m128i m = _mm_or_si128(IN_RANGE_128(v, '\t', '\r'), _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+        unsigned bits = ~(unsigned)_mm_movemask_epi8(m) & 0xFFFF;
+        if (bits) return p + __builtin_ctz(bits);
+        p += 16;
+    }
+    return skipSpaceScalar(p, end);
+}
+
+__attribute__((target("sse2")))
+static size_t countNewlinesSSE2(const char* p, const char* end) {
+    size_t n = 0;
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        n += __builtin_popcount((unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))));
+        p += 16;
+    }
+    return n + countNewlinesScalar(p, end);
+}
+
+__attribute__((target("sse2")))
+static void indexNewlinesSSE2(const char* p, const char* end, uint32_t base, std::vector<uint32_t>& starts) {
+    const char* q = p;
+    while (end - q >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)q);
+        unsigned bits = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+        for (uint32_t at = base + uint32_t(q - p) + 1; bits; bits &= bits - 1)
+            starts.push_back(at + __builtin_ctz(bits));
+        q += 16;
+    }
+    indexNewlinesScalar(q, end, base + uint32_t(q - p), starts);
+}
+
+// Skips ASCII 16 bytes at a time and checks the rest one sequence at a time.
+__attribute__((target("sse2")))
+static const char* validateUtf8SSE2(const char* p, const char* end) {
+    while (end - p >= 16) {
+        unsigned high = (unsigned)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)p));
+        if (!high) {
+            p += 16;
+            continue;
+        }
+        p += __builtin_ctz(high);
+        size_t n = utf8SequenceLength(p, end);
+        if (!n) return p;
+        p += n;
+    }
+    return validateUtf8Scalar(p, end);
+}
+
+__attribute__((target("avx2")))
+static const char* skipWordAVX2(const char* p, const char* end) {
+    while (end - p >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)p);
+        __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+        __m256i m = _mm256_or_si256(IN_RANGE_256(lower, 'a', 'z'), IN_RANGE_256(v, '0', '9'));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('.')));
+        unsigned bits = ~(unsigned)_mm256_movemask_epi8(m);
+        if (bits) return p + __builtin_ctz(bits);
+        p += 32;
+    }
+    return skipWordSSE2(p, end);
+}
+
+__attribute__((target("avx2")))
+static const char* skipSpaceAVX2(const char* p, const char* end) {
+    while (end - p >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)p);
+        __m256i m = _mm256_or_si256(IN_RANGE_256(v, '\t', '\r'), _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')));
+        unsigned bits = ~(unsigned)_mm256_movemask_epi8(m);
+        if (bits) return p + __builtin_ctz(bits);
+        p += 32;
+    }
+    return skipSpaceSSE2(p, end);
+}
+
+__attribute__((target("avx2,popcnt")))
+static size_t countNewlinesAVX2(const char* p, const char* end) {
+    size_t n = 0;
+    while (end - p >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)p);
+        n += __builtin_popcount((unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))));
+        p += 32;
+    }
+    return n + countNewlinesSSE2(p, end);
+}
+
+__attribute__((target("avx2")))
+static void indexNewlinesAVX2(const char* p, const char* end, uint32_t base, std::vector<uint32_t>& starts) {
+    const char* q = p;
+    while (end - q >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)q);
+        unsigned bits = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+        for (uint32_t at = base + uint32_t(q - p) + 1; bits; bits &= bits - 1)
+            starts.push_back(at + __builtin_ctz(bits));
+        q += 32;
+    }
+    indexNewlinesSSE2(q, end, base + uint32_t(q - p), starts);
+}
+
+// Keiser and Lemire's lookup validator ("Validating UTF-8 in less than one
+// instruction per byte"). Three 16-entry tables, indexed by the high and
+// low nibble of each byte's predecessor and the high nibble of the byte
+// itself, each give the set of errors that nibble allows; an error is any
+// bit left in all three. Third and fourth bytes are checked by whether the
+// byte two or three back was a 3- or 4-byte lead. All-ASCII blocks only
+// check that the block before did not end inside a sequence.
+//
+// The blocks only say whether there is an error, not where: at the first
+// bad block, the scalar kernel takes over from the start of the sequence
+// that runs into it, and so it does for the tail.
+__attribute__((target("avx2")))
+static const char* validateUtf8AVX2(const char* p, const char* end) {
+    enum : uint8_t {
+        TOO_SHORT = 1 << 0,     // lead not followed by a continuation byte
+        TOO_LONG = 1 << 1,      // continuation byte after ASCII
+        OVERLONG_3 = 1 << 2,    // E0 80..9F
+        TOO_LARGE = 1 << 3,     // F4 90..BF, F5..FF
+        SURROGATE = 1 << 4,     // ED A0..BF
+        OVERLONG_2 = 1 << 5,    // C0..C1
+        TOO_LARGE_1000 = 1 << 6,
+        OVERLONG_4 = 1 << 6,    // F0 80..8F
+        TWO_CONTS = 1 << 7,     // continuation after continuation: only right as a third or fourth byte
+        CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS,
+    };
+#define UTF8_TABLE(a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, q) \
+    _mm256_setr_epi8(a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, q, a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, q)
+    const __m256i byte1High = UTF8_TABLE(
+        TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+        TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+        TOO_SHORT | OVERLONG_2, TOO_SHORT, TOO_SHORT | OVERLONG_3 | SURROGATE,
+        TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4);
+    const __m256i byte1Low = UTF8_TABLE(
+        CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4, CARRY | OVERLONG_2, CARRY, CARRY,
+        CARRY | TOO_LARGE, CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE, CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000);
+    const __m256i byte2High = UTF8_TABLE(
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT);
+#undef UTF8_TABLE
+    // Bytes that would still need continuation bytes in the next block
+    const __m256i lastLeads = _mm256_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                               -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                               (char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1));
+    const __m256i lowNibble = _mm256_set1_epi8(0x0F);
+    const char* begin = p;
+    __m256i prev = _mm256_setzero_si256(), prevIncomplete = _mm256_setzero_si256();
+
+    while (end - p >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)p);
+        __m256i error;
+        if (!_mm256_movemask_epi8(v)) {
+            error = prevIncomplete;
+        } else {
+            __m256i carried = _mm256_permute2x128_si256(prev, v, 0x21);
+            __m256i prev1 = _mm256_alignr_epi8(v, carried, 15);
+            __m256i prev2 = _mm256_alignr_epi8(v, carried, 14);
+            __m256i prev3 = _mm256_alignr_epi8(v, carried, 13);
+            __m256i special = _mm256_and_si256(
+                _mm256_and_si256(
+                    _mm256_shuffle_epi8(byte1High, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), lowNibble)),
+                    _mm256_shuffle_epi8(byte1Low, _mm256_and_si256(prev1, lowNibble))),
+                _mm256_shuffle_epi8(byte2High, _mm256_and_si256(_mm256_srli_epi16(v, 4), lowNibble)));
+            __m256i thirdOrFourth = _mm256_or_si256(_mm256_subs_epu8(prev2, _mm256_set1_epi8((char)(0xE0 - 0x80))),
+                                                    _mm256_subs_epu8(prev3, _mm256_set1_epi8((char)(0xF0 - 0x80))));
+            error = _mm256_xor_si256(_mm256_and_si256(thirdOrFourth, _mm256_set1_epi8((char)0x80)), special);
+            prevIncomplete = _mm256_subs_epu8(v, lastLeads);
+        }
+        if (!_mm256_testz_si256(error, error)) break;
+        prev = v;
+        p += 32;
+    }
+
+    // Back up to the lead of the sequence that runs into p, if any
+    const char* q = p;
+    for (int k = 0; k < 3 && q > begin && (q[-1] & 0xC0) == 0x80; k++) q--;
+    if (q > begin && (unsigned char)q[-1] >= 0xC0) q--;
+    return validateUtf8Scalar(q, end);
+}
+#endif
+
+struct ScanKernels {
+    const char* name;
+    const char* (*skipWord)(const char*, const char*);
+    const char* (*skipSpace)(const char*, const char*);
+    size_t (*countNewlines)(const char*, const char*);
+    void (*indexNewlines)(const char*, const char*, uint32_t, std::vector<uint32_t>&);
+    const char* (*validateUtf8)(const char*, const char*);
+};
+
+// Picked once at startup from what the CPU reports.
+inline ScanKernels selectKernels() {
+#ifdef LEX_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return {"avx2", skipWordAVX2, skipSpaceAVX2, countNewlinesAVX2, indexNewlinesAVX2, validateUtf8AVX2};
+    if (__builtin_cpu_supports("sse2"))
+        return {"sse2", skipWordSSE2, skipSpaceSSE2, countNewlinesSSE2, indexNewlinesSSE2, validateUtf8SSE2};
+#endif
+    return {"scalar", skipWordScalar, skipSpaceScalar, countNewlinesScalar, indexNewlinesScalar,
+            validateUtf8Scalar};
+}
+
+inline const ScanKernels lexKernels = selectKernels();
+
+#endif
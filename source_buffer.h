@@ -0,0 +1,87 @@
+#ifndef SOURCE_BUFFER_H
+#define SOURCE_BUFFER_H
+
+// An in-memory source file and, built on first use, the offset at which
+// each of its lines starts. Lexers record only byte offsets; the line and
+// column of an offset are looked up here when a token or a diagnostic is
+// printed.
+//
+//     SourceBuffer src(text);
+//     LineCol at = src.locate(offset);          // binary search
+//
+//     LineCursor cursor(src);                   // for ascending offsets,
+//     for (...) cursor.locate(tok.offset);      // e.g. printing a listing
+//
+// Lines and columns count from 1. A column counts bytes, and a tab is one
+// column. The index is one vectorised pass over the text (indexNewlines in
+// scan_kernels.h), 4 bytes per line. Offsets are 32-bit, like the token
+// tables. The first locate() builds the index, so call lineStarts() once
+// before sharing a SourceBuffer between threads.
+
+#include <algorithm>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include "scan_kernels.h"
+
+struct LineCol {
+    int line;
+    int column;
+};
+
+class SourceBuffer {
+    std::string_view src;
+    mutable std::vector<uint32_t> starts;    // starts[i] = offset of line i + 1
+
+public:
+    explicit SourceBuffer(std::string_view text) : src(text) {}
+
+    std::string_view text() const { return src; }
+
+    const std::vector<uint32_t>& lineStarts() const {
+        if (starts.empty()) {
+            starts.reserve(src.size() / 32 + 1);
+            starts.push_back(0);
+            lexKernels.indexNewlines(src.data(), src.data() + src.size(), 0, starts);
+        }
+        return starts;
+    }
+
+    size_t lineCount() const { return lineStarts().size(); }
+
+    LineCol locate(uint64_t offset) const {
+        const std::vector<uint32_t>& s = lineStarts();
+        size_t line = std::upper_bound(s.begin(), s.end(), uint32_t(offset)) - s.begin();
+        return {int(line), int(offset - s[line - 1]) + 1};
+    }
+};
+
+// Looks up offsets that mostly go forward. Moving to the next line or two
+// is a comparison each; anything else falls back to a binary search.
+class LineCursor {
+    const std::vector<uint32_t>* starts;
+    size_t line = 1;                          // 1-based; starts[line - 1] <= last offset
+
+public:
+    explicit LineCursor(const SourceBuffer& src) : starts(&src.lineStarts()) {}
+
+    LineCol locate(uint64_t offset) {
+        const std::vector<uint32_t>& s = *starts;
+        uint32_t at = uint32_t(offset);
+        if (at < s[line - 1]) {
+            line = std::upper_bound(s.begin(), s.begin() + line, at) - s.begin();
+        } else {
+            int steps = 0;
+            while (line < s.size() && s[line] <= at) {
+                if (++steps == 4) {
+                    line = std::upper_bound(s.begin() + line, s.end(), at) - s.begin();
+                    break;
+                }
+                line++;
+            }
+        }
+        return {int(line), int(at - s[line - 1]) + 1};
+    }
+};
+
+#endif
@@ -0,0 +1,368 @@
+#ifndef TOKEN_CACHE_H
+#define TOKEN_CACHE_H
+
+// Persistent cache of lexer results, keyed by the content of the input.
+//
+//     TokenCache cache(dir, maxBytes);
+//     CacheKey key = makeCacheKey(source, "my_lexer/1");
+//     if (CacheEntry hit = cache.lookup(key)) {
+//         CacheArray<uint32_t> lines = hit.array<uint32_t>(SECTION_LINES);
+//         ...
+//     } else {
+//         CacheWriter w;
+//         w.add(SECTION_LINES, lines.data(), lines.size());
+//         cache.store(key, w);
+//     }
+//
+// Each entry is one file, <key>.lexc: a header, a table of sections and
+// the sections themselves, 8-byte aligned so a hit is used in place
+// straight from the mapping. The header carries a format version, the key,
+// and a hash of the payload, so a stale or damaged entry reads as a miss.
+// The tool string is part of the key. Bump it when a lexer changes what
+// it stores or how it lexes.
+//
+// Several processes may share one directory:
+//   - entries are written to a private temporary file and renamed into
+//     place, so a reader sees a whole entry or none;
+//   - a reader keeps its mapping even if the entry is evicted meanwhile;
+//   - the total size is kept in .usage under an flock on .lock. When it
+//     passes the limit, the directory is rescanned and the entries with
+//     the oldest modification time go first. A hit touches its entry,
+//     so that order is least recently used.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// XXH64 (Yann Collet's xxHash, 64-bit variant).
+inline uint64_t xxh64(const void *data, size_t len, uint64_t seed = 0) {
+    const uint64_t P1 = 0x9E3779B185EBCA87ull, P2 = 0xC2B2AE3D27D4EB4Full,
+                   P3 = 0x165667B19E3779F9ull, P4 = 0x85EBCA77C2B2AE63ull,
+                   P5 = 0x27D4EB2F165667C5ull;
+    auto rotl = [](uint64_t x, int r) { return (x << r) | (x >> (64 - r)); };
+    auto read64 = [](const uint8_t *p) { uint64_t v; memcpy(&v, p, 8); return v; };
+    auto read32 = [](const uint8_t *p) { uint32_t v; memcpy(&v, p, 4); return v; };
+    auto round = [&](uint64_t acc, uint64_t in) { return rotl(acc + in * P2, 31) * P1; };
+    auto merge = [&](uint64_t h, uint64_t v) { return (h ^ round(0, v)) * P1 + P4; };
+
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    const uint8_t *end = p + len;
+    uint64_t h;
+    if (len >= 32) {
+        uint64_t v1 = seed + P1 + P2, v2 = seed + P2, v3 = seed, v4 = seed - P1;
+        for (; p + 32 <= end; p += 32) {
+            v1 = round(v1, read64(p));
+            v2 = round(v2, read64(p + 8));
+            v3 = round(v3, read64(p + 16));
+            v4 = round(v4, read64(p + 24));
+        }
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = merge(merge(merge(merge(h, v1), v2), v3), v4);
+    } else {
+        h = seed + P5;
+    }
+    h += len;
+    for (; p + 8 <= end; p += 8) h = rotl(h ^ round(0, read64(p)), 27) * P1 + P4;
+    if (p + 4 <= end) {
+        h = rotl(h ^ (read32(p) * P1), 23) * P2 + P3;
+        p += 4;
+    }
+    for (; p < end; p++) h = rotl(h ^ (*p * P5), 11) * P1;
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    return h ^ (h >> 32);
+}
+
+struct CacheKey {
+    uint64_t lo, hi, size;
+
+    std::string name() const {
+        char s[64];
+        snprintf(s, sizeof s, "%016llx%016llx", (unsigned long long)hi, (unsigned long long)lo);
+        return s;
+    }
+};
+
+// 128 bits of content hash plus the length; `tool` seeds the second half.
+inline CacheKey makeCacheKey(std::string_view content, std::string_view tool) {
+    uint64_t seed = xxh64(tool.data(), tool.size());
+    return {xxh64(content.data(), content.size()), xxh64(content.data(), content.size(), seed),
+            content.size()};
+}
+
+template <class T>
+struct CacheArray {
+    const T *data = nullptr;
+    size_t size = 0;
+    const T &operator[](size_t i) const { return data[i]; }
+    const T *begin() const { return data; }
+    const T *end() const { return data + size; }
+};
+
+namespace token_cache_detail {
+const char MAGIC[8] = {'L', 'E', 'X', 'C', 'A', 'C', 'H', 'E'};
+const uint32_t FORMAT_VERSION = 1;
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t sectionCount;
+    uint64_t keyLo, keyHi, sourceSize;
+    uint64_t fileSize;
+    uint64_t payloadHash;       // of everything after the section table
+};
+
+struct Section {
+    uint32_t id;
+    uint32_t reserved;
+    uint64_t offset;            // from the start of the file
+    uint64_t size;              // in bytes
+};
+
+inline size_t align8(size_t n) { return (n + 7) & ~size_t(7); }
+
+inline bool valid(const char *base, size_t length, const CacheKey &key) {
+    if (length < sizeof(Header)) return false;
+    const Header *h = reinterpret_cast<const Header *>(base);
+    if (memcmp(h->magic, MAGIC, sizeof MAGIC) != 0 || h->version != FORMAT_VERSION) return false;
+    if (h->keyLo != key.lo || h->keyHi != key.hi || h->sourceSize != key.size) return false;
+    if (h->fileSize != length) return false;
+    size_t tableEnd = sizeof(Header) + size_t(h->sectionCount) * sizeof(Section);
+    if (h->sectionCount > 1024 || tableEnd > length) return false;
+    const Section *s = reinterpret_cast<const Section *>(h + 1);
+    for (uint32_t i = 0; i < h->sectionCount; i++)
+        if (s[i].offset < tableEnd || s[i].offset > length || s[i].size > length - s[i].offset)
+            return false;
+    return xxh64(base + tableEnd, length - tableEnd) == h->payloadHash;
+}
+
+// Section `id` of a valid image; empty if there is none.
+inline std::string_view section(const char *base, uint32_t id) {
+    const Header *h = reinterpret_cast<const Header *>(base);
+    const Section *s = reinterpret_cast<const Section *>(h + 1);
+    for (uint32_t i = 0; i < h->sectionCount; i++)
+        if (s[i].id == id) return std::string_view(base + s[i].offset, s[i].size);
+    return {};
+}
+
+inline bool writeAll(int fd, const char *p, size_t n) {
+    while (n) {
+        ssize_t w = ::write(fd, p, n);
+        if (w <= 0) return false;
+        p += w;
+        n -= w;
+    }
+    return true;
+}
+}
+
+// A mapped cache entry; evaluates to false on a miss.
+class CacheEntry {
+    const char *base = nullptr;
+    size_t length = 0;
+
+public:
+    CacheEntry() = default;
+    CacheEntry(const char *base, size_t length) : base(base), length(length) {}
+    CacheEntry(CacheEntry &&o) noexcept : base(o.base), length(o.length) { o.base = nullptr; }
+    CacheEntry &operator=(CacheEntry &&o) noexcept {
+        std::swap(base, o.base);
+        std::swap(length, o.length);
+        return *this;
+    }
+    ~CacheEntry() {
+        if (base) munmap(const_cast<char *>(base), length);
+    }
+
+    explicit operator bool() const { return base != nullptr; }
+    const char *data() const { return base; }
+    size_t size() const { return length; }
+
+    std::string_view section(uint32_t id) const { return token_cache_detail::section(base, id); }
+
+    template <class T>
+    CacheArray<T> array(uint32_t id) const {
+        std::string_view s = section(id);
+        return {reinterpret_cast<const T *>(s.data()), s.size() / sizeof(T)};
+    }
+};
+
+// Sections of an entry being built. The data is copied on add().
+class CacheWriter {
+    struct Pending {
+        uint32_t id;
+        std::string bytes;
+    };
+    std::vector<Pending> sections;
+
+public:
+    void add(uint32_t id, const void *data, size_t bytes) {
+        sections.push_back({id, std::string(static_cast<const char *>(data), bytes)});
+    }
+    template <class T>
+    void add(uint32_t id, const std::vector<T> &v) {
+        add(id, v.data(), v.size() * sizeof(T));
+    }
+
+    // The complete file image for `key`.
+    std::string image(const CacheKey &key) const {
+        using namespace token_cache_detail;
+        size_t tableEnd = sizeof(Header) + sections.size() * sizeof(Section);
+        size_t at = align8(tableEnd);
+        std::vector<Section> table;
+        for (const Pending &p : sections) {
+            table.push_back({p.id, 0, at, p.bytes.size()});
+            at = align8(at + p.bytes.size());
+        }
+        std::string file(at, '\0');
+        for (size_t i = 0; i < sections.size(); i++)
+            memcpy(&file[table[i].offset], sections[i].bytes.data(), sections[i].bytes.size());
+        memcpy(&file[sizeof(Header)], table.data(), table.size() * sizeof(Section));
+
+        Header h;
+        memcpy(h.magic, MAGIC, sizeof MAGIC);
+        h.version = FORMAT_VERSION;
+        h.sectionCount = uint32_t(sections.size());
+        h.keyLo = key.lo;
+        h.keyHi = key.hi;
+        h.sourceSize = key.size;
+        h.fileSize = file.size();
+        h.payloadHash = xxh64(file.data() + tableEnd, file.size() - tableEnd);
+        memcpy(&file[0], &h, sizeof h);
+        return file;
+    }
+};
+
+// Maps one entry file; a miss if it is missing, damaged or for another key.
+inline CacheEntry mapCacheFile(const std::string &file, const CacheKey &key) {
+    int fd = ::open(file.c_str(), O_RDONLY);
+    if (fd < 0) return {};
+    struct stat st;
+    void *p = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+        p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) return {};
+    CacheEntry entry(static_cast<const char *>(p), st.st_size);
+    if (!token_cache_detail::valid(static_cast<const char *>(p), st.st_size, key)) return {};
+    return entry;
+}
+
+// Writes `bytes` to `tmp` and renames it over `file`, so a reader sees the
+// old file or the new one, never a partial one.
+inline bool replaceFile(const std::string &file, const std::string &tmp, std::string_view bytes) {
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) return false;
+    bool ok = token_cache_detail::writeAll(fd, bytes.data(), bytes.size());
+    ::close(fd);
+    if (!ok || rename(tmp.c_str(), file.c_str()) != 0) {
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+class TokenCache {
+    std::string dir;
+    uint64_t maxBytes;
+
+    std::string path(const std::string &name) const { return dir + "/" + name; }
+
+    // Adds `delta` to the recorded total and evicts if it is over the
+    // limit. Runs under the directory lock.
+    void account(int64_t delta) {
+        int lock = ::open(path(".lock").c_str(), O_RDWR | O_CREAT, 0644);
+        if (lock < 0) return;
+        flock(lock, LOCK_EX);
+
+        uint64_t total = 0;
+        int usage = ::open(path(".usage").c_str(), O_RDWR | O_CREAT, 0644);
+        if (usage >= 0 && pread(usage, &total, sizeof total, 0) != sizeof total) total = 0;
+        total = uint64_t(std::max<int64_t>(0, int64_t(total) + delta));
+        if (total > maxBytes) total = evict();
+        if (usage >= 0) {
+            if (pwrite(usage, &total, sizeof total, 0) != sizeof total) { /* recounted next time */ }
+            ::close(usage);
+        }
+
+        flock(lock, LOCK_UN);
+        ::close(lock);
+    }
+
+    // Rescans the directory, drops least recently used entries until the
+    // rest fit in three quarters of the limit, and returns what is left.
+    // Temporary files left behind by crashed writers are removed too.
+    uint64_t evict() {
+        struct File {
+            std::string name;
+            uint64_t size;
+            time_t used;
+        };
+        std::vector<File> files;
+        uint64_t total = 0;
+        time_t now = time(nullptr);
+        if (DIR *d = opendir(dir.c_str())) {
+            while (dirent *e = readdir(d)) {
+                std::string name = e->d_name;
+                struct stat st;
+                if (stat(path(name).c_str(), &st) != 0 || !S_ISREG(st.st_mode)) continue;
+                if (name.rfind(".tmp.", 0) == 0) {
+                    if (now - st.st_mtime > 3600) unlink(path(name).c_str());
+                } else if (name.size() > 5 && name.compare(name.size() - 5, 5, ".lexc") == 0) {
+                    files.push_back({name, uint64_t(st.st_size), st.st_mtime});
+                    total += st.st_size;
+                }
+            }
+            closedir(d);
+        }
+        std::sort(files.begin(), files.end(),
+                  [](const File &a, const File &b) { return a.used < b.used; });
+        for (const File &f : files) {
+            if (total <= maxBytes / 4 * 3) break;
+            if (unlink(path(f.name).c_str()) == 0) total -= f.size;
+        }
+        return total;
+    }
+
+public:
+    TokenCache(std::string dir, uint64_t maxBytes) : dir(std::move(dir)), maxBytes(maxBytes) {
+        mkdir(this->dir.c_str(), 0755);
+    }
+
+    CacheEntry lookup(const CacheKey &key) const {
+        std::string file = path(key.name() + ".lexc");
+        CacheEntry entry = mapCacheFile(file, key);
+        if (entry) utimensat(AT_FDCWD, file.c_str(), nullptr, 0);       // mark as recently used
+        return entry;
+    }
+
+    // False if the entry could not be written; the cache is only an
+    // optimisation, so callers carry on either way.
+    bool store(const CacheKey &key, const CacheWriter &w) {
+        std::string image = w.image(key);
+        static std::atomic<unsigned> counter{0};
+        std::string tmp = path(".tmp." + std::to_string(getpid()) + "." + std::to_string(counter++));
+        std::string file = path(key.name() + ".lexc");
+        struct stat old;
+        int64_t replaced = stat(file.c_str(), &old) == 0 ? old.st_size : 0;
+        if (!replaceFile(file, tmp, image)) return false;
+        account(int64_t(image.size()) - replaced);
+        return true;
+    }
+};
+
+#endif
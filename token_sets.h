@@ -0,0 +1,103 @@
+#ifndef TOKEN_SETS_H
+#define TOKEN_SETS_H
+
+// Compile-time lookup tables for the fixed keyword/operator/symbol sets used
+// by the lexers. Everything here is built by the compiler, so a membership
+// test is a hash, one table load and a length-checked compare on a
+// string_view -- no std::string temporaries and no heap.
+//
+// A lexer picks its own set by naming a struct with a `words` array:
+//
+//     struct MyKeywords {
+//         static constexpr std::string_view words[] = {"if", "else", ...};
+//     };
+//     using Keywords = PerfectHashSet<MyKeywords>;
+//     Keywords::contains(sv);
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string_view>
+
+// 256-bit membership bitmap for single-character sets such as "(){};,".
+class CharSet {
+    uint64_t bits[4] = {0, 0, 0, 0};
+public:
+    constexpr CharSet(std::string_view chars) {
+        for (char c : chars) {
+            unsigned char u = static_cast<unsigned char>(c);
+            bits[u >> 6] |= uint64_t(1) << (u & 63);
+        }
+    }
+    constexpr bool contains(char c) const {
+        unsigned char u = static_cast<unsigned char>(c);
+        return (bits[u >> 6] >> (u & 63)) & 1;
+    }
+};
+
+template <class Words>
+class PerfectHashSet {
+    static constexpr std::size_t N = std::size(Words::words);
+
+    static constexpr std::size_t tableSize() {
+        std::size_t m = 1;
+        while (m < 4 * N) m <<= 1;
+        return m;
+    }
+    static constexpr std::size_t M = tableSize();
+
+    // Length, first, second and last byte are enough to tell every word of
+    // the lexers' sets apart; the seed is searched for at compile time so
+    // that they also land in distinct slots.
+    static constexpr uint32_t hash(std::string_view s, uint32_t seed) {
+        uint32_t h = seed ^ static_cast<uint32_t>(s.size());
+        h = h * 0x9E3779B1u + static_cast<unsigned char>(s[0]);
+        h = h * 0x9E3779B1u + static_cast<unsigned char>(s[s.size() > 1 ? 1 : 0]);
+        h = h * 0x9E3779B1u + static_cast<unsigned char>(s[s.size() - 1]);
+        return h ^ (h >> 15);
+    }
+
+    struct Table {
+        uint32_t seed = 0;
+        std::size_t minLen = ~std::size_t(0), maxLen = 0;
+        std::array<std::string_view, M> slots{};
+    };
+
+    static constexpr bool tryBuild(Table &t, uint32_t seed) {
+        t.slots = {};
+        t.seed = seed;
+        for (std::size_t i = 0; i < N; i++) {
+            std::string_view w = Words::words[i];
+            std::string_view &slot = t.slots[hash(w, seed) & (M - 1)];
+            if (!slot.empty()) return false;
+            slot = w;
+        }
+        return true;
+    }
+
+    static constexpr Table build() {
+        Table t;
+        for (std::size_t i = 0; i < N; i++) {
+            std::size_t len = Words::words[i].size();
+            if (len < t.minLen) t.minLen = len;
+            if (len > t.maxLen) t.maxLen = len;
+        }
+        for (uint32_t seed = 1; seed < 100000; seed++)
+            if (tryBuild(t, seed)) return t;
+        t.seed = 0;                                  // no seed found; caught below
+        return t;
+    }
+
+    static constexpr Table table = build();
+    static_assert(table.seed != 0, "no collision-free seed for this word set");
+
+public:
+    static constexpr bool contains(std::string_view s) {
+        if (s.size() < table.minLen || s.size() > table.maxLen) return false;
+        std::string_view slot = table.slots[hash(s, table.seed) & (M - 1)];
+        return slot.size() == s.size() && slot == s;
+    }
+};
+
+#endif
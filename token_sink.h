@@ -0,0 +1,174 @@
+#ifndef TOKEN_SINK_H
+#define TOKEN_SINK_H
+
+// Output layer for per-token dumps. Records are formatted into one reusable
+// buffer and handed to stdio in large blocks, instead of one flushed write
+// per token. Numbers go through std::to_chars.
+//
+// Each lexer keeps its own text format by subclassing TokenSink; the CSV
+// and JSON-lines backends are shared:
+//
+//     csv:   line,column,kind,lexeme     (kind "error" carries the message)
+//     jsonl: {"line":3,"column":1,"kind":"keyword","lexeme":"int"}
+//            {"line":4,"column":7,"kind":"error","message":"Invalid token '9a'"}
+//
+// JSON strings must be UTF-8, so the jsonl backend writes each invalid
+// sequence in a lexeme (its maximal subpart, see utf8.h) as \ufffd.
+
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <vector>
+#include "utf8.h"
+
+class OutputBuffer {
+    std::FILE* f;
+    std::vector<char> buf;
+    size_t used = 0;
+public:
+    explicit OutputBuffer(std::FILE* f = stdout, size_t capacity = 1 << 16)
+        : f(f), buf(capacity) {}
+    ~OutputBuffer() { flush(); }
+
+    void put(std::string_view s) {
+        if (used + s.size() > buf.size()) {
+            flush();
+            if (s.size() > buf.size()) {
+                std::fwrite(s.data(), 1, s.size(), f);
+                return;
+            }
+        }
+        memcpy(buf.data() + used, s.data(), s.size());
+        used += s.size();
+    }
+    void put(char c) {
+        if (used == buf.size()) flush();
+        buf[used++] = c;
+    }
+    void put(long long v) {
+        char tmp[24];
+        auto r = std::to_chars(tmp, tmp + sizeof tmp, v);
+        put(std::string_view(tmp, r.ptr - tmp));
+    }
+    void put(int v) { put((long long)v); }
+
+    void flush() {
+        if (used) std::fwrite(buf.data(), 1, used, f);
+        used = 0;
+        std::fflush(f);
+    }
+};
+
+class TokenSink {
+public:
+    virtual ~TokenSink() {}
+    virtual void token(int line, int column, std::string_view kind, std::string_view lexeme) = 0;
+    virtual void error(int line, int column, std::string_view message) = 0;
+    // Must be called before anything else is written to stdout.
+    void flush() { out.flush(); }
+protected:
+    OutputBuffer out;
+};
+
+// --quiet: per-token records are dropped.
+class NullSink : public TokenSink {
+public:
+    void token(int, int, std::string_view, std::string_view) override {}
+    void error(int, int, std::string_view) override {}
+};
+
+class CsvSink : public TokenSink {
+    void field(std::string_view s) {
+        out.put('"');
+        for (char c : s) {
+            if (c == '"') out.put('"');
+            out.put(c);
+        }
+        out.put('"');
+    }
+public:
+    CsvSink() { out.put(std::string_view("line,column,kind,lexeme\n")); }
+    void token(int line, int column, std::string_view kind, std::string_view lexeme) override {
+        out.put(line);
+        out.put(',');
+        out.put(column);
+        out.put(',');
+        field(kind);
+        out.put(',');
+        field(lexeme);
+        out.put('\n');
+    }
+    void error(int line, int column, std::string_view message) override {
+        token(line, column, "error", message);
+    }
+};
+
+class JsonlSink : public TokenSink {
+    void str(std::string_view s) {
+        static const char hex[] = "0123456789abcdef";
+        out.put('"');
+        const char* end = s.data() + s.size();
+        for (const char* p = s.data(); p < end;) {
+            char c = *p;
+            unsigned char u = static_cast<unsigned char>(c);
+            if (u >= 0x80) {
+                if (size_t n = utf8SequenceLength(p, end)) {
+                    out.put(std::string_view(p, n));
+                    p += n;
+                } else {
+                    out.put(std::string_view("\\ufffd"));
+                    p += utf8ErrorLength(p, end);
+                }
+                continue;
+            }
+            p++;
+            if (c == '"' || c == '\\') {
+                out.put('\\');
+                out.put(c);
+            } else if (u < 0x20) {
+                out.put(std::string_view("\\u00"));
+                out.put(hex[u >> 4]);
+                out.put(hex[u & 15]);
+            } else {
+                out.put(c);
+            }
+        }
+        out.put('"');
+    }
+    void record(int line, int column, std::string_view kind, std::string_view key, std::string_view value) {
+        out.put(std::string_view("{\"line\":"));
+        out.put(line);
+        out.put(std::string_view(",\"column\":"));
+        out.put(column);
+        out.put(std::string_view(",\"kind\":"));
+        str(kind);
+        out.put(std::string_view(",\""));
+        out.put(key);
+        out.put(std::string_view("\":"));
+        str(value);
+        out.put(std::string_view("}\n"));
+    }
+public:
+    void token(int line, int column, std::string_view kind, std::string_view lexeme) override {
+        record(line, column, kind, "lexeme", lexeme);
+    }
+    void error(int line, int column, std::string_view message) override {
+        record(line, column, "error", "message", message);
+    }
+};
+
+// Builds the backend named on the command line ("text", "csv", "jsonl");
+// TextSink is the calling lexer's own text format. Returns null for an
+// unknown name.
+template <class TextSink>
+std::unique_ptr<TokenSink> makeTokenSink(std::string_view format, bool quiet) {
+    if (quiet) return std::make_unique<NullSink>();
+    if (format == "text") return std::make_unique<TextSink>();
+    if (format == "csv") return std::make_unique<CsvSink>();
+    if (format == "jsonl") return std::make_unique<JsonlSink>();
+    return nullptr;
+}
+
+#endif
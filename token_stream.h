@@ -0,0 +1,357 @@
+#ifndef TOKEN_STREAM_H
+#define TOKEN_STREAM_H
+
+// Compact binary form of a lexer's token stream, for archiving.
+//
+//     TokenStreamWriter w(out);               // any std::ostream
+//     for (const LexToken& t : lex) w.add(t);
+//     w.finish();
+//
+//     TokenStreamReader r(bytes);             // the whole file, e.g. readAll()
+//     TokenStreamReader::Cursor c = r.fromLine(120);
+//     for (LexToken t; c.next(t); ) ...
+//
+// Tokens go in blocks of blockTokens. A block holds the kinds of its
+// tokens as one byte each (TokenKind | LexErrorKind << 4), then one record
+// per token of varints, each relative to the token before:
+//
+//     gap         zigzag: offset minus the end of the previous token
+//     line        0: same line, column moved as far as the offset;
+//                 1: same line, then the zigzag column correction;
+//                 n >= 2: zigzag line delta n - 2, then the column
+//     lexeme      index into the string table
+//
+// The gap is usually 0 or 1 and the line 0, so a typical token takes four
+// bytes, the kind included. Each distinct lexeme is
+// stored once, in the string table after the last block. After that comes
+// the skip index: per block, where it starts and the offset, line and
+// column it is delta-coded from. A reader seeks to a token or a line
+// through it and decodes at most one block to get there. Seeking by line
+// needs lines that do not go down, which holds for every lexer here.
+//
+// A file is "LXTK", a version, the blocks, the string table, the skip
+// index, and a fixed 32-byte trailer that says where the last two start.
+// Numeric values are not stored; the reader decodes them from the text
+// again, as IncrementalLexer does.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "arena.h"
+#include "lexer.h"
+
+namespace token_stream_detail {
+
+const char magic[4] = {'L', 'X', 'T', 'K'};
+const uint32_t version = 1;
+const size_t headerBytes = 8, trailerBytes = 32;
+
+inline void putVarint(std::string& out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(char(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(char(v));
+}
+
+inline uint64_t zigzag(int64_t v) { return (uint64_t(v) << 1) ^ uint64_t(v >> 63); }
+inline int64_t unzigzag(uint64_t v) { return int64_t(v >> 1) ^ -int64_t(v & 1); }
+
+// Fixed-width fields are little-endian whatever the host is.
+inline void putFixed(std::string& out, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; i++) out.push_back(char(v >> (8 * i)));
+}
+
+inline uint64_t getFixed(const char* p, int bytes) {
+    uint64_t v = 0;
+    for (int i = 0; i < bytes; i++) v |= uint64_t((unsigned char)p[i]) << (8 * i);
+    return v;
+}
+
+[[noreturn]] inline void malformed(const char* what) {
+    throw std::runtime_error(std::string("token stream: ") + what);
+}
+
+// Reads a varint at p, no further than end.
+inline uint64_t getVarint(const char*& p, const char* end) {
+    uint64_t v = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        unsigned char b = *p++;
+        v |= uint64_t(b & 0x7f) << shift;
+        if (!(b & 0x80)) return v;
+    }
+    malformed("truncated varint");
+}
+
+// The state a token is delta-coded from: the token before it.
+struct Position {
+    uint64_t offset = 0, end = 0;
+    int64_t line = 0, column = 0;
+};
+
+// Where a block starts in the file, and the state its first token is
+// coded from.
+struct SkipEntry {
+    uint64_t position;
+    Position from;
+};
+
+}  // namespace token_stream_detail
+
+class TokenStreamWriter {
+public:
+    explicit TokenStreamWriter(std::ostream& out, uint32_t blockTokens = 128)
+        : out(out), blockTokens(blockTokens ? blockTokens : 1) {
+        using namespace token_stream_detail;
+        std::string header(magic, 4);
+        putFixed(header, version, 4);
+        write(header);
+    }
+
+    TokenStreamWriter(const TokenStreamWriter&) = delete;
+    TokenStreamWriter& operator=(const TokenStreamWriter&) = delete;
+
+    void add(const LexToken& t) {
+        using namespace token_stream_detail;
+        if (kinds.size() == blockTokens) flushBlock();
+        if (kinds.empty()) index.push_back({written, last});
+
+        kinds.push_back(char(uint8_t(t.kind) | uint8_t(t.error) << 4));
+        putVarint(records, zigzag(int64_t(t.offset - last.end)));
+        if (t.line != last.line) {
+            putVarint(records, zigzag(t.line - last.line) + 2);
+            putVarint(records, uint64_t(t.column));
+        } else if (int64_t correction = t.column - last.column - int64_t(t.offset - last.offset)) {
+            putVarint(records, 1);
+            putVarint(records, zigzag(correction));
+        } else {
+            putVarint(records, 0);
+        }
+        putVarint(records, intern(t.text));
+        last = {t.offset, t.offset + t.text.size(), t.line, t.column};
+        count++;
+    }
+
+    // Writes the last block, the string table, the skip index and the
+    // trailer. Nothing may be added after.
+    void finish() {
+        using namespace token_stream_detail;
+        flushBlock();
+        uint64_t stringsAt = written;
+        std::string s;
+        putVarint(s, strings.size());
+        for (std::string_view str : strings) {
+            putVarint(s, str.size());
+            s.append(str);
+        }
+        write(s);
+
+        uint64_t indexAt = written;
+        s.clear();
+        for (const SkipEntry& e : index) {
+            putVarint(s, e.position);
+            putVarint(s, e.from.offset);
+            putVarint(s, e.from.end - e.from.offset);
+            putVarint(s, uint64_t(e.from.line));
+            putVarint(s, uint64_t(e.from.column));
+        }
+        putFixed(s, count, 8);
+        putFixed(s, stringsAt, 8);
+        putFixed(s, indexAt, 8);
+        putFixed(s, blockTokens, 4);
+        s.append(magic, 4);
+        write(s);
+        out.flush();
+    }
+
+    uint64_t bytesWritten() const { return written; }
+
+private:
+    std::ostream& out;
+    uint32_t blockTokens;
+    std::string kinds, records;     // the block being filled
+    token_stream_detail::Position last;
+    std::vector<token_stream_detail::SkipEntry> index;
+    uint64_t count = 0, written = 0;
+
+    Arena text;                     // lexemes; `strings` and `ids` view into it
+    std::vector<std::string_view> strings;
+    std::unordered_map<std::string_view, uint32_t> ids;
+
+    uint32_t intern(std::string_view s) {
+        auto it = ids.find(s);
+        if (it != ids.end()) return it->second;
+        std::string_view copy = text.copy(s);
+        strings.push_back(copy);
+        ids.emplace(copy, uint32_t(strings.size() - 1));
+        return uint32_t(strings.size() - 1);
+    }
+
+    void write(const std::string& s) {
+        out.write(s.data(), std::streamsize(s.size()));
+        written += s.size();
+    }
+
+    void flushBlock() {
+        write(kinds);
+        write(records);
+        kinds.clear();
+        records.clear();
+    }
+};
+
+// Reads a stream in place: token texts are views into `data`, which must
+// outlive the reader and its cursors. Throws std::runtime_error if the
+// trailer, the string table or the index is malformed, and a cursor throws
+// the same if it runs into a damaged block.
+class TokenStreamReader {
+    using SkipEntry = token_stream_detail::SkipEntry;
+
+public:
+    explicit TokenStreamReader(std::string_view data) : data(data) {
+        using namespace token_stream_detail;
+        if (data.size() < headerBytes + trailerBytes || memcmp(data.data(), magic, 4) != 0 ||
+            memcmp(data.data() + data.size() - 4, magic, 4) != 0)
+            malformed("not a token stream");
+        if (getFixed(data.data() + 4, 4) != version) malformed("unsupported version");
+
+        const char* trailer = data.data() + data.size() - trailerBytes;
+        count = getFixed(trailer, 8);
+        uint64_t stringsAt = getFixed(trailer + 8, 8);
+        uint64_t indexAt = getFixed(trailer + 16, 8);
+        blockTokens = uint32_t(getFixed(trailer + 24, 4));
+        uint64_t trailerAt = data.size() - trailerBytes;
+        if (blockTokens == 0 || stringsAt < headerBytes || stringsAt > indexAt || indexAt > trailerAt)
+            malformed("bad trailer");
+        blocksEnd = stringsAt;
+
+        const char* p = data.data() + stringsAt;
+        const char* end = data.data() + indexAt;
+        uint64_t n = getVarint(p, end);
+        if (n > uint64_t(end - p)) malformed("bad string table");
+        strings.reserve(n);
+        for (uint64_t i = 0; i < n; i++) {
+            uint64_t len = getVarint(p, end);
+            if (len > uint64_t(end - p)) malformed("bad string table");
+            strings.emplace_back(p, len);
+            p += len;
+        }
+
+        p = end;
+        end = data.data() + trailerAt;
+        uint64_t blocks = count / blockTokens + (count % blockTokens != 0);
+        if (blocks > uint64_t(end - p)) malformed("bad skip index");
+        index.reserve(blocks);
+        while (p < end) {
+            SkipEntry e;
+            e.position = getVarint(p, end);
+            e.from.offset = getVarint(p, end);
+            e.from.end = e.from.offset + getVarint(p, end);
+            e.from.line = int64_t(getVarint(p, end));
+            e.from.column = int64_t(getVarint(p, end));
+            if (e.position < headerBytes || e.position > blocksEnd) malformed("bad skip index");
+            index.push_back(e);
+        }
+        if (index.size() != blocks) malformed("bad skip index");
+    }
+
+    size_t size() const { return count; }
+
+    class Cursor {
+    public:
+        // Fills tok with the next token; false after the last one.
+        bool next(LexToken& tok) {
+            using namespace token_stream_detail;
+            if (i >= r->count) return false;
+            if (left == 0) startBlock(i / r->blockTokens);
+            const char* end = r->data.data() + r->blocksEnd;
+            uint8_t kind = uint8_t(*kinds++);
+            uint64_t offset = last.end + uint64_t(unzigzag(getVarint(p, end)));
+            uint64_t line = getVarint(p, end);
+            if (line >= 2) {
+                last.line += unzigzag(line - 2);
+                last.column = int64_t(getVarint(p, end));
+            } else {
+                last.column += int64_t(offset - last.offset) + (line ? unzigzag(getVarint(p, end)) : 0);
+            }
+            uint64_t id = getVarint(p, end);
+            if (id >= r->strings.size() || (kind & 15) > uint8_t(TokenKind::Error) ||
+                (kind >> 4) > uint8_t(LexErrorKind::InvalidUtf8))
+                malformed("bad token record");
+            std::string_view text = r->strings[id];
+            last.offset = offset;
+            last.end = offset + text.size();
+            tok = {TokenKind(kind & 15), LexErrorKind(kind >> 4), text, offset, int(last.line), int(last.column), {}};
+            if (tok.kind == TokenKind::Num) decodeNumber(tok.text, tok.number);
+            i++;
+            left--;
+            return true;
+        }
+
+        size_t index() const { return i; }
+
+    private:
+        friend class TokenStreamReader;
+        const TokenStreamReader* r;
+        uint64_t i;                     // index of the token next() returns
+        size_t left = 0;                // tokens left in the current block
+        const char* kinds = nullptr;
+        const char* p = nullptr;        // next record
+        token_stream_detail::Position last;
+
+        explicit Cursor(const TokenStreamReader* r) : r(r), i(r->count) {}
+
+        void startBlock(uint64_t b) {
+            const SkipEntry& e = r->index[b];
+            left = size_t(std::min<uint64_t>(r->blockTokens, r->count - b * r->blockTokens));
+            if (left > r->blocksEnd - e.position) token_stream_detail::malformed("bad block");
+            kinds = r->data.data() + e.position;
+            p = kinds + left;
+            last = e.from;
+        }
+    };
+
+    // A cursor at token i (at the end if i >= size()).
+    Cursor at(uint64_t i) const {
+        Cursor c(this);
+        if (i >= count) return c;
+        c.i = i - i % blockTokens;
+        c.startBlock(c.i / blockTokens);
+        LexToken skipped;
+        while (c.i < i) c.next(skipped);
+        return c;
+    }
+
+    // A cursor at the first token on `line` or after it.
+    Cursor fromLine(int line) const {
+        // The last block that starts after a token before `line`; every
+        // token before it is on an earlier line
+        size_t lo = 0, hi = index.size();
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (index[mid].from.line < line) lo = mid + 1;
+            else hi = mid;
+        }
+        Cursor c = at(uint64_t(lo ? lo - 1 : 0) * blockTokens);
+        Cursor probe = c;
+        LexToken t;
+        while (probe.next(t) && t.line < line) c = probe;
+        return c;
+    }
+
+private:
+    std::string_view data;
+    uint64_t count = 0, blocksEnd = 0;
+    uint32_t blockTokens = 0;
+    std::vector<std::string_view> strings;
+    std::vector<SkipEntry> index;
+};
+
+#endif
@@ -0,0 +1,442 @@
+#ifndef UTF8_H
+#define UTF8_H
+
+// UTF-8 in C sources: the Unicode identifier and operator characters the
+// lexers accept, and the diagnostics for bytes that are not UTF-8.
+//
+//     if (size_t n = utf8SequenceLength(p, end)) {     // scan_kernels.h
+//         char32_t c = decodeUtf8(p, n);
+//         if (isXidStart(c)) ...
+//     }
+//     forEachInvalidUtf8(begin, end, [&](const char* bad, size_t n) { ... });
+//
+// Identifiers follow UAX #31, as in C23: a letter, '_' or XID_Start
+// character, then letters, digits, '_' or XID_Continue characters. The
+// two properties come from a two-level table: the 256-character block of
+// a code point picks one of a couple of hundred distinct 256-bit maps,
+// about 7 KB in all.
+//
+// The mathematical operators ≠ ≤ ≥ ∧ ∨ lex as the operators != <= >= && ||
+// and print as them.
+//
+// Validation goes through the validateUtf8 scan kernel, which passes ASCII
+// at one vector compare per 32 bytes, so ASCII sources pay next to
+// nothing for it. An invalid sequence is reported as its maximal subpart
+// (the longest prefix that could have started a well-formed sequence, or
+// one byte), and the scan picks up after it, as Unicode recommends for
+// replacing errors.
+
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include "scan_kernels.h"
+
+namespace utf8_detail {
+
+// Generated from Unicode 14.0.0 (XID_Start, XID_Continue); 186 maps.
+inline const uint64_t xidMaps[186][4] = {
+    {0x0000000000000000, 0x07fffffe07fffffe, 0x0420040000000000, 0xff7fffffff7fffff},
+    {0x03ff000000000000, 0x07fffffe87fffffe, 0x04a0040000000000, 0xff7fffffff7fffff},
+    {0xffffffffffffffff, 0xffffffffffffffff, 0xffffffffffffffff, 0xffffffffffffffff},
+    {0xffffffffffffffff, 0xffffffffffffffff, 0xffffffffffffffff, 0x0000501f0003ffc3},
+    {0x0000000000000000, 0xb8df000000000000, 0xfffffffbffffd740, 0xffbfffffffffffff},
+    {0xffffffffffffffff, 0xb8dfffffffffffff, 0xfffffffbffffd7c0, 0xffbfffffffffffff},
+    {0xffffffffffffffff, 0xffffffffffffffff, 0xfffffffffffffc03, 0xffffffffffffffff},
+    {0xffffffffffffffff, 0xffffffffffffffff, 0xfffffffffffffcfb, 0xffffffffffffffff},
+    {0xfffeffffffffffff, 0xffffffff027fffff, 0x00000000000001ff, 0x000787ffffff0000},
+    {0xfffeffffffffffff, 0xffffffff027fffff, 0xbffffffffffe01ff, 0x000787ffffff00b6},
+    {0xffffffff00000000, 0xfffec000000007ff, 0xffffffffffffffff, 0x9c00c060002fffff},
+    {0xffffffff07ff0000, 0xffffc3ffffffffff, 0xffffffffffffffff, 0x9ffffdff9fefffff},
+    {0x0000fffffffd0000, 0xffffffffffffe000, 0x0002003fffffffff, 0x043007fffffffc00},
+    {0xffffffffffff0000, 0xffffffffffffe7ff, 0x0003ffffffffffff, 0x243fffffffffffff},
+    {0x00000110043fffff, 0xffff07ff01ffffff, 0xffffffff00007eff, 0x00000000000003ff},
+    {0x00003fffffffffff, 0xffff07ff0fffffff, 0xffffffffff007eff, 0xfffffffbffffffff},
+    {0x23fffffffffffff0, 0xfffe0003ff010000, 0x23c5fdfffff99fe1, 0x10030003b0004000},
+    {0xffffffffffffffff, 0xfffeffcfffffffff, 0xf3c5fdfffff99fef, 0x5003ffcfb080799f},
+    {0x036dfdfffff987e0, 0x001c00005e000000, 0x23edfdfffffbbfe0, 0x0200000300010000},
+    {0xd36dfdfffff987ee, 0x003fffc05e023987, 0xf3edfdfffffbbfee, 0xfe00ffcf00013bbf},
+    {0x23edfdfffff99fe0, 0x00020003b0000000, 0x03ffc718d63dc7e8, 0x0000000000010000},
+    {0xf3edfdfffff99fee, 0x0002ffcfb0e0399f, 0xc3ffc718d63dc7ec, 0x0000ffc000813dc7},
+    {0x23fffdfffffddfe0, 0x0000000327000000, 0x23effdfffffddfe1, 0x0006000360000000},
+    {0xf3fffdfffffddfff, 0x0000ffcf27603ddf, 0xf3effdfffffddfef, 0x0006ffcf60603ddf},
+    {0x27fffffffffddff0, 0xfc00000380704000, 0x2ffbfffffc7fffe0, 0x000000000000007f},
+    {0xfffffffffffddfff, 0xfc00ffcf80f07ddf, 0x2ffbfffffc7fffee, 0x000cffc0ff5f847f},
+    {0x0005fffffffffffe, 0x000000000000007f, 0x2005ffaffffff7d6, 0x00000000f000005f},
+    {0x07fffffffffffffe, 0x0000000003ff7fff, 0x3fffffaffffff7d6, 0x00000000f3ff3f5f},
+    {0x0000000000000001, 0x00001ffffffffeff, 0x0000000000001f00, 0x0000000000000000},
+    {0xc2a003ff03000001, 0xfffe1ffffffffeff, 0x1ffffffffeffffdf, 0x0000000000000040},
+    {0x800007ffffffffff, 0xffe1c0623c3f0000, 0xffffffff00004003, 0xf7ffffffffff20bf},
+    {0xffffffffffffffff, 0xffffffffffff03ff, 0xffffffff3fffffff, 0xf7ffffffffff20bf},
+    {0xffffffffffffffff, 0xffffffff3d7f3dff, 0x7f3dffffffff3dff, 0xffffffffff7fff3d},
+    {0xffffffffff3dffff, 0x0000000007ffffff, 0xffffffff0000ffff, 0x3f3fffffffffffff},
+    {0xffffffffff3dffff, 0x0003fe00e7ffffff, 0xffffffff0000ffff, 0x3f3fffffffffffff},
+    {0xfffffffffffffffe, 0xffffffffffffffff, 0xffffffffffffffff, 0xffffffffffffffff},
+    {0xffffffffffffffff, 0xffff9fffffffffff, 0xffffffff07fffffe, 0x01ffc7ffffffffff},
+    {0x0003ffff8003ffff, 0x0001dfff0003ffff, 0x000fffffffffffff, 0x0000000010800000},
+    {0x001fffff803fffff, 0x000ddfff000fffff, 0xffffffffffffffff, 0x000003ff308fffff},
+    {0xffffffff00000000, 0x01ffffffffffffff, 0xffff05ffffffffff, 0x003fffffffffffff},
+    {0xffffffff03ffb800, 0x01ffffffffffffff, 0xffff07ffffffffff, 0x003fffffffffffff},
+    {0x000000007fffffff, 0x001f3fffffff0000, 0xffff0fffffffffff, 0x00000000000003ff},
+    {0x0fff0fff7fffffff, 0x001f3fffffffffc0, 0xffff0fffffffffff, 0x0000000007ff03ff},
+    {0xffffffff007fffff, 0x00000000001fffff, 0x0000008000000000, 0x0000000000000000},
+    {0xffffffff0fffffff, 0x9fffffff7fffffff, 0xbfff008003ff03ff, 0x0000000000007fff},
+    {0x000fffffffffffe0, 0x0000000000001fe0, 0xfc00c001fffffff8, 0x0000003fffffffff},
+    {0xffffffffffffffff, 0x000ff80003ff1fff, 0xffffffffffffffff, 0x000fffffffffffff},
+    {0x0000000fffffffff, 0x3ffffffffc00e000, 0xe7ffffffffff01ff, 0x046fde0000000000},
+    {0x00ffffffffffffff, 0x3fffffffffffe3ff, 0xe7ffffffffff01ff, 0x07fffffffff70000},
+    {0xffffffffffffffff, 0xffffffffffffffff, 0xffffffffffffffff, 0x0000000000000000},
+    {0xffffffff3f3fffff, 0x3fffffffaaff3f3f, 0x5fdfffffffffffff, 0x1fdc1fff0fcf1fdc},
+    {0x0000000000000000, 0x8002000000000000, 0x000000001fff0000, 0x0000000000000000},
+    {0x8000000000000000, 0x8002000000100001, 0x000000001fff0000, 0x0001ffe21fff0000},
+    {0xf3fffd503f2ffc84, 0xffffffff000043e0, 0x00000000000001ff, 0x0000000000000000},
+    {0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000},
+    {0xffffffffffffffff, 0xffffffffffffffff, 0xffffffffffffffff, 0x000c781fffffffff},
+    {0xffffffffffffffff, 0xffffffffffffffff, 0xffffffffffffffff, 0x000ff81fffffffff},
+    {0xffff20bfffffffff, 0x000080ffffffffff, 0x7f7f7f7f007fffff, 0x000000007f7f7f7f},
+    {0xffff20bfffffffff, 0x800080ffffffffff, 0x7f7f7f7f007fffff, 0xffffffff7f7f7f7f},
+    {0x1f3e03fe000000e0, 0xfffffffffffffffe, 0xfffffffee07fffff, 0xf7ffffffffffffff},
+    {0x1f3efffe000000e0, 0xfffffffffffffffe, 0xfffffffee67fffff, 0xf7ffffffffffffff},
+    {0xfffeffffffffffe0, 0xffffffffffffffff, 0xffffffff00007fff, 0xffff000000000000},
+    {0xffffffffffffffff, 0xffffffffffffffff, 0x0000000000001fff, 0x3fffffffffff0000},
+    {0x00000c00ffff1fff, 0x80007fffffffffff, 0xffffffff3fffffff, 0x0000ffffffffffff},
+    {0x00000fffffff1fff, 0xbff0ffffffffffff, 0xffffffffffffffff, 0x0003ffffffffffff},
+    {0xfffffffcff800000, 0xffffffffffffffff, 0xfffffffffffff9ff, 0xfffc000003eb07ff},
+    {0x00000007fffff7bb, 0x000fffffffffffff, 0x000ffffffffffffc, 0x68fc000000000000},
+    {0x000010ffffffffff, 0x000fffffffffffff, 0xffffffffffffffff, 0xe8ffffff03ff003f},
+    {0xffff003ffffffc00, 0x1fffffff0000007f, 0x0007fffffffffff0, 0x7c00ffdf00008000},
+    {0xffff3fffffffffff, 0x1fffffff000fffff, 0xffffffffffffffff, 0x7fffffff03ff8001},
+    {0x000001ffffffffff, 0xc47fffff00000ff7, 0x3e62ffffffffffff, 0x001c07ff38000005},
+    {0x007fffffffffffff, 0xfc7fffff03ff3fff, 0xffffffffffffffff, 0x007cffff38000007},
+    {0xffff7f7f007e7e7e, 0xffff03fff7ffffff, 0xffffffffffffffff, 0x00000007ffffffff},
+    {0xffff7f7f007e7e7e, 0xffff03fff7ffffff, 0xffffffffffffffff, 0x03ff37ffffffffff},
+    {0xffffffffffffffff, 0xffffffffffffffff, 0xffff000fffffffff, 0x0ffffffffffff87f},
+    {0xffffffffffffffff, 0xffff3fffffffffff, 0xffffffffffffffff, 0x0000000003ffffff},
+    {0x5f7ffdffa0f8007f, 0xffffffffffffffdb, 0x0003ffffffffffff, 0xfffffffffff80000},
+    {0x5f7ffdffe0f8007f, 0xffffffffffffffdb, 0x0003ffffffffffff, 0xfffffffffff80000},
+    {0xffffffffffffffff, 0xfffffff03fffffff, 0xffffffffffffffff, 0xffffffffffffffff},
+    {0x3fffffffffffffff, 0xffffffffffff0000, 0xfffffffffffcffff, 0x03ff0000000000ff},
+    {0x0000000000000000, 0xaa8a000000000000, 0xffffffffffffffff, 0x1fffffffffffffff},
+    {0x0018ffff0000ffff, 0xaa8a00000000e000, 0xffffffffffffffff, 0x1fffffffffffffff},
+    {0x07fffffe00000000, 0xffffffc007fffffe, 0x7fffffff3fffffff, 0x000000001cfcfcfc},
+    {0x87fffffe03ff0000, 0xffffffc007fffffe, 0x7fffffffffffffff, 0x000000001cfcfcfc},
+    {0xb7ffff7fffffefff, 0x000000003fff3fff, 0xffffffffffffffff, 0x07ffffffffffffff},
+    {0x0000000000000000, 0x001fffffffffffff, 0x0000000000000000, 0x0000000000000000},
+    {0x0000000000000000, 0x001fffffffffffff, 0x0000000000000000, 0x2000000000000000},
+    {0x0000000000000000, 0x0000000000000000, 0xffffffff1fffffff, 0x000000000001ffff},
+    {0x0000000000000000, 0x0000000000000000, 0xffffffff1fffffff, 0x000000010001ffff},
+    {0xffffe000ffffffff, 0x003fffffffff07ff, 0xffffffff3fffffff, 0x00000000003eff0f},
+    {0xffffe000ffffffff, 0x07ffffffffff07ff, 0xffffffff3fffffff, 0x00000000003eff0f},
+    {0xffffffffffffffff, 0xffffffffffffffff, 0xffff00003fffffff, 0x0fffffffff0fffff},
+    {0xffffffffffffffff, 0xffffffffffffffff, 0xffff03ff3fffffff, 0x0fffffffff0fffff},
+    {0xffff00ffffffffff, 0xf7ff000fffffffff, 0x1bfbfffbffb7f7ff, 0x0000000000000000},
+    {0x007fffffffffffff, 0x000000ff003fffff, 0x07fdffffffffffbf, 0x0000000000000000},
+    {0x91bffffffffffd3f, 0x007fffff003fffff, 0x000000007fffffff, 0x0037ffff00000000},
+    {0x03ffffff003fffff, 0x0000000000000000, 0xc0ffffffffffffff, 0x0000000000000000},
+    {0x003ffffffeef0001, 0x1fffffff00000000, 0x000000001fffffff, 0x0000001ffffffeff},
+    {0x873ffffffeeff06f, 0x1fffffff00000000, 0x000000001fffffff, 0x0000007ffffffeff},
+    {0x003fffffffffffff, 0x0007ffff003fffff, 0x000000000003ffff, 0x0000000000000000},
+    {0xffffffffffffffff, 0x00000000000001ff, 0x0007ffffffffffff, 0x0007ffffffffffff},
+    {0x0000000fffffffff, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000},
+    {0x03ff00ffffffffff, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000},
+    {0x0000000000000000, 0x0000000000000000, 0x000303ffffffffff, 0x0000000000000000},
+    {0x0000000000000000, 0x0000000000000000, 0x00031bffffffffff, 0x0000000000000000},
+    {0xffff00801fffffff, 0xffff00000000003f, 0xffff000000000003, 0x007fffff0000001f},
+    {0xffff00801fffffff, 0xffff00000001ffff, 0xffff00000000003f, 0x007fffff0000001f},
+    {0x00fffffffffffff8, 0x0026000000000000, 0x0000fffffffffff8, 0x000001ffffff0000},
+    {0xffffffffffffffff, 0x803fffc00000007f, 0x07ffffffffffffff, 0x03ff01ffffff0004},
+    {0x0000007ffffffff8, 0x0047ffffffff0090, 0x0007fffffffffff8, 0x000000001400001e},
+    {0xffdfffffffffffff, 0x004fffffffff00f0, 0xffffffffffffffff, 0x0000000017ffde1f},
+    {0x00000ffffffbffff, 0x0000000000000000, 0xffff01ffbfffbd7f, 0x000000007fffffff},
+    {0x40fffffffffbffff, 0x0000000000000000, 0xffff01ffbfffbd7f, 0x03ff07ffffffffff},
+    {0x23edfdfffff99fe0, 0x00000003e0010000, 0x0000000000000000, 0x0000000000000000},
+    {0xfbedfdfffff99fef, 0x001f1fcfe081399f, 0x0000000000000000, 0x0000000000000000},
+    {0x001fffffffffffff, 0x0000000380000780, 0x0000ffffffffffff, 0x00000000000000b0},
+    {0xffffffffffffffff, 0x00000003c3ff07ff, 0xffffffffffffffff, 0x0000000003ff00bf},
+    {0x0000000000000000, 0x0000000000000000, 0x00007fffffffffff, 0x000000000f000000},
+    {0x0000000000000000, 0x0000000000000000, 0xff3fffffffffffff, 0x000000003f000001},
+    {0x0000ffffffffffff, 0x0000000000000010, 0x010007ffffffffff, 0x0000000000000000},
+    {0xffffffffffffffff, 0x0000000003ff0011, 0x01ffffffffffffff, 0x00000000000003ff},
+    {0x0000000007ffffff, 0x000000000000007f, 0x0000000000000000, 0x0000000000000000},
+    {0x03ff0fffe7ffffff, 0x000000000000007f, 0x0000000000000000, 0x0000000000000000},
+    {0x00000fffffffffff, 0x0000000000000000, 0xffffffff00000000, 0x80000000ffffffff},
+    {0x07ffffffffffffff, 0x0000000000000000, 0xffffffff00000000, 0x800003ffffffffff},
+    {0x8000ffffff6ff27f, 0x0000000000000002, 0xfffffcff00000000, 0x0000000a0001ffff},
+    {0xf9bfffffff6ff27f, 0x0000000003ff000f, 0xfffffcff00000000, 0x0000001bfcffffff},
+    {0x0407fffffffff801, 0xfffffffff0010000, 0xffff0000200003ff, 0x01ffffffffffffff},
+    {0x7fffffffffffffff, 0xffffffffffff0080, 0xffff000023ffffff, 0x01ffffffffffffff},
+    {0x00007ffffffffdff, 0xfffc000000000001, 0x000000000000ffff, 0x0000000000000000},
+    {0xff7ffffffffffdff, 0xfffc000003ff0001, 0x007ffefffffcffff, 0x0000000000000000},
+    {0x0001fffffffffb7f, 0xfffffdbf00000040, 0x00000000010003ff, 0x0000000000000000},
+    {0xb47ffffffffffb7f, 0xfffffdbf03ff00ff, 0x000003ff01fb7fff, 0x0000000000000000},
+    {0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x0007ffff00000000},
+    {0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x007fffff00000000},
+    {0x0000000000000000, 0x0000000000000000, 0x0001000000000000, 0x0000000000000000},
+    {0xffffffffffffffff, 0xffffffffffffffff, 0x0000000003ffffff, 0x0000000000000000},
+    {0xffffffffffffffff, 0x00007fffffffffff, 0xffffffffffffffff, 0xffffffffffffffff},
+    {0xffffffffffffffff, 0x000000000000000f, 0x0000000000000000, 0x0000000000000000},
+    {0x0000000000000000, 0x0000000000000000, 0xffffffffffff0000, 0x0001ffffffffffff},
+    {0x00007fffffffffff, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000},
+    {0xffffffffffffffff, 0x000000000000007f, 0x0000000000000000, 0x0000000000000000},
+    {0x01ffffffffffffff, 0xffff00007fffffff, 0x7fffffffffffffff, 0x00003fffffff0000},
+    {0x01ffffffffffffff, 0xffff03ff7fffffff, 0x7fffffffffffffff, 0x001f3fffffff03ff},
+    {0x0000ffffffffffff, 0xe0fffff80000000f, 0x000000000000ffff, 0x0000000000000000},
+    {0x007fffffffffffff, 0xe0fffff803ff000f, 0x000000000000ffff, 0x0000000000000000},
+    {0x0000000000000000, 0xffffffffffffffff, 0x0000000000000000, 0x0000000000000000},
+    {0xffffffffffffffff, 0x00000000000107ff, 0x00000000fff80000, 0x0000000b00000000},
+    {0xffffffffffffffff, 0xffffffffffff87ff, 0x00000000ffff80ff, 0x0003001b00000000},
+    {0xffffffffffffffff, 0xffffffffffffffff, 0xffffffffffffffff, 0x00ffffffffffffff},
+    {0xffffffffffffffff, 0xffffffffffffffff, 0xffffffffffffffff, 0x00000000003fffff},
+    {0x00000000000001ff, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000},
+    {0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x6fef000000000000},
+    {0x00000007ffffffff, 0xffff00f000070000, 0xffffffffffffffff, 0xffffffffffffffff},
+    {0xffffffffffffffff, 0xffffffffffffffff, 0xffffffffffffffff, 0x0fffffffffffffff},
+    {0xffffffffffffffff, 0x1fff07ffffffffff, 0x0000000003ff01ff, 0x0000000000000000},
+    {0xffffffffffffffff, 0x1fff07ffffffffff, 0x0000000063ff01ff, 0x0000000000000000},
+    {0xffff3fffffffffff, 0x000000000000007f, 0x0000000000000000, 0x0000000000000000},
+    {0x0000000000000000, 0xf807e3e000000000, 0x00003c0000000fe7, 0x0000000000000000},
+    {0x0000000000000000, 0x000000000000001c, 0x0000000000000000, 0x0000000000000000},
+    {0xffffffffffffffff, 0xffffffffffdfffff, 0xebffde64dfffffff, 0xffffffffffffffef},
+    {0x7bffffffdfdfe7bf, 0xfffffffffffdfc5f, 0xffffffffffffffff, 0xffffffffffffffff},
+    {0xffffffffffffffff, 0xffffffffffffffff, 0xffffff3fffffffff, 0xf7fffffff7fffffd},
+    {0xffdfffffffdfffff, 0xffff7fffffff7fff, 0xfffffdfffffffdff, 0x0000000000000ff7},
+    {0xffdfffffffdfffff, 0xffff7fffffff7fff, 0xfffffdfffffffdff, 0xffffffffffffcff7},
+    {0xf87fffffffffffff, 0x00201fffffffffff, 0x0000fffef8000010, 0x0000000000000000},
+    {0x000000007fffffff, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000},
+    {0x000007dbf9ffff7f, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000},
+    {0x3f801fffffffffff, 0x0000000000004000, 0x0000000000000000, 0x0000000000000000},
+    {0x3fff1fffffffffff, 0x00000000000043ff, 0x0000000000000000, 0x0000000000000000},
+    {0x0000000000000000, 0x0000000000000000, 0x00003fffffff0000, 0x00000fffffffffff},
+    {0x0000000000000000, 0x0000000000000000, 0x00007fffffff0000, 0x03ffffffffffffff},
+    {0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x7fff6f7f00000000},
+    {0xffffffffffffffff, 0xffffffffffffffff, 0xffffffffffffffff, 0x000000000000001f},
+    {0xffffffffffffffff, 0xffffffffffffffff, 0xffffffffffffffff, 0x00000000007f001f},
+    {0xffffffffffffffff, 0x000000000000080f, 0x0000000000000000, 0x0000000000000000},
+    {0xffffffffffffffff, 0x0000000003ff0fff, 0x0000000000000000, 0x0000000000000000},
+    {0x0af7fe96ffffffef, 0x5ef7f796aa96ea84, 0x0ffffbee0ffffbff, 0x0000000000000000},
+    {0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x03ff000000000000},
+    {0xffffffffffffffff, 0xffffffffffffffff, 0xffffffffffffffff, 0x00000000ffffffff},
+    {0x01ffffffffffffff, 0xffffffffffffffff, 0xffffffffffffffff, 0xffffffffffffffff},
+    {0xffffffff3fffffff, 0xffffffffffffffff, 0xffffffffffffffff, 0xffffffffffffffff},
+    {0xffffffffffffffff, 0xffffffffffffffff, 0xffff0003ffffffff, 0xffffffffffffffff},
+    {0xffffffffffffffff, 0xffffffffffffffff, 0xffffffffffffffff, 0x00000001ffffffff},
+    {0x000000003fffffff, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000},
+    {0xffffffffffffffff, 0x00000000000007ff, 0x0000000000000000, 0x0000000000000000},
+};
+inline const uint8_t xidStartBlock[804] = {
+    0, 2, 3, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30, 2, 32, 33,
+    35, 2, 36, 37, 39, 41, 43, 45, 47, 49, 2, 50, 51, 53, 54, 54, 54, 54, 54, 54,
+    54, 54, 54, 54, 55, 57, 54, 54, 59, 61, 54, 54, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 49, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 62, 2, 63, 65, 66, 68, 70, 72, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 74, 54, 54, 54, 54,
+    54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54,
+    54, 54, 54, 54, 54, 54, 54, 54, 54, 2, 75, 76, 78, 79, 80, 82, 84, 85, 87, 89,
+    91, 93, 2, 94, 95, 96, 97, 99, 100, 101, 103, 105, 107, 109, 111, 113, 115, 117, 119, 121,
+    123, 125, 127, 54, 129, 131, 133, 135, 2, 2, 2, 136, 137, 138, 54, 54, 54, 54, 54, 54,
+    54, 54, 54, 139, 2, 2, 2, 2, 140, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54,
+    54, 54, 54, 54, 2, 2, 141, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54,
+    54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54,
+    2, 2, 142, 144, 54, 54, 146, 147, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 149, 2, 2, 2, 2, 150, 151, 54, 54,
+    54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54,
+    54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 152, 2, 153, 154, 54, 54, 54, 54, 54,
+    54, 54, 54, 54, 155, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54,
+    54, 54, 54, 54, 54, 54, 54, 54, 160, 161, 162, 163, 54, 54, 54, 54, 54, 54, 54, 166,
+    54, 168, 170, 54, 54, 54, 54, 172, 173, 175, 54, 54, 54, 54, 177, 54, 54, 54, 54, 54,
+    54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 179, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 180, 181, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 182, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 183, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54,
+    2, 2, 184, 54, 54, 54, 54, 54, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 185, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54,
+    54, 54, 54, 54,
+};
+inline const uint8_t xidContinueBlock[804] = {
+    1, 2, 3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 29, 31, 2, 32, 34,
+    35, 2, 36, 38, 40, 42, 44, 46, 48, 2, 2, 50, 52, 53, 54, 54, 54, 54, 54, 54,
+    54, 54, 54, 54, 56, 58, 54, 54, 60, 61, 54, 54, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 49, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 62, 2, 64, 65, 67, 69, 71, 73, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 74, 54, 54, 54, 54,
+    54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54,
+    54, 54, 54, 54, 54, 54, 54, 54, 54, 2, 75, 77, 78, 79, 81, 83, 84, 86, 88, 90,
+    92, 93, 2, 94, 95, 96, 98, 99, 100, 102, 104, 106, 108, 110, 112, 114, 116, 118, 120, 122,
+    124, 126, 128, 54, 130, 132, 134, 135, 2, 2, 2, 136, 137, 138, 54, 54, 54, 54, 54, 54,
+    54, 54, 54, 139, 2, 2, 2, 2, 140, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54,
+    54, 54, 54, 54, 2, 2, 141, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54,
+    54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54,
+    2, 2, 143, 145, 54, 54, 146, 148, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 149, 2, 2, 2, 2, 150, 151, 54, 54,
+    54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54,
+    54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 152, 2, 153, 154, 54, 54, 54, 54, 54,
+    54, 54, 54, 54, 156, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54,
+    54, 54, 54, 157, 54, 158, 159, 54, 160, 161, 162, 164, 54, 54, 165, 54, 54, 54, 54, 166,
+    167, 169, 171, 54, 54, 54, 54, 172, 174, 176, 54, 54, 54, 54, 177, 54, 54, 54, 54, 54,
+    54, 54, 54, 54, 54, 54, 54, 178, 54, 54, 54, 54, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 179, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 180, 181, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 182, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 183, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54,
+    2, 2, 184, 54, 54, 54, 54, 54, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 185, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54,
+    54, 54, 54, 54,
+};
+
+inline bool inMap(const uint8_t* blockMap, char32_t c) {
+    const uint64_t* map = xidMaps[blockMap[c >> 8]];
+    return (map[(c >> 6) & 3] >> (c & 63)) & 1;
+}
+
+}  // namespace utf8_detail
+
+// Code point of the well-formed sequence of n bytes at p.
+inline char32_t decodeUtf8(const char* p, size_t n) {
+    const unsigned char* s = reinterpret_cast<const unsigned char*>(p);
+    switch (n) {
+    case 1: return s[0];
+    case 2: return char32_t(s[0] & 0x1F) << 6 | (s[1] & 0x3F);
+    case 3: return char32_t(s[0] & 0x0F) << 12 | char32_t(s[1] & 0x3F) << 6 | (s[2] & 0x3F);
+    default:
+        return char32_t(s[0] & 0x07) << 18 | char32_t(s[1] & 0x3F) << 12 | char32_t(s[2] & 0x3F) << 6 |
+               (s[3] & 0x3F);
+    }
+}
+
+inline bool isXidStart(char32_t c) {
+    return c < 0x32400 && utf8_detail::inMap(utf8_detail::xidStartBlock, c);
+}
+
+inline bool isXidContinue(char32_t c) {
+    if (c >= 0x32400) return c >= 0xE0100 && c <= 0xE01EF;      // variation selectors
+    return utf8_detail::inMap(utf8_detail::xidContinueBlock, c);
+}
+
+// Skips the non-ASCII XID_Continue characters at p; stops at ASCII, at
+// any other character and at bytes that are not UTF-8.
+inline const char* skipXidContinue(const char* p, const char* end) {
+    while (p < end && (unsigned char)*p >= 0x80) {
+        size_t n = utf8SequenceLength(p, end);
+        if (!n || !isXidContinue(decodeUtf8(p, n))) break;
+        p += n;
+    }
+    return p;
+}
+
+// An identifier by the rule above, in well-formed UTF-8.
+inline bool isUnicodeIdentifier(std::string_view word) {
+    const char* p = word.data();
+    const char* end = p + word.size();
+    for (bool first = true; p < end; first = false) {
+        unsigned char c = *p;
+        if (c < 0x80) {
+            if (!(isalpha(c) || c == '_' || (!first && isdigit(c)))) return false;
+            p++;
+            continue;
+        }
+        size_t n = utf8SequenceLength(p, end);
+        if (!n) return false;
+        char32_t cp = decodeUtf8(p, n);
+        if (!(first ? isXidStart(cp) : isXidContinue(cp))) return false;
+        p += n;
+    }
+    return !word.empty();
+}
+
+// The ASCII operator a Unicode operator character stands for, or "".
+inline std::string_view asciiOperator(char32_t c) {
+    switch (c) {
+    case U'≠': return "!=";
+    case U'≤': return "<=";
+    case U'≥': return ">=";
+    case U'∧': return "&&";
+    case U'∨': return "||";
+    }
+    return {};
+}
+
+inline std::string_view asciiOperator(std::string_view symbol) {
+    size_t n = symbol.empty() ? 0 : utf8SequenceLength(symbol.data(), symbol.data() + symbol.size());
+    if (n == 0 || n != symbol.size()) return {};
+    return asciiOperator(decodeUtf8(symbol.data(), n));
+}
+
+// True if [p, end) is a proper prefix of some well-formed sequence: more
+// bytes could still make it valid.
+inline bool isUtf8Prefix(const char* p, const char* end) {
+    unsigned char c = *p;
+    size_t have = size_t(end - p);
+    size_t need = c >= 0xC2 && c <= 0xF4 ? (c < 0xE0 ? 2 : c < 0xF0 ? 3 : 4) : 0;
+    if (have == 0 || have >= need) return false;
+    // Complete it with the smallest continuation bytes the lead allows
+    char full[4] = {char(c), char(c == 0xE0 ? 0xA0 : c == 0xF0 ? 0x90 : 0x80), char(0x80), char(0x80)};
+    for (size_t i = 1; i < have; i++) full[i] = p[i];
+    return utf8SequenceLength(full, full + need) == need;
+}
+
+// Length of the maximal subpart of the invalid sequence at p.
+inline size_t utf8ErrorLength(const char* p, const char* end) {
+    size_t n = 1;
+    while (n < 3 && p + n < end && isUtf8Prefix(p, p + n + 1)) n++;
+    return n;
+}
+
+// The first invalid sequence in [p, end), or end. Short ASCII runs -- most
+// literals -- are settled inline, without a call through the kernel table.
+inline const char* findInvalidUtf8(const char* p, const char* end) {
+    const char* inlineEnd = end - p < 16 ? end : p + 16;
+    while (p < inlineEnd && (unsigned char)*p < 0x80) p++;
+    return p < end ? lexKernels.validateUtf8(p, end) : end;
+}
+
+// Calls f(bad, n) for each invalid sequence in [p, end), in order.
+template <class F>
+void forEachInvalidUtf8(const char* p, const char* end, F&& f) {
+    while ((p = findInvalidUtf8(p, end)) < end) {
+        size_t n = utf8ErrorLength(p, end);
+        f(p, n);
+        p += n;
+    }
+}
+
+// The bytes as \xHH escapes, for messages.
+inline std::string utf8Escaped(std::string_view bytes) {
+    std::string s;
+    for (unsigned char c : bytes) {
+        char hex[5];
+        snprintf(hex, sizeof hex, "\\x%02X", c);
+        s += hex;
+    }
+    return s;
+}
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef WORK_POOL_H
+#define WORK_POOL_H
+
+// Work-stealing loop over independent tasks, for the batch drivers.
+//
+//     runWorkStealing(files.size(), jobs, [&](size_t i, unsigned worker) { ... });
+//
+// Task indices are dealt out to the workers as contiguous ranges. A worker
+// takes tasks from the front of its own range; when that is empty it steals
+// the back half of another worker's range. A range is one 64-bit word
+// (begin << 32 | end) updated with compare-and-swap, so neither side ever
+// takes a lock. An index is handed out exactly once, so a word never returns
+// to a value it held before and the CAS cannot be fooled by ABA.
+//
+// `worker` is in [0, jobs) and stays the same for the whole run of one
+// thread, so tasks can keep per-thread state in a vector indexed by it.
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+class WorkRanges {
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> range{0};
+    };
+    std::vector<Slot> slots;
+
+    static uint64_t pack(uint32_t b, uint32_t e) { return (uint64_t(b) << 32) | e; }
+    static uint32_t begin(uint64_t r) { return uint32_t(r >> 32); }
+    static uint32_t end(uint64_t r) { return uint32_t(r); }
+
+public:
+    WorkRanges(size_t n, unsigned workers) : slots(workers) {
+        for (unsigned w = 0; w < workers; w++)
+            slots[w].range.store(pack(uint32_t(n * w / workers), uint32_t(n * (w + 1) / workers)),
+                                 std::memory_order_relaxed);
+    }
+
+    bool pop(unsigned self, size_t &task) {
+        std::atomic<uint64_t> &mine = slots[self].range;
+        uint64_t r = mine.load();
+        while (begin(r) < end(r)) {
+            if (mine.compare_exchange_weak(r, pack(begin(r) + 1, end(r)))) {
+                task = begin(r);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Moves the back half of some other worker's range into `self`'s
+    // (empty) slot. False once every range is empty.
+    bool steal(unsigned self) {
+        unsigned n = unsigned(slots.size());
+        for (unsigned k = 1; k < n; k++) {
+            std::atomic<uint64_t> &victim = slots[(self + k) % n].range;
+            uint64_t r = victim.load();
+            while (begin(r) < end(r)) {
+                uint32_t mid = begin(r) + (end(r) - begin(r)) / 2;
+                if (victim.compare_exchange_weak(r, pack(begin(r), mid))) {
+                    slots[self].range.store(pack(mid, end(r)));
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+};
+
+// The most workers a --jobs value is taken to ask for. Past the core count
+// more threads only contend, and each costs a WorkerState in the drivers.
+constexpr unsigned maxJobs = 256;
+
+template <class Task>
+void runWorkStealing(size_t n, unsigned jobs, Task &&task) {
+    jobs = unsigned(std::max<size_t>(1, std::min<size_t>(jobs, n)));
+    WorkRanges ranges(n, jobs);
+    auto worker = [&](unsigned self) {
+        size_t i;
+        do {
+            while (ranges.pop(self, i)) task(i, self);
+        } while (ranges.steal(self));
+    };
+    std::vector<std::thread> pool;
+    for (unsigned w = 1; w < jobs; w++) pool.emplace_back(worker, w);
+    worker(0);
+    for (std::thread &t : pool) t.join();
+}
+
+#endif